@@ -0,0 +1,120 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+#import <pthread.h>
+#import "PLStateMachineInlineExecutor.h"
+
+typedef struct PLStateMachineInlineWork {
+    struct PLStateMachineInlineWork *next;
+    dispatch_function_t function;
+    void *context;
+} PLStateMachineInlineWork;
+
+@implementation PLStateMachineInlineExecutor {
+@private
+    pthread_mutex_t _lock;
+    pthread_t volatile _owner;
+    //only touched by the owner
+    PLStateMachineInlineWork *_deferredHead;
+    PLStateMachineInlineWork *_deferredTail;
+}
+
+- (id)init {
+    self = [super init];
+    if (self) {
+        pthread_mutex_init(&_lock, NULL);
+    }
+
+    return self;
+}
+
+- (void)dealloc {
+    pthread_mutex_destroy(&_lock);
+}
+
+- (void)executeFunction:(dispatch_function_t)function context:(void *)context {
+    //scheduled from a running function, runs once that one returns
+    if ([self isCurrent]) {
+        PLStateMachineInlineWork *work = malloc(sizeof(PLStateMachineInlineWork));
+        work->next = NULL;
+        work->function = function;
+        work->context = context;
+        if (_deferredTail != NULL) {
+            _deferredTail->next = work;
+        } else {
+            _deferredHead = work;
+        }
+        _deferredTail = work;
+        return;
+    }
+
+    pthread_mutex_lock(&_lock);
+    _owner = pthread_self();
+    function(context);
+    while (_deferredHead != NULL) {
+        PLStateMachineInlineWork *work = _deferredHead;
+        _deferredHead = work->next;
+        if (_deferredHead == NULL) {
+            _deferredTail = NULL;
+        }
+        work->function(work->context);
+        free(work);
+    }
+    _owner = NULL;
+    pthread_mutex_unlock(&_lock);
+}
+
+- (BOOL)isCurrent {
+    //only ever equal to the caller if the caller set it
+    return _owner != NULL && pthread_equal(_owner, pthread_self());
+}
+
+- (void)waitForSemaphore:(dispatch_semaphore_t)semaphore {
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+}
+
+@end
@@ -0,0 +1,157 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+#import <pthread.h>
+#import "PLStateMachineManualExecutor.h"
+
+typedef struct PLStateMachineManualWork {
+    struct PLStateMachineManualWork *next;
+    dispatch_function_t function;
+    void *context;
+} PLStateMachineManualWork;
+
+@implementation PLStateMachineManualExecutor {
+@private
+    pthread_mutex_t _pendingLock;
+    PLStateMachineManualWork *_pendingHead;
+    PLStateMachineManualWork *_pendingTail;
+    NSUInteger _pendingCount;
+    pthread_mutex_t _drainLock;
+    pthread_t volatile _drainer;
+}
+
+@synthesize pendingCount = _pendingCount;
+
+- (id)init {
+    self = [super init];
+    if (self) {
+        pthread_mutex_init(&_pendingLock, NULL);
+        pthread_mutex_init(&_drainLock, NULL);
+    }
+
+    return self;
+}
+
+- (void)dealloc {
+    //contexts can hold references the functions give back, whatever was never drained runs now
+    [self drain];
+    pthread_mutex_destroy(&_pendingLock);
+    pthread_mutex_destroy(&_drainLock);
+}
+
+- (NSUInteger)pendingCount {
+    pthread_mutex_lock(&_pendingLock);
+    NSUInteger pendingCount = _pendingCount;
+    pthread_mutex_unlock(&_pendingLock);
+    return pendingCount;
+}
+
+- (void)executeFunction:(dispatch_function_t)function context:(void *)context {
+    PLStateMachineManualWork *work = malloc(sizeof(PLStateMachineManualWork));
+    work->next = NULL;
+    work->function = function;
+    work->context = context;
+
+    pthread_mutex_lock(&_pendingLock);
+    if (_pendingTail != NULL) {
+        _pendingTail->next = work;
+    } else {
+        _pendingHead = work;
+    }
+    _pendingTail = work;
+    ++_pendingCount;
+    pthread_mutex_unlock(&_pendingLock);
+}
+
+- (NSUInteger)drain {
+    if ([self isCurrent]) {
+        return 0;
+    }
+
+    NSUInteger runCount = 0;
+    pthread_mutex_lock(&_drainLock);
+    _drainer = pthread_self();
+    while (YES) {
+        pthread_mutex_lock(&_pendingLock);
+        PLStateMachineManualWork *work = _pendingHead;
+        _pendingHead = NULL;
+        _pendingTail = NULL;
+        _pendingCount = 0;
+        pthread_mutex_unlock(&_pendingLock);
+
+        if (work == NULL) {
+            break;
+        }
+
+        while (work != NULL) {
+            PLStateMachineManualWork *next = work->next;
+            work->function(work->context);
+            free(work);
+            work = next;
+            ++runCount;
+        }
+    }
+    _drainer = NULL;
+    pthread_mutex_unlock(&_drainLock);
+
+    return runCount;
+}
+
+- (BOOL)isCurrent {
+    return _drainer != NULL && pthread_equal(_drainer, pthread_self());
+}
+
+- (void)waitForSemaphore:(dispatch_semaphore_t)semaphore {
+    while (dispatch_semaphore_wait(semaphore, DISPATCH_TIME_NOW) != 0) {
+        //nothing left here means another thread is draining the function that signals
+        if ([self drain] == 0 && dispatch_semaphore_wait(semaphore, dispatch_time(DISPATCH_TIME_NOW, NSEC_PER_MSEC)) == 0) {
+            break;
+        }
+    }
+}
+
+@end
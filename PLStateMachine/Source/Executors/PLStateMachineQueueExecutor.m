@@ -0,0 +1,97 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+#import <libkern/OSAtomic.h>
+#import "PLStateMachineQueueExecutor.h"
+
+@implementation PLStateMachineQueueExecutor {
+@private
+    dispatch_queue_t _queue;
+}
+
+@synthesize queue = _queue;
+
+- (id)init {
+    self = [self initWithQueue:nil];
+    return self;
+}
+
+- (id)initWithQueue:(dispatch_queue_t)queue {
+    self = [super init];
+    if (self) {
+        _queue = queue;
+        static int32_t queueIdAutoKey = 0;
+        if (_queue == nil) {
+            int32_t queueId = OSAtomicIncrement32(&queueIdAutoKey) - 1;
+            _queue = dispatch_queue_create([[NSString stringWithFormat:@"fsm-%d", queueId] cStringUsingEncoding:NSASCIIStringEncoding], DISPATCH_QUEUE_SERIAL);
+        } else {
+            dispatch_retain(_queue);
+        }
+        dispatch_queue_set_specific(_queue, (__bridge const void *) self, (__bridge void *) self, NULL);
+    }
+
+    return self;
+}
+
+- (void)dealloc {
+    dispatch_queue_set_specific(_queue, (__bridge const void *) self, NULL, NULL);
+    dispatch_release(_queue);
+}
+
+- (void)executeFunction:(dispatch_function_t)function context:(void *)context {
+    dispatch_async_f(_queue, context, function);
+}
+
+- (BOOL)isCurrent {
+    return dispatch_get_specific((__bridge const void *) self) == (__bridge void *) self;
+}
+
+- (void)waitForSemaphore:(dispatch_semaphore_t)semaphore {
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+}
+
+@end
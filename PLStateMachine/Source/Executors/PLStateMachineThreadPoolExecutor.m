@@ -0,0 +1,232 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+#import <pthread.h>
+#import "PLStateMachineThreadPoolExecutor.h"
+
+typedef struct PLStateMachineThreadPoolWork {
+    struct PLStateMachineThreadPoolWork *next;
+    dispatch_function_t function;
+    void *context;
+} PLStateMachineThreadPoolWork;
+
+//outlives the executor until the last worker exits
+typedef struct PLStateMachineThreadPool {
+    pthread_mutex_t lock;
+    pthread_cond_t available;
+    PLStateMachineThreadPoolWork *head;
+    PLStateMachineThreadPoolWork *tail;
+    BOOL stopping;
+    NSUInteger liveThreadCount;
+} PLStateMachineThreadPool;
+
+static pthread_key_t PLStateMachineThreadPoolCurrentKey;
+static pthread_once_t PLStateMachineThreadPoolCurrentKeyOnce = PTHREAD_ONCE_INIT;
+
+static void PLStateMachineThreadPoolCreateCurrentKey(void) {
+    pthread_key_create(&PLStateMachineThreadPoolCurrentKey, NULL);
+}
+
+//called with the lock held
+static PLStateMachineThreadPoolWork *PLStateMachineThreadPoolTake(PLStateMachineThreadPool *pool) {
+    PLStateMachineThreadPoolWork *work = pool->head;
+    if (work != NULL) {
+        pool->head = work->next;
+        if (pool->head == NULL) {
+            pool->tail = NULL;
+        }
+    }
+    return work;
+}
+
+static void PLStateMachineThreadPoolRun(PLStateMachineThreadPoolWork *work) {
+    @autoreleasepool {
+        work->function(work->context);
+    }
+    free(work);
+}
+
+static void *PLStateMachineThreadPoolWorker(void *argument) {
+    PLStateMachineThreadPool *pool = argument;
+    pthread_setspecific(PLStateMachineThreadPoolCurrentKey, pool);
+
+    pthread_mutex_lock(&pool->lock);
+    while (YES) {
+        while (pool->head == NULL && !pool->stopping) {
+            pthread_cond_wait(&pool->available, &pool->lock);
+        }
+        //stopping, but only once everything scheduled has run
+        PLStateMachineThreadPoolWork *work = PLStateMachineThreadPoolTake(pool);
+        if (work == NULL) {
+            break;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        PLStateMachineThreadPoolRun(work);
+
+        pthread_mutex_lock(&pool->lock);
+    }
+    BOOL lastThread = --pool->liveThreadCount == 0;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (lastThread) {
+        pthread_cond_destroy(&pool->available);
+        pthread_mutex_destroy(&pool->lock);
+        free(pool);
+    }
+    return NULL;
+}
+
+@implementation PLStateMachineThreadPoolExecutor {
+@private
+    PLStateMachineThreadPool *_pool;
+    NSUInteger _threadCount;
+}
+
+@synthesize threadCount = _threadCount;
+
++ (PLStateMachineThreadPoolExecutor *)sharedExecutor {
+    static PLStateMachineThreadPoolExecutor *sharedExecutor = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedExecutor = [[PLStateMachineThreadPoolExecutor alloc] initWithThreadCount:0];
+    });
+    return sharedExecutor;
+}
+
+- (id)init {
+    self = [self initWithThreadCount:0];
+    return self;
+}
+
+- (id)initWithThreadCount:(NSUInteger)threadCount {
+    self = [super init];
+    if (self) {
+        pthread_once(&PLStateMachineThreadPoolCurrentKeyOnce, PLStateMachineThreadPoolCreateCurrentKey);
+
+        _threadCount = threadCount > 0 ? threadCount : [[NSProcessInfo processInfo] activeProcessorCount];
+        _pool = calloc(1, sizeof(PLStateMachineThreadPool));
+        pthread_mutex_init(&_pool->lock, NULL);
+        pthread_cond_init(&_pool->available, NULL);
+
+        //only the threads that started count, the last one to exit frees the pool
+        NSUInteger startedCount = 0;
+        for (NSUInteger i = 0; i < _threadCount; ++i) {
+            pthread_t thread;
+            if (pthread_create(&thread, NULL, PLStateMachineThreadPoolWorker, _pool) == 0) {
+                pthread_detach(thread);
+                ++startedCount;
+            }
+        }
+        if (startedCount == 0) {
+            pthread_cond_destroy(&_pool->available);
+            pthread_mutex_destroy(&_pool->lock);
+            free(_pool);
+            _pool = NULL;
+            return nil;
+        }
+        _threadCount = startedCount;
+        pthread_mutex_lock(&_pool->lock);
+        _pool->liveThreadCount += startedCount;
+        pthread_mutex_unlock(&_pool->lock);
+    }
+
+    return self;
+}
+
+- (void)dealloc {
+    if (_pool == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&_pool->lock);
+    _pool->stopping = YES;
+    pthread_cond_broadcast(&_pool->available);
+    pthread_mutex_unlock(&_pool->lock);
+}
+
+- (void)executeFunction:(dispatch_function_t)function context:(void *)context {
+    PLStateMachineThreadPoolWork *work = malloc(sizeof(PLStateMachineThreadPoolWork));
+    work->next = NULL;
+    work->function = function;
+    work->context = context;
+
+    pthread_mutex_lock(&_pool->lock);
+    if (_pool->tail != NULL) {
+        _pool->tail->next = work;
+    } else {
+        _pool->head = work;
+    }
+    _pool->tail = work;
+    pthread_cond_signal(&_pool->available);
+    pthread_mutex_unlock(&_pool->lock);
+}
+
+- (BOOL)isCurrent {
+    return pthread_getspecific(PLStateMachineThreadPoolCurrentKey) == _pool;
+}
+
+- (void)waitForSemaphore:(dispatch_semaphore_t)semaphore {
+    if (![self isCurrent]) {
+        dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+        return;
+    }
+
+    //the function that signals can be queued behind this one, with every worker waiting nothing else would run it
+    while (dispatch_semaphore_wait(semaphore, DISPATCH_TIME_NOW) != 0) {
+        pthread_mutex_lock(&_pool->lock);
+        PLStateMachineThreadPoolWork *work = PLStateMachineThreadPoolTake(_pool);
+        pthread_mutex_unlock(&_pool->lock);
+        if (work != NULL) {
+            PLStateMachineThreadPoolRun(work);
+        } else if (dispatch_semaphore_wait(semaphore, dispatch_time(DISPATCH_TIME_NOW, NSEC_PER_MSEC)) == 0) {
+            break;
+        }
+    }
+}
+
+@end
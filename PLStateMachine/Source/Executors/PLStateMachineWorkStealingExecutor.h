@@ -0,0 +1,90 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+#import <Foundation/Foundation.h>
+#import "PLStateMachineExecutor.h"
+
+/**
+* Executor scheduling machines over a fixed set of worker threads with work stealing. Thousands of machines share
+* the workers instead of one queue each, pass it, e.g. the sharedExecutor, when creating the machines.
+*
+* Every worker has a lock-free run queue of its own. Work scheduled from a worker, e.g. a trigger emitted to another
+* machine from a callback, stays on that worker and runs next, a limited number of times in a row before the run
+* queue gets its turn. Work scheduled from other threads goes through a shared injection queue. Idle workers steal
+* from the busy ones. A machine has at most one function in flight, so it never runs on two workers at once and its
+* triggers keep their order.
+*
+* A worker waiting for a machine runs other work meanwhile. Emitting to a full machine with
+* PLStateMachineOverflowPolicyBlock from a worker still blocks it, with every worker blocked that way nothing runs.
+*/
+@interface PLStateMachineWorkStealingExecutor : NSObject <PLStateMachineExecutor>
+
+/**
+* The number of worker threads
+*/
+@property(nonatomic, assign, readonly) NSUInteger threadCount;
+
+/**
+* The number of functions taken over from another worker's run queue so far
+*/
+@property(nonatomic, assign, readonly) uint64_t stealCount;
+
+/**
+* A process wide executor with one worker thread per active processor.
+*/
++ (PLStateMachineWorkStealingExecutor *)sharedExecutor;
+
+/**
+* Initializes a work stealing executor. The threads exit once the executor is deallocated and the functions
+* scheduled so far have run.
+*
+* @param threadCount the number of worker threads. If 0 is provided, one per active processor will be started.
+* @return the executor, with fewer threads if some couldn't be started, or nil if none could
+*/
+- (id)initWithThreadCount:(NSUInteger)threadCount;
+
+@end
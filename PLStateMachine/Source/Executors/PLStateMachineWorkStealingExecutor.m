@@ -0,0 +1,422 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+#import <libkern/OSAtomic.h>
+#import <pthread.h>
+#import "PLStateMachineWorkStealingExecutor.h"
+
+//slots of a worker's run queue, work beyond that goes through the injection queue
+#define PLSTATE_MACHINE_STEALING_QUEUE_CAPACITY 256
+//run-next picks in a row before the run queue gets a turn, machines waking each other up can't starve it
+static NSUInteger const kStealingRunNextLimit = 16;
+//picks between looks at the injection queue while a worker has work of its own
+static NSUInteger const kStealingInjectionInterval = 61;
+
+typedef struct PLStateMachineStealingWork {
+    struct PLStateMachineStealingWork *next;
+    dispatch_function_t function;
+    void *context;
+} PLStateMachineStealingWork;
+
+struct PLStateMachineStealingScheduler;
+
+//cache line aligned, workers only touch their neighbours' when stealing
+typedef struct PLStateMachineStealingWorker {
+    //a ring only the owner pushes to, the owner and thieves take from the head with a compare and swap
+    PLStateMachineStealingWork *volatile slots[PLSTATE_MACHINE_STEALING_QUEUE_CAPACITY];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    //runs before the queue, keeps a machine woken up by a callback on the same core
+    PLStateMachineStealingWork *volatile runNext;
+    NSUInteger runNextStreak;
+    NSUInteger pickCount;
+    struct PLStateMachineStealingScheduler *scheduler;
+    NSUInteger index;
+    uint32_t random;
+} __attribute__((aligned(64))) PLStateMachineStealingWorker;
+
+//outlives the executor until the last worker exits
+typedef struct PLStateMachineStealingScheduler {
+    PLStateMachineStealingWorker *workers;
+    NSUInteger workerCount;
+    volatile int64_t stealCount;
+
+    //work scheduled from other threads and overflowing run queues
+    pthread_mutex_t injectionLock;
+    PLStateMachineStealingWork *injectionHead;
+    PLStateMachineStealingWork *injectionTail;
+    volatile int32_t injectionCount;
+
+    pthread_mutex_t parkLock;
+    pthread_cond_t parked;
+    volatile int32_t idleCount;
+    BOOL stopping;
+    NSUInteger liveThreadCount;
+} PLStateMachineStealingScheduler;
+
+static pthread_key_t PLStateMachineStealingWorkerKey;
+static pthread_once_t PLStateMachineStealingWorkerKeyOnce = PTHREAD_ONCE_INIT;
+
+static void PLStateMachineStealingCreateWorkerKey(void) {
+    pthread_key_create(&PLStateMachineStealingWorkerKey, NULL);
+}
+
+static void PLStateMachineStealingInject(PLStateMachineStealingScheduler *scheduler, PLStateMachineStealingWork *work) {
+    pthread_mutex_lock(&scheduler->injectionLock);
+    if (scheduler->injectionTail != NULL) {
+        scheduler->injectionTail->next = work;
+    } else {
+        scheduler->injectionHead = work;
+    }
+    scheduler->injectionTail = work;
+    OSAtomicIncrement32Barrier(&scheduler->injectionCount);
+    pthread_mutex_unlock(&scheduler->injectionLock);
+}
+
+static PLStateMachineStealingWork *PLStateMachineStealingTakeInjected(PLStateMachineStealingScheduler *scheduler) {
+    //unlocked peek, a stale answer only costs a retry
+    if (scheduler->injectionCount == 0) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&scheduler->injectionLock);
+    PLStateMachineStealingWork *work = scheduler->injectionHead;
+    if (work != NULL) {
+        scheduler->injectionHead = work->next;
+        if (scheduler->injectionHead == NULL) {
+            scheduler->injectionTail = NULL;
+        }
+        OSAtomicDecrement32Barrier(&scheduler->injectionCount);
+        work->next = NULL;
+    }
+    pthread_mutex_unlock(&scheduler->injectionLock);
+    return work;
+}
+
+//owner only
+static void PLStateMachineStealingPushQueued(PLStateMachineStealingWorker *worker, PLStateMachineStealingWork *work) {
+    uint32_t tail = worker->tail;
+    OSMemoryBarrier();
+    if (tail - worker->head < PLSTATE_MACHINE_STEALING_QUEUE_CAPACITY) {
+        worker->slots[tail % PLSTATE_MACHINE_STEALING_QUEUE_CAPACITY] = work;
+        //the slot is written before thieves can see it
+        OSMemoryBarrier();
+        worker->tail = tail + 1;
+    } else {
+        PLStateMachineStealingInject(worker->scheduler, work);
+    }
+}
+
+static PLStateMachineStealingWork *PLStateMachineStealingTakeQueued(PLStateMachineStealingWorker *worker) {
+    while (YES) {
+        uint32_t head = worker->head;
+        OSMemoryBarrier();
+        if (head == worker->tail) {
+            return NULL;
+        }
+        //the owner doesn't reuse the slot before the head moves past it
+        PLStateMachineStealingWork *work = worker->slots[head % PLSTATE_MACHINE_STEALING_QUEUE_CAPACITY];
+        if (OSAtomicCompareAndSwap32Barrier((int32_t) head, (int32_t) (head + 1), (volatile int32_t *) &worker->head)) {
+            return work;
+        }
+    }
+}
+
+static PLStateMachineStealingWork *PLStateMachineStealingTakeRunNext(PLStateMachineStealingWorker *worker) {
+    while (YES) {
+        PLStateMachineStealingWork *work = worker->runNext;
+        if (work == NULL || OSAtomicCompareAndSwapPtrBarrier(work, NULL, (void *volatile *) &worker->runNext)) {
+            return work;
+        }
+    }
+}
+
+//owner only
+static void PLStateMachineStealingPushLocal(PLStateMachineStealingWorker *worker, PLStateMachineStealingWork *work) {
+    PLStateMachineStealingWork *kicked;
+    do {
+        kicked = worker->runNext;
+    } while (!OSAtomicCompareAndSwapPtrBarrier(kicked, work, (void *volatile *) &worker->runNext));
+    if (kicked != NULL) {
+        PLStateMachineStealingPushQueued(worker, kicked);
+    }
+}
+
+static PLStateMachineStealingWork *PLStateMachineStealingFind(PLStateMachineStealingWorker *worker) {
+    PLStateMachineStealingScheduler *scheduler = worker->scheduler;
+    PLStateMachineStealingWork *work = NULL;
+
+    //the injection queue gets a turn now and then, the worker's own work can't starve it
+    if (++worker->pickCount % kStealingInjectionInterval == 0) {
+        work = PLStateMachineStealingTakeInjected(scheduler);
+    }
+    if (work == NULL && worker->runNextStreak < kStealingRunNextLimit) {
+        work = PLStateMachineStealingTakeRunNext(worker);
+        if (work != NULL) {
+            ++worker->runNextStreak;
+            return work;
+        }
+    }
+    if (work == NULL) {
+        work = PLStateMachineStealingTakeQueued(worker);
+    }
+    if (work == NULL) {
+        work = PLStateMachineStealingTakeInjected(scheduler);
+    }
+    if (work == NULL) {
+        work = PLStateMachineStealingTakeRunNext(worker);
+    }
+    worker->runNextStreak = 0;
+    if (work != NULL) {
+        return work;
+    }
+
+    //victims are visited from a random start, so thieves don't all line up behind the same one
+    worker->random ^= worker->random << 13;
+    worker->random ^= worker->random >> 17;
+    worker->random ^= worker->random << 5;
+    NSUInteger start = worker->random % scheduler->workerCount;
+    //a victim's run-next is about to run on its own core, it's only taken once no queue has work
+    for (NSUInteger pass = 0; pass < 2; ++pass) {
+        for (NSUInteger i = 0; i < scheduler->workerCount; ++i) {
+            PLStateMachineStealingWorker *victim = &scheduler->workers[(start + i) % scheduler->workerCount];
+            if (victim == worker) {
+                continue;
+            }
+            work = pass == 0 ? PLStateMachineStealingTakeQueued(victim) : PLStateMachineStealingTakeRunNext(victim);
+            if (work != NULL) {
+                OSAtomicIncrement64(&scheduler->stealCount);
+                return work;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void PLStateMachineStealingWake(PLStateMachineStealingScheduler *scheduler) {
+    //the work is published before the idle count is read, a worker going idle rescans after counting itself
+    OSMemoryBarrier();
+    if (scheduler->idleCount > 0) {
+        pthread_mutex_lock(&scheduler->parkLock);
+        pthread_cond_signal(&scheduler->parked);
+        pthread_mutex_unlock(&scheduler->parkLock);
+    }
+}
+
+static void PLStateMachineStealingRun(PLStateMachineStealingWork *work) {
+    @autoreleasepool {
+        work->function(work->context);
+    }
+    free(work);
+}
+
+static void *PLStateMachineStealingWorkerMain(void *argument) {
+    PLStateMachineStealingWorker *worker = argument;
+    PLStateMachineStealingScheduler *scheduler = worker->scheduler;
+    pthread_setspecific(PLStateMachineStealingWorkerKey, worker);
+
+    while (YES) {
+        PLStateMachineStealingWork *work = PLStateMachineStealingFind(worker);
+        if (work != NULL) {
+            PLStateMachineStealingRun(work);
+            continue;
+        }
+
+        pthread_mutex_lock(&scheduler->parkLock);
+        OSAtomicIncrement32Barrier(&scheduler->idleCount);
+        work = PLStateMachineStealingFind(worker);
+        while (work == NULL && !scheduler->stopping) {
+            pthread_cond_wait(&scheduler->parked, &scheduler->parkLock);
+            work = PLStateMachineStealingFind(worker);
+        }
+        OSAtomicDecrement32Barrier(&scheduler->idleCount);
+        pthread_mutex_unlock(&scheduler->parkLock);
+
+        //stopping, but only once everything scheduled has run
+        if (work == NULL) {
+            break;
+        }
+        PLStateMachineStealingRun(work);
+    }
+
+    pthread_mutex_lock(&scheduler->parkLock);
+    BOOL lastThread = --scheduler->liveThreadCount == 0;
+    pthread_mutex_unlock(&scheduler->parkLock);
+
+    if (lastThread) {
+        pthread_cond_destroy(&scheduler->parked);
+        pthread_mutex_destroy(&scheduler->parkLock);
+        pthread_mutex_destroy(&scheduler->injectionLock);
+        free(scheduler->workers);
+        free(scheduler);
+    }
+    return NULL;
+}
+
+@implementation PLStateMachineWorkStealingExecutor {
+@private
+    PLStateMachineStealingScheduler *_scheduler;
+    NSUInteger _threadCount;
+}
+
++ (PLStateMachineWorkStealingExecutor *)sharedExecutor {
+    static PLStateMachineWorkStealingExecutor *sharedExecutor = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedExecutor = [[PLStateMachineWorkStealingExecutor alloc] initWithThreadCount:0];
+    });
+    return sharedExecutor;
+}
+
+- (id)init {
+    self = [self initWithThreadCount:0];
+    return self;
+}
+
+- (id)initWithThreadCount:(NSUInteger)threadCount {
+    self = [super init];
+    if (self) {
+        pthread_once(&PLStateMachineStealingWorkerKeyOnce, PLStateMachineStealingCreateWorkerKey);
+
+        _scheduler = calloc(1, sizeof(PLStateMachineStealingScheduler));
+        _scheduler->workerCount = threadCount > 0 ? threadCount : [[NSProcessInfo processInfo] activeProcessorCount];
+        pthread_mutex_init(&_scheduler->injectionLock, NULL);
+        pthread_mutex_init(&_scheduler->parkLock, NULL);
+        pthread_cond_init(&_scheduler->parked, NULL);
+
+        posix_memalign((void **) &_scheduler->workers, 64, _scheduler->workerCount * sizeof(PLStateMachineStealingWorker));
+        memset(_scheduler->workers, 0, _scheduler->workerCount * sizeof(PLStateMachineStealingWorker));
+        for (NSUInteger i = 0; i < _scheduler->workerCount; ++i) {
+            PLStateMachineStealingWorker *worker = &_scheduler->workers[i];
+            worker->scheduler = _scheduler;
+            worker->index = i;
+            worker->random = (uint32_t) (i * 2654435761u) | 1;
+        }
+
+        //a worker whose thread didn't start is never pushed to, only the threads that started count
+        for (NSUInteger i = 0; i < _scheduler->workerCount; ++i) {
+            pthread_t thread;
+            if (pthread_create(&thread, NULL, PLStateMachineStealingWorkerMain, &_scheduler->workers[i]) == 0) {
+                pthread_detach(thread);
+                ++_threadCount;
+            }
+        }
+        if (_threadCount == 0) {
+            pthread_cond_destroy(&_scheduler->parked);
+            pthread_mutex_destroy(&_scheduler->parkLock);
+            pthread_mutex_destroy(&_scheduler->injectionLock);
+            free(_scheduler->workers);
+            free(_scheduler);
+            _scheduler = NULL;
+            return nil;
+        }
+        pthread_mutex_lock(&_scheduler->parkLock);
+        _scheduler->liveThreadCount += _threadCount;
+        pthread_mutex_unlock(&_scheduler->parkLock);
+    }
+
+    return self;
+}
+
+- (void)dealloc {
+    if (_scheduler == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&_scheduler->parkLock);
+    _scheduler->stopping = YES;
+    pthread_cond_broadcast(&_scheduler->parked);
+    pthread_mutex_unlock(&_scheduler->parkLock);
+}
+
+- (NSUInteger)threadCount {
+    return _threadCount;
+}
+
+- (uint64_t)stealCount {
+    return (uint64_t) _scheduler->stealCount;
+}
+
+- (void)executeFunction:(dispatch_function_t)function context:(void *)context {
+    PLStateMachineStealingWork *work = malloc(sizeof(PLStateMachineStealingWork));
+    work->next = NULL;
+    work->function = function;
+    work->context = context;
+
+    PLStateMachineStealingWorker *current = pthread_getspecific(PLStateMachineStealingWorkerKey);
+    if (current != NULL && current->scheduler == _scheduler) {
+        PLStateMachineStealingPushLocal(current, work);
+    } else {
+        PLStateMachineStealingInject(_scheduler, work);
+    }
+    PLStateMachineStealingWake(_scheduler);
+}
+
+- (BOOL)isCurrent {
+    PLStateMachineStealingWorker *current = pthread_getspecific(PLStateMachineStealingWorkerKey);
+    return current != NULL && current->scheduler == _scheduler;
+}
+
+- (void)waitForSemaphore:(dispatch_semaphore_t)semaphore {
+    PLStateMachineStealingWorker *current = pthread_getspecific(PLStateMachineStealingWorkerKey);
+    if (current == NULL || current->scheduler != _scheduler) {
+        dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+        return;
+    }
+
+    //a blocked worker can hold the very function that signals, e.g. in its run-next slot, so it keeps working
+    while (dispatch_semaphore_wait(semaphore, DISPATCH_TIME_NOW) != 0) {
+        PLStateMachineStealingWork *work = PLStateMachineStealingFind(current);
+        if (work != NULL) {
+            PLStateMachineStealingRun(work);
+        } else if (dispatch_semaphore_wait(semaphore, dispatch_time(DISPATCH_TIME_NOW, NSEC_PER_MSEC)) == 0) {
+            break;
+        }
+    }
+}
+
+@end
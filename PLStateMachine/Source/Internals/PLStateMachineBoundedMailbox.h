@@ -0,0 +1,140 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+
+#import <Foundation/Foundation.h>
+#import <pthread.h>
+#import "PLStateMachine.h"
+#import "PLStateMachineTriggerRecord.h"
+#import "PLStateMachineLaneSchedule.h"
+#import "PLStateMachineTimerScheduler.h"
+
+/**
+* Multi-producer, single-consumer FIFO of trigger records holding at most capacity triggers.
+*
+* Unlike PLStateMachineMailbox it takes a lock, so it can drop the oldest trigger and replace a queued one in place.
+* Only single trigger records count against the capacity and are subject to the overflow policy, start, wait and
+* bookkeeping records are always accepted. The capacity is shared by the lanes of all priorities.
+*/
+typedef struct PLStateMachineBoundedMailboxLane {
+    PLStateMachineTriggerRecord *head;
+    PLStateMachineTriggerRecord *tail;
+    NSUInteger depth;
+    //stamped on the records, so a lane stays in ascending order whatever is removed from it
+    uint64_t pushedCount;
+} PLStateMachineBoundedMailboxLane;
+
+typedef struct PLStateMachineBoundedMailbox {
+    pthread_mutex_t lock;
+    pthread_cond_t notFull;
+    NSUInteger blockedCount;
+
+    PLStateMachineBoundedMailboxLane lanes[PLSTATE_MACHINE_PRIORITY_COUNT];
+    PLStateMachineLaneSchedule schedule;
+    //accepted and not processed yet, including the record being processed
+    NSUInteger pending;
+    NSUInteger capacity;
+    PLStateMachineOverflowPolicy policy;
+    //the time records are stamped with
+    PLStateMachineTimerScheduler *clock;
+    //PLStateMachineOverflowPolicyCoalesce only, trigger id to the queued record
+    CFMutableDictionaryRef queuedByTriggerId;
+
+    PLStateMachineQueueStatistics statistics;
+    PLStateMachineLaneStatistics laneStatistics[PLSTATE_MACHINE_PRIORITY_COUNT];
+} PLStateMachineBoundedMailbox;
+
+PLStateMachineBoundedMailbox *PLStateMachineBoundedMailboxCreate(NSUInteger capacity, PLStateMachineOverflowPolicy policy, PLStateMachineTimerScheduler *clock);
+
+/**
+* Records still queued are not released, the owner pops and discards them first.
+*/
+void PLStateMachineBoundedMailboxFree(PLStateMachineBoundedMailbox *mailbox);
+
+/**
+* Pushes a record, blocking the caller while the mailbox is full if the policy says so.
+*
+* @param mayBlock NO if the caller can't wait, e.g. a timer thread, a trigger it pushes with
+*        PLStateMachineOverflowPolicyBlock goes over the capacity instead
+* @param accepted set to NO if the record was rejected or dropped as the newest, the caller has to discard it
+* @param dropped set to a record the caller has to discard, the oldest trigger or the carrier of a replaced one
+* @return YES if the mailbox was empty, and a drain needs to be scheduled
+*/
+BOOL PLStateMachineBoundedMailboxPush(PLStateMachineBoundedMailbox *mailbox, PLStateMachineTriggerRecord *record, BOOL mayBlock, BOOL *accepted, PLStateMachineTriggerRecord **dropped);
+
+/**
+* Consumer only. Returns the oldest record of the lane picked by the schedule, or NULL if the mailbox is empty.
+*/
+PLStateMachineTriggerRecord *PLStateMachineBoundedMailboxPop(PLStateMachineBoundedMailbox *mailbox);
+
+/**
+* Consumer only. Has to be called once per popped record, after processing it.
+*
+* @return YES if there are more records to process, NO if the drain should end
+*/
+BOOL PLStateMachineBoundedMailboxDidProcess(PLStateMachineBoundedMailbox *mailbox);
+
+/**
+* Copies the number of records each lane took in so far into sequences, one per lane.
+*/
+void PLStateMachineBoundedMailboxCopySequences(PLStateMachineBoundedMailbox *mailbox, uint64_t *sequences);
+
+/**
+* Consumer only.
+*
+* @return YES if every record counted by PLStateMachineBoundedMailboxCopySequences into sequences left the mailbox
+*/
+BOOL PLStateMachineBoundedMailboxHasPopped(PLStateMachineBoundedMailbox *mailbox, const uint64_t *sequences);
+
+/**
+* @return the number of records accepted and not processed yet
+*/
+NSUInteger PLStateMachineBoundedMailboxPendingCount(PLStateMachineBoundedMailbox *mailbox);
+
+PLStateMachineQueueStatistics PLStateMachineBoundedMailboxStatistics(PLStateMachineBoundedMailbox *mailbox);
+
+PLStateMachineLaneStatistics PLStateMachineBoundedMailboxLaneStatistics(PLStateMachineBoundedMailbox *mailbox, PLStateMachineTriggerPriority priority);
@@ -0,0 +1,292 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+
+#import "PLStateMachineBoundedMailbox.h"
+
+static void PLStateMachineBoundedMailboxAppend(PLStateMachineBoundedMailbox *mailbox, PLStateMachineTriggerRecord *record) {
+    PLStateMachineBoundedMailboxLane *lane = &mailbox->lanes[record->priority];
+    record->next = NULL;
+    record->sequence = ++lane->pushedCount;
+    if (lane->tail != NULL) {
+        lane->tail->next = record;
+    } else {
+        lane->head = record;
+    }
+    lane->tail = record;
+    ++lane->depth;
+}
+
+static PLStateMachineTriggerRecord *PLStateMachineBoundedMailboxRemoveOldestTrigger(PLStateMachineBoundedMailbox *mailbox) {
+    //the least urgent lane gives up its trigger first
+    for (NSUInteger i = 0; i < PLSTATE_MACHINE_PRIORITY_COUNT; ++i) {
+        PLStateMachineBoundedMailboxLane *lane = &mailbox->lanes[i];
+
+        //bookkeeping records in front of it are rare, the walk is short
+        PLStateMachineTriggerRecord *previous = NULL;
+        PLStateMachineTriggerRecord *record = lane->head;
+        while (record != NULL && !PLStateMachineTriggerRecordIsTrigger(record)) {
+            previous = record;
+            record = record->next;
+        }
+        if (record == NULL) {
+            continue;
+        }
+
+        if (previous != NULL) {
+            previous->next = record->next;
+        } else {
+            lane->head = record->next;
+        }
+        if (lane->tail == record) {
+            lane->tail = previous;
+        }
+        record->next = NULL;
+        --lane->depth;
+        return record;
+    }
+    return NULL;
+}
+
+static void PLStateMachineBoundedMailboxUnindex(PLStateMachineBoundedMailbox *mailbox, PLStateMachineTriggerRecord *record) {
+    if (mailbox->queuedByTriggerId == NULL) {
+        return;
+    }
+
+    const void *triggerId = (const void *) ((__bridge PLStateMachineTrigger *) record->object).triggerId;
+    if (CFDictionaryGetValue(mailbox->queuedByTriggerId, triggerId) == record) {
+        CFDictionaryRemoveValue(mailbox->queuedByTriggerId, triggerId);
+    }
+}
+
+PLStateMachineBoundedMailbox *PLStateMachineBoundedMailboxCreate(NSUInteger capacity, PLStateMachineOverflowPolicy policy, PLStateMachineTimerScheduler *clock) {
+    PLStateMachineBoundedMailbox *mailbox = calloc(1, sizeof(PLStateMachineBoundedMailbox));
+    pthread_mutex_init(&mailbox->lock, NULL);
+    pthread_cond_init(&mailbox->notFull, NULL);
+    mailbox->capacity = capacity;
+    mailbox->policy = policy;
+    mailbox->clock = clock;
+    if (policy == PLStateMachineOverflowPolicyCoalesce) {
+        mailbox->queuedByTriggerId = CFDictionaryCreateMutable(NULL, 0, NULL, NULL);
+    }
+    return mailbox;
+}
+
+void PLStateMachineBoundedMailboxFree(PLStateMachineBoundedMailbox *mailbox) {
+    if (mailbox->queuedByTriggerId != NULL) {
+        CFRelease(mailbox->queuedByTriggerId);
+    }
+    pthread_cond_destroy(&mailbox->notFull);
+    pthread_mutex_destroy(&mailbox->lock);
+    free(mailbox);
+}
+
+BOOL PLStateMachineBoundedMailboxPush(PLStateMachineBoundedMailbox *mailbox, PLStateMachineTriggerRecord *record, BOOL mayBlock, BOOL *accepted, PLStateMachineTriggerRecord **dropped) {
+    *accepted = YES;
+    *dropped = NULL;
+    BOOL isTrigger = PLStateMachineTriggerRecordIsTrigger(record);
+    record->enqueuedAt = PLStateMachineTimerSchedulerNow(mailbox->clock);
+
+    pthread_mutex_lock(&mailbox->lock);
+    PLStateMachineQueueStatistics *statistics = &mailbox->statistics;
+    if (isTrigger && statistics->queuedTriggerCount >= mailbox->capacity) {
+        switch (mailbox->policy) {
+            case PLStateMachineOverflowPolicyBlock:
+                //a fired timer isn't lost, it's let in over the capacity like the bookkeeping records
+                if (!mayBlock) {
+                    break;
+                }
+                ++mailbox->blockedCount;
+                while (statistics->queuedTriggerCount >= mailbox->capacity) {
+                    pthread_cond_wait(&mailbox->notFull, &mailbox->lock);
+                }
+                --mailbox->blockedCount;
+                break;
+            case PLStateMachineOverflowPolicyFail:
+                ++statistics->rejectedTriggerCount;
+                *accepted = NO;
+                break;
+            case PLStateMachineOverflowPolicyDropNewest:
+                ++statistics->droppedTriggerCount;
+                *accepted = NO;
+                break;
+            case PLStateMachineOverflowPolicyDropOldest:
+                //takes over the slot, so the pending count doesn't change and the drain stays scheduled
+                *dropped = PLStateMachineBoundedMailboxRemoveOldestTrigger(mailbox);
+                PLStateMachineBoundedMailboxUnindex(mailbox, *dropped);
+                ++statistics->droppedTriggerCount;
+                --statistics->queuedTriggerCount;
+                break;
+            case PLStateMachineOverflowPolicyCoalesce: {
+                const void *triggerId = (const void *) ((__bridge PLStateMachineTrigger *) record->object).triggerId;
+                PLStateMachineTriggerRecord *queued = (PLStateMachineTriggerRecord *) CFDictionaryGetValue(mailbox->queuedByTriggerId, triggerId);
+                //the queued record stays in its lane and keeps its scope, a trigger emitted with others is dropped
+                if (queued != NULL && queued->priority == record->priority && queued->scope == record->scope) {
+                    //the queued record keeps its place and takes the newer trigger, the new one carries the older away
+                    const void *olderTrigger = queued->object;
+                    queued->object = record->object;
+                    record->object = olderTrigger;
+                    *dropped = record;
+                    ++statistics->coalescedTriggerCount;
+                } else {
+                    ++statistics->droppedTriggerCount;
+                    *accepted = NO;
+                }
+                pthread_mutex_unlock(&mailbox->lock);
+                return NO;
+            }
+        }
+        if (!*accepted) {
+            pthread_mutex_unlock(&mailbox->lock);
+            return NO;
+        }
+    }
+
+    PLStateMachineBoundedMailboxAppend(mailbox, record);
+    if (isTrigger) {
+        statistics->highWaterMark = MAX(statistics->highWaterMark, ++statistics->queuedTriggerCount);
+        //coalescable triggers are already replaced by key
+        if (mailbox->queuedByTriggerId != NULL && record->kind == PLStateMachineTriggerRecordKindTrigger) {
+            CFDictionarySetValue(mailbox->queuedByTriggerId, (const void *) ((__bridge PLStateMachineTrigger *) record->object).triggerId, record);
+        }
+    }
+    BOOL wasEmpty = NO;
+    if (*dropped == NULL) {
+        wasEmpty = mailbox->pending++ == 0;
+    }
+    pthread_mutex_unlock(&mailbox->lock);
+
+    return wasEmpty;
+}
+
+PLStateMachineTriggerRecord *PLStateMachineBoundedMailboxPop(PLStateMachineBoundedMailbox *mailbox) {
+    NSTimeInterval now = PLStateMachineTimerSchedulerNow(mailbox->clock);
+
+    pthread_mutex_lock(&mailbox->lock);
+    NSUInteger nonEmptyLanes = 0;
+    for (NSUInteger i = 0; i < PLSTATE_MACHINE_PRIORITY_COUNT; ++i) {
+        if (mailbox->lanes[i].head != NULL) {
+            nonEmptyLanes |= 1 << i;
+        }
+    }
+
+    PLStateMachineTriggerRecord *record = NULL;
+    if (nonEmptyLanes != 0) {
+        PLStateMachineTriggerPriority priority = PLStateMachineLaneSchedulePick(&mailbox->schedule, nonEmptyLanes);
+        PLStateMachineBoundedMailboxLane *lane = &mailbox->lanes[priority];
+        record = lane->head;
+        lane->head = record->next;
+        if (lane->head == NULL) {
+            lane->tail = NULL;
+        }
+        record->next = NULL;
+        --lane->depth;
+        //a barrier isn't a trigger the lane kept waiting
+        if (record->kind != PLStateMachineTriggerRecordKindBarrier) {
+            PLStateMachineLaneStatisticsRecord(&mailbox->laneStatistics[priority], record->enqueuedAt, now);
+        }
+
+        if (PLStateMachineTriggerRecordIsTrigger(record)) {
+            PLStateMachineBoundedMailboxUnindex(mailbox, record);
+            --mailbox->statistics.queuedTriggerCount;
+            if (mailbox->blockedCount > 0) {
+                pthread_cond_signal(&mailbox->notFull);
+            }
+        }
+    }
+    pthread_mutex_unlock(&mailbox->lock);
+    return record;
+}
+
+BOOL PLStateMachineBoundedMailboxDidProcess(PLStateMachineBoundedMailbox *mailbox) {
+    pthread_mutex_lock(&mailbox->lock);
+    BOOL more = --mailbox->pending > 0;
+    pthread_mutex_unlock(&mailbox->lock);
+    return more;
+}
+
+void PLStateMachineBoundedMailboxCopySequences(PLStateMachineBoundedMailbox *mailbox, uint64_t *sequences) {
+    pthread_mutex_lock(&mailbox->lock);
+    for (NSUInteger i = 0; i < PLSTATE_MACHINE_PRIORITY_COUNT; ++i) {
+        sequences[i] = mailbox->lanes[i].pushedCount;
+    }
+    pthread_mutex_unlock(&mailbox->lock);
+}
+
+BOOL PLStateMachineBoundedMailboxHasPopped(PLStateMachineBoundedMailbox *mailbox, const uint64_t *sequences) {
+    BOOL popped = YES;
+    pthread_mutex_lock(&mailbox->lock);
+    for (NSUInteger i = 0; i < PLSTATE_MACHINE_PRIORITY_COUNT && popped; ++i) {
+        //the head is the oldest record left, dropped ones may have been taken from behind it
+        PLStateMachineTriggerRecord *head = mailbox->lanes[i].head;
+        popped = head == NULL || head->sequence > sequences[i];
+    }
+    pthread_mutex_unlock(&mailbox->lock);
+    return popped;
+}
+
+NSUInteger PLStateMachineBoundedMailboxPendingCount(PLStateMachineBoundedMailbox *mailbox) {
+    pthread_mutex_lock(&mailbox->lock);
+    NSUInteger pending = mailbox->pending;
+    pthread_mutex_unlock(&mailbox->lock);
+    return pending;
+}
+
+PLStateMachineQueueStatistics PLStateMachineBoundedMailboxStatistics(PLStateMachineBoundedMailbox *mailbox) {
+    pthread_mutex_lock(&mailbox->lock);
+    PLStateMachineQueueStatistics statistics = mailbox->statistics;
+    pthread_mutex_unlock(&mailbox->lock);
+    return statistics;
+}
+
+PLStateMachineLaneStatistics PLStateMachineBoundedMailboxLaneStatistics(PLStateMachineBoundedMailbox *mailbox, PLStateMachineTriggerPriority priority) {
+    pthread_mutex_lock(&mailbox->lock);
+    PLStateMachineLaneStatistics statistics = mailbox->laneStatistics[priority];
+    statistics.depth = mailbox->lanes[priority].depth;
+    pthread_mutex_unlock(&mailbox->lock);
+    return statistics;
+}
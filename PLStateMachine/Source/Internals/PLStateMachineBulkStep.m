@@ -0,0 +1,120 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+
+#import "PLStateMachineBulkStep.h"
+
+#if defined(__SSSE3__)
+#import <tmmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#import <arm_neon.h>
+#endif
+
+NSUInteger PLStateMachineBulkStep8(uint8_t *states, uint8_t *prevStates, NSUInteger count, const PLStateMachineBulkStepTables *tables, PLStateMachinePoolHandle base, PLStateMachinePoolHandle *changed) {
+    const uint8_t *targets = tables->targets;
+    const uint8_t *fires = tables->fires;
+    NSUInteger changedCount = 0;
+    NSUInteger i = 0;
+
+#if defined(__SSSE3__)
+    __m128i targetTable = _mm_loadu_si128((const __m128i *) targets);
+    __m128i firesTable = _mm_loadu_si128((const __m128i *) fires);
+    for (; i + 16 <= count; i += 16) {
+        __m128i old = _mm_loadu_si128((const __m128i *) (states + i));
+        //pshufb yields zero for indexes with the top bit set, so free slots never fire
+        __m128i fired = _mm_shuffle_epi8(firesTable, old);
+        unsigned int mask = (unsigned int) _mm_movemask_epi8(fired);
+        if (mask == 0) {
+            continue;
+        }
+
+        __m128i target = _mm_shuffle_epi8(targetTable, old);
+        __m128i prev = _mm_loadu_si128((const __m128i *) (prevStates + i));
+        _mm_storeu_si128((__m128i *) (states + i), _mm_or_si128(_mm_and_si128(fired, target), _mm_andnot_si128(fired, old)));
+        _mm_storeu_si128((__m128i *) (prevStates + i), _mm_or_si128(_mm_and_si128(fired, old), _mm_andnot_si128(fired, prev)));
+
+        while (mask != 0) {
+            changed[changedCount++] = base + (PLStateMachinePoolHandle) (i + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+    uint8x8x2_t targetTable = {{vld1_u8(targets), vld1_u8(targets + 8)}};
+    uint8x8x2_t firesTable = {{vld1_u8(fires), vld1_u8(fires + 8)}};
+    for (; i + 8 <= count; i += 8) {
+        uint8x8_t old = vld1_u8(states + i);
+        //vtbl yields zero for indexes out of the table, so free slots never fire
+        uint8x8_t fired = vtbl2_u8(firesTable, old);
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(fired), 0);
+        if (mask == 0) {
+            continue;
+        }
+
+        uint8x8_t target = vtbl2_u8(targetTable, old);
+        uint8x8_t prev = vld1_u8(prevStates + i);
+        vst1_u8(states + i, vbsl_u8(fired, target, old));
+        vst1_u8(prevStates + i, vbsl_u8(fired, old, prev));
+
+        for (NSUInteger lane = 0; lane < 8; ++lane, mask >>= 8) {
+            if (mask & 0xFF) {
+                changed[changedCount++] = base + (PLStateMachinePoolHandle) (i + lane);
+            }
+        }
+    }
+#endif
+
+    for (; i < count; ++i) {
+        uint8_t old = states[i];
+        if (old < kBulkStepVectorStateLimit && fires[old]) {
+            prevStates[i] = old;
+            states[i] = targets[old];
+            changed[changedCount++] = base + (PLStateMachinePoolHandle) i;
+        }
+    }
+
+    return changedCount;
+}
@@ -0,0 +1,212 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+#import <pthread.h>
+#import "PLStateMachineCoalescer.h"
+
+@interface PLStateMachineCoalescingRule : NSObject
+
+@property (nonatomic, copy, readonly) PLStateMachineCoalescingKeyBlock keyBlock;
+//key -> queued record, records aren't retained
+@property (nonatomic, assign, readonly) CFMutableDictionaryRef queuedByKey;
+
+- (id)initWithKeyBlock:(PLStateMachineCoalescingKeyBlock)keyBlock;
+
+@end
+
+@implementation PLStateMachineCoalescingRule
+
+@synthesize keyBlock = _keyBlock;
+@synthesize queuedByKey = _queuedByKey;
+
+- (id)initWithKeyBlock:(PLStateMachineCoalescingKeyBlock)keyBlock {
+    self = [super init];
+    if (self) {
+        _keyBlock = [keyBlock copy];
+        _queuedByKey = CFDictionaryCreateMutable(NULL, 0, &kCFTypeDictionaryKeyCallBacks, NULL);
+    }
+
+    return self;
+}
+
+- (void)dealloc {
+    CFRelease(_queuedByKey);
+}
+
+@end
+
+@interface PLStateMachineCoalescer ()
+
+- (void)unindexRecord:(PLStateMachineTriggerRecord *)record;
+
+@end
+
+@implementation PLStateMachineCoalescer {
+@private
+    pthread_mutex_t _lock;
+    //trigger id -> rule, rules are never removed
+    CFMutableDictionaryRef _rules;
+}
+
+@synthesize coalescedTriggerCount = _coalescedTriggerCount;
+
+- (id)init {
+    self = [super init];
+    if (self) {
+        pthread_mutex_init(&_lock, NULL);
+        _rules = CFDictionaryCreateMutable(NULL, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+    }
+
+    return self;
+}
+
+- (void)dealloc {
+    CFRelease(_rules);
+    pthread_mutex_destroy(&_lock);
+}
+
+- (uint64_t)coalescedTriggerCount {
+    pthread_mutex_lock(&_lock);
+    uint64_t count = _coalescedTriggerCount;
+    pthread_mutex_unlock(&_lock);
+    return count;
+}
+
+- (void)coalesceTriggerId:(PLStateMachineTriggerId)triggerId byKey:(PLStateMachineCoalescingKeyBlock)keyBlock {
+    PLStateMachineCoalescingRule *rule = [[PLStateMachineCoalescingRule alloc] initWithKeyBlock:keyBlock];
+
+    pthread_mutex_lock(&_lock);
+    BOOL exists = CFDictionaryContainsKey(_rules, (const void *) triggerId);
+    if (!exists) {
+        CFDictionarySetValue(_rules, (const void *) triggerId, (__bridge const void *) rule);
+    }
+    pthread_mutex_unlock(&_lock);
+
+    //queued triggers are indexed by the key they were emitted with
+    if (exists) {
+        @throw [NSException exceptionWithName:@"InvalidArgumentException" reason:@"trigger id is already coalesced" userInfo:nil];
+    }
+}
+
+- (PLStateMachineCoalescingRule *)ruleForTriggerId:(PLStateMachineTriggerId)triggerId {
+    pthread_mutex_lock(&_lock);
+    PLStateMachineCoalescingRule *rule = (__bridge PLStateMachineCoalescingRule *) CFDictionaryGetValue(_rules, (const void *) triggerId);
+    pthread_mutex_unlock(&_lock);
+    return rule;
+}
+
+- (BOOL)coalesceRecord:(PLStateMachineTriggerRecord *)record blocking:(BOOL)blocking push:(PLStateMachineCoalescerPushBlock)push {
+    PLStateMachineTrigger *trigger = (__bridge PLStateMachineTrigger *) record->object;
+    PLStateMachineCoalescingRule *rule = [self ruleForTriggerId:trigger.triggerId];
+    PLStateMachineTriggerRecord *dropped = NULL;
+    if (rule == nil) {
+        push(&dropped);
+        return NO;
+    }
+
+    //user code, kept out of the lock
+    id key = rule.keyBlock != nil ? rule.keyBlock(trigger) : nil;
+    if (key == nil) {
+        key = (__bridge id) kCFNull;
+    }
+
+    pthread_mutex_lock(&_lock);
+    PLStateMachineTriggerRecord *queued = (PLStateMachineTriggerRecord *) CFDictionaryGetValue(rule.queuedByKey, (__bridge const void *) key);
+    //the queued record stays in its lane and keeps its scope, a trigger emitted with others can't take its place
+    if (queued != NULL && (queued->priority != record->priority || queued->scope != record->scope)) {
+        queued = NULL;
+    }
+    if (queued != NULL) {
+        //the newer trigger keeps the older one's place
+        const void *object = queued->object;
+        queued->object = record->object;
+        record->object = object;
+        ++_coalescedTriggerCount;
+        pthread_mutex_unlock(&_lock);
+        return YES;
+    }
+
+    //takes over the index from a queued record it couldn't replace, that one is still forgotten on its own
+    record->kind = PLStateMachineTriggerRecordKindCoalescableTrigger;
+    record->key = CFBridgingRetain(key);
+    CFDictionarySetValue(rule.queuedByKey, record->key, record);
+    if (blocking) {
+        pthread_mutex_unlock(&_lock);
+        push(&dropped);
+        return NO;
+    }
+
+    //the records are unindexed here and forgotten once discarded, outside of the mailbox's lock
+    if (!push(&dropped)) {
+        [self unindexRecord:record];
+    }
+    if (dropped != NULL && dropped->kind == PLStateMachineTriggerRecordKindCoalescableTrigger) {
+        [self unindexRecord:dropped];
+    }
+    pthread_mutex_unlock(&_lock);
+    return NO;
+}
+
+- (void)unindexRecord:(PLStateMachineTriggerRecord *)record {
+    //the object can be swapped until the record is unindexed
+    PLStateMachineTrigger *trigger = (__bridge PLStateMachineTrigger *) record->object;
+    PLStateMachineCoalescingRule *rule = (__bridge PLStateMachineCoalescingRule *) CFDictionaryGetValue(_rules, (const void *) trigger.triggerId);
+    if (CFDictionaryGetValue(rule.queuedByKey, record->key) == record) {
+        CFDictionaryRemoveValue(rule.queuedByKey, record->key);
+    }
+}
+
+- (void)forgetRecord:(PLStateMachineTriggerRecord *)record {
+    pthread_mutex_lock(&_lock);
+    [self unindexRecord:record];
+    pthread_mutex_unlock(&_lock);
+
+    CFRelease(record->key);
+    record->key = NULL;
+}
+
+@end
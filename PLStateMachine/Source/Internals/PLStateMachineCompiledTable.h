@@ -0,0 +1,123 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+
+#import <Foundation/Foundation.h>
+#import "PLStateMachine.h"
+#import "PLStateMachineResolver.h"
+#import "PLStateMachineStateTable.h"
+
+/**
+* Implemented by resolvers whose answers can be computed ahead of time for a given trigger id.
+*/
+@protocol PLStateMachineCompilableResolver <PLStateMachineResolver>
+
+/**
+* Adds all trigger ids this resolver (and the resolvers it consults) knows about.
+*/
+- (void)collectTriggerIds:(NSMutableIndexSet *)triggerIds;
+
+/**
+* Resolves a trigger id without a trigger instance.
+*
+* @param dynamic set to YES if the result can only be established at runtime
+* @return the target state, or PLStateMachineStateUndefined if no transition should be performed
+*/
+- (PLStateMachineStateId)compiledTargetForTriggerId:(PLStateMachineTriggerId)triggerId dynamic:(BOOL *)dynamic;
+
+@end
+
+void PLStateMachineCollectTriggerIds(id <PLStateMachineResolver> resolver, NSMutableIndexSet *triggerIds);
+
+PLStateMachineStateId PLStateMachineCompileResolver(id <PLStateMachineResolver> resolver, PLStateMachineTriggerId triggerId, BOOL *dynamic);
+
+/**
+* States x triggers transition matrix. Each cell holds the index of the target state, narrowed to the smallest integer
+* type able to hold all the state indexes. Cells that depend on runtime information (block resolvers, unregistered
+* targets, trigger ids outside of the matrix) are marked dynamic, and the resolver has to be consulted for them.
+*
+* The matrix is laid out trigger-major, so all the cells for a single trigger are contiguous.
+*/
+typedef struct PLStateMachineCompiledTable PLStateMachineCompiledTable;
+
+PLStateMachineCompiledTable *PLStateMachineCompiledTableCreate(const PLStateMachineStateTable *states);
+
+void PLStateMachineCompiledTableFree(PLStateMachineCompiledTable *table);
+
+/**
+* @return the memory used by the matrix and its index, in bytes
+*/
+NSUInteger PLStateMachineCompiledTableSize(const PLStateMachineCompiledTable *table);
+
+/**
+* @param stateIndex the index of the current state (see PLStateMachineStateNode)
+* @param dynamic set to YES if the resolver needs to be consulted
+* @return the target state, or PLStateMachineStateUndefined if no transition should be performed
+*/
+PLStateMachineStateId PLStateMachineCompiledTableResolve(const PLStateMachineCompiledTable *table, NSUInteger stateIndex, PLStateMachineTriggerId triggerId, BOOL *dynamic);
+
+NSUInteger PLStateMachineCompiledTableStateCount(const PLStateMachineCompiledTable *table);
+
+/**
+* @return the width of a cell, also the narrowest integer able to hold a state index of this table
+*/
+NSUInteger PLStateMachineCompiledTableCellSize(const PLStateMachineCompiledTable *table);
+
+/**
+* @return the all-ones value of a cell, never a valid state index
+*/
+uint32_t PLStateMachineCompiledTableNoneCell(const PLStateMachineCompiledTable *table);
+
+PLStateMachineStateId PLStateMachineCompiledTableStateIdAtIndex(const PLStateMachineCompiledTable *table, NSUInteger stateIndex);
+
+/**
+* @return the raw cell: the index of the target state, the none cell, or the dynamic cell. Cells outside of the matrix
+* are dynamic.
+*/
+uint32_t PLStateMachineCompiledTableTargetIndex(const PLStateMachineCompiledTable *table, NSUInteger stateIndex, PLStateMachineTriggerId triggerId);
+
+uint32_t PLStateMachineCompiledTableDynamicCell(const PLStateMachineCompiledTable *table);
@@ -0,0 +1,215 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+
+#import "PLStateMachineCompiledTable.h"
+#import "PLStateMachineStateNode.h"
+
+struct PLStateMachineCompiledTable {
+    NSUInteger stateCount;
+    NSUInteger triggerCount;
+    NSUInteger cellSize;
+    uint32_t noneCell;
+    uint32_t dynamicCell;
+    PLStateMachineStateId *stateIds;
+    void *cells;
+};
+
+//trigger ids above this limit are not compiled
+static PLStateMachineTriggerId const kCompiledTableTriggerLimit = 1024;
+
+void PLStateMachineCollectTriggerIds(id <PLStateMachineResolver> resolver, NSMutableIndexSet *triggerIds) {
+    if ([resolver conformsToProtocol:@protocol(PLStateMachineCompilableResolver)]) {
+        [(id <PLStateMachineCompilableResolver>) resolver collectTriggerIds:triggerIds];
+    }
+}
+
+PLStateMachineStateId PLStateMachineCompileResolver(id <PLStateMachineResolver> resolver, PLStateMachineTriggerId triggerId, BOOL *dynamic) {
+    if ([resolver conformsToProtocol:@protocol(PLStateMachineCompilableResolver)]) {
+        return [(id <PLStateMachineCompilableResolver>) resolver compiledTargetForTriggerId:triggerId dynamic:dynamic];
+    }
+
+    *dynamic = YES;
+    return PLStateMachineStateUndefined;
+}
+
+static inline uint32_t PLStateMachineCompiledTableCell(const PLStateMachineCompiledTable *table, NSUInteger offset) {
+    switch (table->cellSize) {
+        case sizeof(uint8_t):
+            return ((const uint8_t *) table->cells)[offset];
+        case sizeof(uint16_t):
+            return ((const uint16_t *) table->cells)[offset];
+        default:
+            return ((const uint32_t *) table->cells)[offset];
+    }
+}
+
+static inline void PLStateMachineCompiledTableSetCell(PLStateMachineCompiledTable *table, NSUInteger offset, uint32_t value) {
+    switch (table->cellSize) {
+        case sizeof(uint8_t):
+            ((uint8_t *) table->cells)[offset] = (uint8_t) value;
+            break;
+        case sizeof(uint16_t):
+            ((uint16_t *) table->cells)[offset] = (uint16_t) value;
+            break;
+        default:
+            ((uint32_t *) table->cells)[offset] = value;
+            break;
+    }
+}
+
+PLStateMachineCompiledTable *PLStateMachineCompiledTableCreate(const PLStateMachineStateTable *states) {
+    PLStateMachineCompiledTable *table = calloc(1, sizeof(PLStateMachineCompiledTable));
+    table->stateCount = PLStateMachineStateTableCount(states);
+
+    if (table->stateCount < UINT8_MAX - 1) {
+        table->cellSize = sizeof(uint8_t);
+        table->noneCell = UINT8_MAX;
+    } else if (table->stateCount < UINT16_MAX - 1) {
+        table->cellSize = sizeof(uint16_t);
+        table->noneCell = UINT16_MAX;
+    } else {
+        table->cellSize = sizeof(uint32_t);
+        table->noneCell = UINT32_MAX;
+    }
+    table->dynamicCell = table->noneCell - 1;
+
+    NSMutableIndexSet *triggerIds = [NSMutableIndexSet indexSet];
+    table->stateIds = calloc(MAX(table->stateCount, 1), sizeof(PLStateMachineStateId));
+    for (NSUInteger i = 0; i < table->stateCount; ++i) {
+        PLStateMachineStateNode *node = PLStateMachineStateTableNodeAtIndex(states, i);
+        table->stateIds[i] = node.stateId;
+        PLStateMachineCollectTriggerIds(node.resolver, triggerIds);
+    }
+
+    [triggerIds removeIndexesInRange:NSMakeRange(kCompiledTableTriggerLimit, NSNotFound - kCompiledTableTriggerLimit)];
+    table->triggerCount = triggerIds.count > 0 ? triggerIds.lastIndex + 1 : 0;
+    table->cells = calloc(MAX(table->triggerCount * table->stateCount, 1), table->cellSize);
+
+    for (PLStateMachineTriggerId triggerId = 0; triggerId < table->triggerCount; ++triggerId) {
+        for (NSUInteger i = 0; i < table->stateCount; ++i) {
+            PLStateMachineStateNode *node = PLStateMachineStateTableNodeAtIndex(states, i);
+
+            BOOL dynamic = NO;
+            PLStateMachineStateId target = PLStateMachineCompileResolver(node.resolver, triggerId, &dynamic);
+
+            uint32_t cell;
+            if (dynamic) {
+                cell = table->dynamicCell;
+            } else if (target == PLStateMachineStateUndefined) {
+                cell = table->noneCell;
+            } else {
+                //unregistered targets are left to the runtime path, it knows how to complain about them
+                PLStateMachineStateNode *targetNode = PLStateMachineStateTableGet(states, target);
+                cell = targetNode != nil ? (uint32_t) targetNode.index : table->dynamicCell;
+            }
+
+            PLStateMachineCompiledTableSetCell(table, triggerId * table->stateCount + i, cell);
+        }
+    }
+
+    return table;
+}
+
+void PLStateMachineCompiledTableFree(PLStateMachineCompiledTable *table) {
+    if (table == NULL) {
+        return;
+    }
+
+    free(table->stateIds);
+    free(table->cells);
+    free(table);
+}
+
+NSUInteger PLStateMachineCompiledTableSize(const PLStateMachineCompiledTable *table) {
+    return table->triggerCount * table->stateCount * table->cellSize + table->stateCount * sizeof(PLStateMachineStateId);
+}
+
+PLStateMachineStateId PLStateMachineCompiledTableResolve(const PLStateMachineCompiledTable *table, NSUInteger stateIndex, PLStateMachineTriggerId triggerId, BOOL *dynamic) {
+    if (triggerId >= table->triggerCount || stateIndex >= table->stateCount) {
+        *dynamic = YES;
+        return PLStateMachineStateUndefined;
+    }
+
+    uint32_t cell = PLStateMachineCompiledTableCell(table, triggerId * table->stateCount + stateIndex);
+    if (cell == table->noneCell) {
+        return PLStateMachineStateUndefined;
+    } else if (cell == table->dynamicCell) {
+        *dynamic = YES;
+        return PLStateMachineStateUndefined;
+    }
+
+    return table->stateIds[cell];
+}
+
+NSUInteger PLStateMachineCompiledTableStateCount(const PLStateMachineCompiledTable *table) {
+    return table->stateCount;
+}
+
+NSUInteger PLStateMachineCompiledTableCellSize(const PLStateMachineCompiledTable *table) {
+    return table->cellSize;
+}
+
+uint32_t PLStateMachineCompiledTableNoneCell(const PLStateMachineCompiledTable *table) {
+    return table->noneCell;
+}
+
+PLStateMachineStateId PLStateMachineCompiledTableStateIdAtIndex(const PLStateMachineCompiledTable *table, NSUInteger stateIndex) {
+    return table->stateIds[stateIndex];
+}
+
+uint32_t PLStateMachineCompiledTableTargetIndex(const PLStateMachineCompiledTable *table, NSUInteger stateIndex, PLStateMachineTriggerId triggerId) {
+    if (triggerId >= table->triggerCount || stateIndex >= table->stateCount) {
+        return table->dynamicCell;
+    }
+
+    return PLStateMachineCompiledTableCell(table, triggerId * table->stateCount + stateIndex);
+}
+
+uint32_t PLStateMachineCompiledTableDynamicCell(const PLStateMachineCompiledTable *table) {
+    return table->dynamicCell;
+}
@@ -0,0 +1,127 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+#import <pthread.h>
+#import "PLStateMachineDrainBatch.h"
+
+#define PLSTATE_MACHINE_DRAIN_BATCH_LIMIT 64
+
+typedef struct PLStateMachineDrain {
+    dispatch_function_t function;
+    void *context;
+} PLStateMachineDrain;
+
+typedef struct PLStateMachineDrainRun {
+    NSUInteger count;
+    PLStateMachineDrain drains[PLSTATE_MACHINE_DRAIN_BATCH_LIMIT];
+} PLStateMachineDrainRun;
+
+//executor -> the run being collected for it, set while the thread collects a batch
+static pthread_key_t PLStateMachineDrainBatchKey;
+static pthread_once_t PLStateMachineDrainBatchKeyOnce = PTHREAD_ONCE_INIT;
+
+static void PLStateMachineCreateDrainBatchKey(void) {
+    pthread_key_create(&PLStateMachineDrainBatchKey, NULL);
+}
+
+static void PLStateMachineDrainBatchRun(void *context) {
+    PLStateMachineDrainRun *run = context;
+    for (NSUInteger i = 0; i < run->count; ++i) {
+        run->drains[i].function(run->drains[i].context);
+    }
+    free(run);
+}
+
+void PLStateMachineDrainBatchBegin(void) {
+    pthread_once(&PLStateMachineDrainBatchKeyOnce, PLStateMachineCreateDrainBatchKey);
+    CFMutableDictionaryRef runs = CFDictionaryCreateMutable(NULL, 0, &kCFTypeDictionaryKeyCallBacks, NULL);
+    pthread_setspecific(PLStateMachineDrainBatchKey, runs);
+}
+
+BOOL PLStateMachineDrainBatchAdd(id <PLStateMachineExecutor> executor, dispatch_function_t function, void *context) {
+    pthread_once(&PLStateMachineDrainBatchKeyOnce, PLStateMachineCreateDrainBatchKey);
+    CFMutableDictionaryRef runs = pthread_getspecific(PLStateMachineDrainBatchKey);
+    if (runs == NULL) {
+        return NO;
+    }
+
+    PLStateMachineDrainRun *run = (PLStateMachineDrainRun *) CFDictionaryGetValue(runs, (__bridge const void *) executor);
+    if (run == NULL) {
+        run = malloc(sizeof(PLStateMachineDrainRun));
+        run->count = 0;
+        CFDictionarySetValue(runs, (__bridge const void *) executor, run);
+    }
+    run->drains[run->count].function = function;
+    run->drains[run->count].context = context;
+    ++run->count;
+
+    //a full run goes right away, huge waves still spread over an executor's threads
+    if (run->count == PLSTATE_MACHINE_DRAIN_BATCH_LIMIT) {
+        CFDictionaryRemoveValue(runs, (__bridge const void *) executor);
+        [executor executeFunction:PLStateMachineDrainBatchRun context:run];
+    }
+    return YES;
+}
+
+void PLStateMachineDrainBatchCommit(void) {
+    CFMutableDictionaryRef runs = pthread_getspecific(PLStateMachineDrainBatchKey);
+    //drains run by inline executors schedule directly from here on
+    pthread_setspecific(PLStateMachineDrainBatchKey, NULL);
+
+    CFIndex count = CFDictionaryGetCount(runs);
+    if (count > 0) {
+        const void **executors = malloc(count * sizeof(void *));
+        const void **pending = malloc(count * sizeof(void *));
+        CFDictionaryGetKeysAndValues(runs, executors, pending);
+        for (CFIndex i = 0; i < count; ++i) {
+            [(__bridge id <PLStateMachineExecutor>) executors[i] executeFunction:PLStateMachineDrainBatchRun context:(void *) pending[i]];
+        }
+        free(executors);
+        free(pending);
+    }
+    CFRelease(runs);
+}
@@ -45,20 +45,20 @@
 
  */
 
-
 #import <Foundation/Foundation.h>
 #import "PLStateMachine.h"
 
-@interface PLStateMachineTransitionSignature : NSObject <NSCopying>
+/**
+* A single registered transition callback. Instances are handed out as removal tokens.
+*/
+@interface PLStateMachineListener : NSObject
 
 @property (nonatomic, assign, readonly) PLStateMachineStateId leavingState;
 @property (nonatomic, assign, readonly) PLStateMachineStateId enteringState;
+@property (nonatomic, copy, readonly) PLStateMachineStateChangeBlock block;
+//only used as a key, never retained nor messaged
+@property (nonatomic, assign, readonly) const void *owner;
 
--(id)initForLeaving:(PLStateMachineStateId)leaving forEntering:(PLStateMachineStateId)entering;
-
-+(id)signatureForLeaving:(PLStateMachineStateId)leaving forEntering:(PLStateMachineStateId)entering;
-+(id)signatureForLeaving:(PLStateMachineStateId)leaving;
-+(id)signatureForEntering:(PLStateMachineStateId)entering;
-+(id)zeroSignature;
+- (id)initForLeaving:(PLStateMachineStateId)leaving entering:(PLStateMachineStateId)entering block:(PLStateMachineStateChangeBlock)block owner:(id <NSObject>)owner;
 
-@end
\ No newline at end of file
+@end
@@ -45,60 +45,28 @@
 
  */
 
+#import "PLStateMachineListener.h"
 
-#import "PLStateMachineTransitionSignature.h"
 
-@implementation PLStateMachineTransitionSignature {
+@implementation PLStateMachineListener {
 
-@private
-    PLStateMachineStateId enteringState;
-    PLStateMachineStateId leavingState;
 }
 
-@synthesize enteringState;
-@synthesize leavingState;
+@synthesize leavingState = leavingState;
+@synthesize enteringState = enteringState;
+@synthesize block = block;
+@synthesize owner = owner;
 
-+ (id)signatureForLeaving:(PLStateMachineStateId)leaving forEntering:(PLStateMachineStateId)entering {
-    return [[self alloc] initForLeaving:leaving forEntering:entering];
-}
-
-+ (id)signatureForLeaving:(PLStateMachineStateId)leaving {
-    return [[self alloc] initForLeaving:leaving forEntering:PLStateMachineStateUndefined];
-}
-
-+ (id)signatureForEntering:(PLStateMachineStateId)entering {
-    return [[self alloc] initForLeaving:PLStateMachineStateUndefined forEntering:entering];
-}
-
-+ (id)zeroSignature {
-    static PLStateMachineTransitionSignature * zeroSignature = nil;
-    if(zeroSignature == nil){
-        zeroSignature = [[self alloc] initForLeaving:PLStateMachineStateUndefined forEntering:PLStateMachineStateUndefined];
-    }
-    return zeroSignature;
-}
-
-- (id)initForLeaving:(PLStateMachineStateId)leaving forEntering:(PLStateMachineStateId)entering {
+- (id)initForLeaving:(PLStateMachineStateId)leaving entering:(PLStateMachineStateId)entering block:(PLStateMachineStateChangeBlock)aBlock owner:(id <NSObject>)anOwner {
     self = [super init];
-    if (self){
-        enteringState = entering;
+    if (self) {
         leavingState = leaving;
+        enteringState = entering;
+        block = [aBlock copy];
+        owner = (__bridge const void *) anOwner;
     }
-    return self;
-}
-
-- (BOOL)isEqual:(id)object {
-    return (self == object) || ([object isKindOfClass:[self class]] && [(PLStateMachineTransitionSignature *)object leavingState] == [self leavingState] && [(PLStateMachineTransitionSignature *)object enteringState] == [self enteringState]);
-}
 
-- (NSUInteger)hash {
-    //TODO: better hash?!
-    return enteringState * 17 + leavingState * 7;
-}
-
-- (id)copyWithZone:(NSZone *)zone {
-    return [[[self class] allocWithZone:zone] initForLeaving:self.leavingState forEntering:self.enteringState];
+    return self;
 }
 
-
-@end
\ No newline at end of file
+@end
@@ -0,0 +1,147 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+
+#import <Foundation/Foundation.h>
+#import <libkern/OSAtomic.h>
+#import <pthread.h>
+#import "PLStateMachineTriggerRecord.h"
+#import "PLStateMachineLaneSchedule.h"
+#import "PLStateMachineTimerScheduler.h"
+
+/**
+* Intrusive multi-producer, single-consumer FIFO of trigger records.
+*
+* Producers push onto a lock-free stack, the consumer takes the whole stack at once and reverses it into a private
+* FIFO. A pending counter tells the producer which push made the mailbox non-empty, only that one has to schedule a
+* drain. The consumer keeps popping until PLStateMachineMailboxDidProcess reports the mailbox is empty again.
+*
+* There is one such FIFO per trigger priority, the pending counter is shared by all of them. Records are pushed into
+* the lane of their priority, and popped from the lane picked by the lane schedule.
+*
+* Each lane counts the records it took in and gave out, a waiting thread notes the first and waits for the second to
+* catch up.
+*/
+typedef struct PLStateMachineMailboxLane {
+    PLStateMachineTriggerRecord *volatile inbox;
+    volatile int32_t depth;
+    //counted before the push, so every record visible in the inbox is counted
+    volatile int64_t pushedCount;
+
+    //consumer side
+    PLStateMachineTriggerRecord *staged;
+    PLStateMachineTriggerRecord *stagedTail;
+    int64_t poppedCount;
+} PLStateMachineMailboxLane;
+
+typedef struct PLStateMachineMailbox {
+    PLStateMachineMailboxLane lanes[PLSTATE_MACHINE_PRIORITY_COUNT];
+    volatile int32_t pending;
+    //the emitted triggers among the pending records
+    volatile int32_t queuedTriggerCount;
+    //the time records are stamped with, set before the first push
+    PLStateMachineTimerScheduler *clock;
+
+    //consumer side
+    PLStateMachineLaneSchedule schedule;
+    //written by the consumer, read by anyone
+    pthread_mutex_t statisticsLock;
+    PLStateMachineLaneStatistics statistics[PLSTATE_MACHINE_PRIORITY_COUNT];
+} PLStateMachineMailbox;
+
+/**
+* Sets up a zeroed mailbox, its records are stamped with the time of clock.
+*/
+void PLStateMachineMailboxInit(PLStateMachineMailbox *mailbox, PLStateMachineTimerScheduler *clock);
+
+/**
+* Records still queued are not released, the owner pops and discards them first.
+*/
+void PLStateMachineMailboxDestroy(PLStateMachineMailbox *mailbox);
+
+/**
+* Pushes a record into the lane of its priority.
+*
+* @return YES if the mailbox was empty, and a drain needs to be scheduled
+*/
+BOOL PLStateMachineMailboxPush(PLStateMachineMailbox *mailbox, PLStateMachineTriggerRecord *record);
+
+/**
+* Consumer only. Returns the oldest record of the lane picked by the schedule, or NULL if none is visible yet.
+*/
+PLStateMachineTriggerRecord *PLStateMachineMailboxPop(PLStateMachineMailbox *mailbox);
+
+/**
+* Consumer only. Has to be called once per popped record, after processing it.
+*
+* @return YES if there are more records to process, NO if the drain should end
+*/
+BOOL PLStateMachineMailboxDidProcess(PLStateMachineMailbox *mailbox);
+
+/**
+* Copies the number of records each lane took in so far into sequences, one per lane.
+*/
+void PLStateMachineMailboxCopySequences(PLStateMachineMailbox *mailbox, uint64_t *sequences);
+
+/**
+* Consumer only.
+*
+* @return YES if every record counted by PLStateMachineMailboxCopySequences into sequences was popped
+*/
+BOOL PLStateMachineMailboxHasPopped(PLStateMachineMailbox *mailbox, const uint64_t *sequences);
+
+/**
+* @return the number of records pushed and not processed yet
+*/
+NSUInteger PLStateMachineMailboxPendingCount(PLStateMachineMailbox *mailbox);
+
+/**
+* @return the number of emitted triggers pushed and not popped yet, a batch counts all of its triggers
+*/
+NSUInteger PLStateMachineMailboxQueuedTriggerCount(PLStateMachineMailbox *mailbox);
+
+PLStateMachineLaneStatistics PLStateMachineMailboxLaneStatistics(PLStateMachineMailbox *mailbox, PLStateMachineTriggerPriority priority);
@@ -0,0 +1,169 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+
+#import "PLStateMachineMailbox.h"
+
+static BOOL PLStateMachineMailboxLaneIsEmpty(PLStateMachineMailboxLane *lane) {
+    return lane->staged == NULL && lane->inbox == NULL;
+}
+
+void PLStateMachineMailboxInit(PLStateMachineMailbox *mailbox, PLStateMachineTimerScheduler *clock) {
+    mailbox->clock = clock;
+    pthread_mutex_init(&mailbox->statisticsLock, NULL);
+}
+
+void PLStateMachineMailboxDestroy(PLStateMachineMailbox *mailbox) {
+    pthread_mutex_destroy(&mailbox->statisticsLock);
+}
+
+BOOL PLStateMachineMailboxPush(PLStateMachineMailbox *mailbox, PLStateMachineTriggerRecord *record) {
+    PLStateMachineMailboxLane *lane = &mailbox->lanes[record->priority];
+    record->enqueuedAt = PLStateMachineTimerSchedulerNow(mailbox->clock);
+    //lanes pop in push order, so a count of n is reached only once the first n pushes were popped
+    OSAtomicIncrement64Barrier(&lane->pushedCount);
+
+    PLStateMachineTriggerRecord *head;
+    do {
+        head = lane->inbox;
+        record->next = head;
+    } while (!OSAtomicCompareAndSwapPtrBarrier(head, record, (void *volatile *) &lane->inbox));
+    OSAtomicIncrement32(&lane->depth);
+    OSAtomicAdd32((int32_t) PLStateMachineTriggerRecordTriggerCount(record), &mailbox->queuedTriggerCount);
+
+    //the record is visible before it is counted, so a non zero count always has a record behind it
+    return OSAtomicIncrement32Barrier(&mailbox->pending) == 1;
+}
+
+PLStateMachineTriggerRecord *PLStateMachineMailboxPop(PLStateMachineMailbox *mailbox) {
+    NSUInteger nonEmptyLanes = 0;
+    for (NSUInteger i = 0; i < PLSTATE_MACHINE_PRIORITY_COUNT; ++i) {
+        if (!PLStateMachineMailboxLaneIsEmpty(&mailbox->lanes[i])) {
+            nonEmptyLanes |= 1 << i;
+        }
+    }
+    if (nonEmptyLanes == 0) {
+        return NULL;
+    }
+
+    PLStateMachineTriggerPriority priority = PLStateMachineLaneSchedulePick(&mailbox->schedule, nonEmptyLanes);
+    PLStateMachineMailboxLane *lane = &mailbox->lanes[priority];
+    if (lane->staged == NULL) {
+        PLStateMachineTriggerRecord *taken;
+        do {
+            taken = lane->inbox;
+        } while (taken != NULL && !OSAtomicCompareAndSwapPtrBarrier(taken, NULL, (void *volatile *) &lane->inbox));
+
+        //the inbox is newest first
+        PLStateMachineTriggerRecord *reversed = NULL;
+        lane->stagedTail = taken;
+        while (taken != NULL) {
+            PLStateMachineTriggerRecord *next = taken->next;
+            taken->next = reversed;
+            reversed = taken;
+            taken = next;
+        }
+        lane->staged = reversed;
+    }
+
+    PLStateMachineTriggerRecord *record = lane->staged;
+    lane->staged = record->next;
+    if (lane->staged == NULL) {
+        lane->stagedTail = NULL;
+    }
+    record->next = NULL;
+    OSAtomicDecrement32(&lane->depth);
+    OSAtomicAdd32(-(int32_t) PLStateMachineTriggerRecordTriggerCount(record), &mailbox->queuedTriggerCount);
+    ++lane->poppedCount;
+
+    //a barrier isn't a trigger the lane kept waiting
+    if (record->kind != PLStateMachineTriggerRecordKindBarrier) {
+        NSTimeInterval now = PLStateMachineTimerSchedulerNow(mailbox->clock);
+        pthread_mutex_lock(&mailbox->statisticsLock);
+        PLStateMachineLaneStatisticsRecord(&mailbox->statistics[priority], record->enqueuedAt, now);
+        pthread_mutex_unlock(&mailbox->statisticsLock);
+    }
+    return record;
+}
+
+BOOL PLStateMachineMailboxDidProcess(PLStateMachineMailbox *mailbox) {
+    return OSAtomicDecrement32Barrier(&mailbox->pending) > 0;
+}
+
+void PLStateMachineMailboxCopySequences(PLStateMachineMailbox *mailbox, uint64_t *sequences) {
+    for (NSUInteger i = 0; i < PLSTATE_MACHINE_PRIORITY_COUNT; ++i) {
+        sequences[i] = (uint64_t) OSAtomicAdd64Barrier(0, &mailbox->lanes[i].pushedCount);
+    }
+}
+
+BOOL PLStateMachineMailboxHasPopped(PLStateMachineMailbox *mailbox, const uint64_t *sequences) {
+    for (NSUInteger i = 0; i < PLSTATE_MACHINE_PRIORITY_COUNT; ++i) {
+        if ((uint64_t) mailbox->lanes[i].poppedCount < sequences[i]) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+NSUInteger PLStateMachineMailboxPendingCount(PLStateMachineMailbox *mailbox) {
+    return (NSUInteger) OSAtomicAdd32Barrier(0, &mailbox->pending);
+}
+
+NSUInteger PLStateMachineMailboxQueuedTriggerCount(PLStateMachineMailbox *mailbox) {
+    //popped before the producer counted it
+    return (NSUInteger) MAX(OSAtomicAdd32Barrier(0, &mailbox->queuedTriggerCount), 0);
+}
+
+PLStateMachineLaneStatistics PLStateMachineMailboxLaneStatistics(PLStateMachineMailbox *mailbox, PLStateMachineTriggerPriority priority) {
+    pthread_mutex_lock(&mailbox->statisticsLock);
+    PLStateMachineLaneStatistics statistics = mailbox->statistics[priority];
+    pthread_mutex_unlock(&mailbox->statisticsLock);
+
+    //popped before the producer counted it
+    statistics.depth = (NSUInteger) MAX(OSAtomicAdd32Barrier(0, &mailbox->lanes[priority].depth), 0);
+    return statistics;
+}
@@ -54,7 +54,15 @@
 @property (nonatomic, assign, readonly) PLStateMachineStateId stateId;
 @property (nonatomic, copy, readonly) NSString * name;
 @property (nonatomic, strong, readonly) id<PLStateMachineResolver> resolver;
+@property (nonatomic, assign, readwrite) NSUInteger index;
+//0 if the state has no timeout
+@property (nonatomic, assign, readonly) NSTimeInterval timeout;
+//how much later than the timeout it may expire, to share a wakeup with other timers
+@property (nonatomic, assign, readonly) NSTimeInterval timeoutLeeway;
+@property (nonatomic, assign, readonly) PLStateMachineTriggerId timeoutTriggerId;
 
 - (id)initWithStateId:(PLStateMachineStateId)stateId name:(NSString *)name resolver:(id <PLStateMachineResolver>)resolver;
 
+- (id)initWithStateId:(PLStateMachineStateId)stateId name:(NSString *)name resolver:(id <PLStateMachineResolver>)resolver timeout:(NSTimeInterval)timeout leeway:(NSTimeInterval)leeway trigger:(PLStateMachineTriggerId)triggerId;
+
 @end
\ No newline at end of file
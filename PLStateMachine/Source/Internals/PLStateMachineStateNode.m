@@ -55,13 +55,25 @@
 @synthesize stateId = stateId;
 @synthesize name = name;
 @synthesize resolver = resolver;
+@synthesize index = index;
+@synthesize timeout = timeout;
+@synthesize timeoutLeeway = timeoutLeeway;
+@synthesize timeoutTriggerId = timeoutTriggerId;
 
 - (id)initWithStateId:(PLStateMachineStateId)aStateId name:(NSString *)aName resolver:(id <PLStateMachineResolver>)aResolver {
+    self = [self initWithStateId:aStateId name:aName resolver:aResolver timeout:0 leeway:0 trigger:0];
+    return self;
+}
+
+- (id)initWithStateId:(PLStateMachineStateId)aStateId name:(NSString *)aName resolver:(id <PLStateMachineResolver>)aResolver timeout:(NSTimeInterval)aTimeout leeway:(NSTimeInterval)aLeeway trigger:(PLStateMachineTriggerId)aTriggerId {
     self = [super init];
     if (self) {
         stateId = aStateId;
         name = [aName copy];
         resolver = aResolver;
+        timeout = aTimeout;
+        timeoutLeeway = aLeeway;
+        timeoutTriggerId = aTriggerId;
     }
 
     return self;
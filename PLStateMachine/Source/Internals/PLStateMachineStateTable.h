@@ -0,0 +1,80 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+
+#import <Foundation/Foundation.h>
+#import "PLStateMachine.h"
+
+@class PLStateMachineStateNode;
+
+/**
+* Registry of the state nodes of a machine.
+*
+* Nodes are stored in a dense array indexed directly by PLStateMachineStateId. Ids that would make the dense array
+* unreasonably big are kept in a sparse map instead. Both structures are copy-on-write and get published with a memory
+* barrier, so lookups never take a lock and never box the id. Replaced structures are kept until the table is freed,
+* readers may still be using them. Additions have to be serialized by the caller.
+*/
+typedef struct PLStateMachineStateTable PLStateMachineStateTable;
+
+PLStateMachineStateTable *PLStateMachineStateTableCreate(void);
+
+void PLStateMachineStateTableFree(PLStateMachineStateTable *table);
+
+PLStateMachineStateNode *PLStateMachineStateTableGet(const PLStateMachineStateTable *table, PLStateMachineStateId stateId);
+
+/**
+* Adds a node, and assigns its index (the registration order).
+*/
+void PLStateMachineStateTableAdd(PLStateMachineStateTable *table, PLStateMachineStateNode *node);
+
+NSUInteger PLStateMachineStateTableCount(const PLStateMachineStateTable *table);
+
+/**
+* Returns nodes in registration order. Like PLStateMachineStateTableCount, this has to be serialized with additions.
+*/
+PLStateMachineStateNode *PLStateMachineStateTableNodeAtIndex(const PLStateMachineStateTable *table, NSUInteger index);
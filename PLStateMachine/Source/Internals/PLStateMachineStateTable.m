@@ -0,0 +1,169 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+
+#import <libkern/OSAtomic.h>
+#import "PLStateMachineStateTable.h"
+#import "PLStateMachineStateNode.h"
+#import "PLStateMachineTransitionMap.h"
+
+typedef struct PLStateMachineStateTableSlots {
+    struct PLStateMachineStateTableSlots *retired;
+    NSUInteger capacity;
+    const void *nodes[];
+} PLStateMachineStateTableSlots;
+
+typedef struct PLStateMachineStateTableRetiredMap {
+    struct PLStateMachineStateTableRetiredMap *next;
+    PLStateMachineTransitionMap *map;
+} PLStateMachineStateTableRetiredMap;
+
+struct PLStateMachineStateTable {
+    PLStateMachineStateTableSlots *volatile dense;
+    PLStateMachineTransitionMap *volatile sparse;
+    PLStateMachineStateTableRetiredMap *retiredSparse;
+    CFMutableArrayRef nodes;
+};
+
+//ids above this limit go to the sparse map
+static PLStateMachineStateId const kStateTableDenseLimit = 4096;
+
+static PLStateMachineStateTableSlots *PLStateMachineStateTableSlotsCreate(NSUInteger capacity) {
+    PLStateMachineStateTableSlots *slots = calloc(1, sizeof(PLStateMachineStateTableSlots) + capacity * sizeof(void *));
+    slots->capacity = capacity;
+    return slots;
+}
+
+PLStateMachineStateTable *PLStateMachineStateTableCreate(void) {
+    PLStateMachineStateTable *table = calloc(1, sizeof(PLStateMachineStateTable));
+    table->dense = PLStateMachineStateTableSlotsCreate(16);
+    table->sparse = PLStateMachineTransitionMapCreate();
+    table->nodes = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
+    return table;
+}
+
+void PLStateMachineStateTableFree(PLStateMachineStateTable *table) {
+    if (table == NULL) {
+        return;
+    }
+
+    PLStateMachineStateTableSlots *slots = table->dense;
+    while (slots != NULL) {
+        PLStateMachineStateTableSlots *retired = slots->retired;
+        free(slots);
+        slots = retired;
+    }
+
+    PLStateMachineTransitionMapFree(table->sparse);
+    PLStateMachineStateTableRetiredMap *retiredMap = table->retiredSparse;
+    while (retiredMap != NULL) {
+        PLStateMachineStateTableRetiredMap *next = retiredMap->next;
+        PLStateMachineTransitionMapFree(retiredMap->map);
+        free(retiredMap);
+        retiredMap = next;
+    }
+
+    CFRelease(table->nodes);
+    free(table);
+}
+
+PLStateMachineStateNode *PLStateMachineStateTableGet(const PLStateMachineStateTable *table, PLStateMachineStateId stateId) {
+    const PLStateMachineStateTableSlots *slots = table->dense;
+    if (stateId < slots->capacity) {
+        return (__bridge PLStateMachineStateNode *) slots->nodes[stateId];
+    } else if (stateId < kStateTableDenseLimit) {
+        return nil;
+    }
+
+    return PLStateMachineTransitionMapGet(table->sparse, stateId, 0);
+}
+
+void PLStateMachineStateTableAdd(PLStateMachineStateTable *table, PLStateMachineStateNode *node) {
+    PLStateMachineStateId stateId = node.stateId;
+    node.index = (NSUInteger) CFArrayGetCount(table->nodes);
+    CFArrayAppendValue(table->nodes, (__bridge const void *) node);
+
+    if (stateId < kStateTableDenseLimit) {
+        PLStateMachineStateTableSlots *slots = table->dense;
+        if (stateId >= slots->capacity) {
+            NSUInteger capacity = slots->capacity;
+            while (capacity <= stateId) {
+                capacity *= 2;
+            }
+
+            PLStateMachineStateTableSlots *grown = PLStateMachineStateTableSlotsCreate(capacity);
+            memcpy(grown->nodes, slots->nodes, slots->capacity * sizeof(void *));
+            grown->nodes[stateId] = (__bridge const void *) node;
+            grown->retired = slots;
+
+            OSMemoryBarrier();
+            table->dense = grown;
+        } else {
+            OSMemoryBarrier();
+            slots->nodes[stateId] = (__bridge const void *) node;
+        }
+    } else {
+        PLStateMachineTransitionMap *sparse = PLStateMachineTransitionMapCopy(table->sparse);
+        PLStateMachineTransitionMapSet(sparse, stateId, 0, node);
+
+        PLStateMachineStateTableRetiredMap *retiredMap = malloc(sizeof(PLStateMachineStateTableRetiredMap));
+        retiredMap->map = table->sparse;
+        retiredMap->next = table->retiredSparse;
+        table->retiredSparse = retiredMap;
+
+        OSMemoryBarrier();
+        table->sparse = sparse;
+    }
+}
+
+NSUInteger PLStateMachineStateTableCount(const PLStateMachineStateTable *table) {
+    return (NSUInteger) CFArrayGetCount(table->nodes);
+}
+
+PLStateMachineStateNode *PLStateMachineStateTableNodeAtIndex(const PLStateMachineStateTable *table, NSUInteger index) {
+    return (__bridge PLStateMachineStateNode *) CFArrayGetValueAtIndex(table->nodes, (CFIndex) index);
+}
@@ -0,0 +1,116 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+
+#import <Foundation/Foundation.h>
+#import "PLStateMachine.h"
+#import "PLStateMachineTimingWheel.h"
+
+/**
+* Keeps the time of a clock and fires its timers from one timing wheel of millisecond ticks.
+*
+* The shared scheduler follows PLStateMachineMonotonicTime and is driven by a single thread, which sleeps until the
+* next tick the wheel has work for, so there is no dispatch source or run loop timer per timer, and arming or
+* cancelling one costs a lock and O(1) wheel work. Manual schedulers keep a time of their own, which only moves when
+* they are advanced, and fire on the advancing thread. Timer functions are called without the lock held, they should
+* only hand work over, e.g. emit a trigger. The timers expiring at one tick fire within a drain batch, see
+* PLStateMachineDrainBatchBegin.
+*/
+typedef struct PLStateMachineTimerScheduler PLStateMachineTimerScheduler;
+
+/**
+* @return the scheduler of the system clock, its thread is started on first use
+*/
+PLStateMachineTimerScheduler *PLStateMachineTimerSchedulerShared(void);
+
+/**
+* @param now the time the scheduler starts at, in seconds
+* @return a scheduler that only moves when advanced
+*/
+PLStateMachineTimerScheduler *PLStateMachineTimerSchedulerCreateManual(NSTimeInterval now);
+
+/**
+* Frees a manual scheduler. Timers still armed are disarmed without firing.
+*/
+void PLStateMachineTimerSchedulerFree(PLStateMachineTimerScheduler *scheduler);
+
+/**
+* @return the scheduler's time, in seconds
+*/
+NSTimeInterval PLStateMachineTimerSchedulerNow(PLStateMachineTimerScheduler *scheduler);
+
+/**
+* Moves the time of a manual scheduler forward, firing the timers due until then on the caller, tick by tick in
+* deadline order. While a tick's timers fire the time reads that tick, so timers armed from them are due relative to
+* it. Advancing is not reentrant, and has to be serialized by the caller.
+*
+* @param time in seconds, not before PLStateMachineTimerSchedulerNow
+* @return the number of timers fired
+*/
+NSUInteger PLStateMachineTimerSchedulerAdvance(PLStateMachineTimerScheduler *scheduler, NSTimeInterval time);
+
+/**
+* Arms a timer, or moves an armed one. The timer's function, context and payload have to be set, and can't change
+* while it is armed.
+*
+* A timer with a leeway expires at the most round tick within it, so timers due around the same time line up on one
+* tick and fire with one wakeup.
+*
+* @param deadline in PLStateMachineTimerSchedulerNow seconds, the timer never fires earlier
+* @param leeway how much later than the deadline the timer may fire, in seconds
+*/
+void PLStateMachineTimerSchedulerArm(PLStateMachineTimerScheduler *scheduler, PLStateMachineTimer *timer, NSTimeInterval deadline, NSTimeInterval leeway);
+
+/**
+* @return YES if the timer was armed and won't fire, NO if it wasn't armed or is firing already
+*/
+BOOL PLStateMachineTimerSchedulerCancel(PLStateMachineTimerScheduler *scheduler, PLStateMachineTimer *timer);
+
+/**
+* @return counters of the scheduler
+*/
+PLStateMachineTimerStatistics PLStateMachineTimerSchedulerGetStatistics(PLStateMachineTimerScheduler *scheduler);
@@ -0,0 +1,283 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+
+#import <pthread.h>
+#import "PLStateMachineTimerScheduler.h"
+#import "PLStateMachineDrainBatch.h"
+#import "PLStateMachineTime.h"
+
+static double const kTicksPerSecond = 1000;
+//keeps rounding errors of time arithmetic, e.g. 129.999 + 0.001, from moving a time over a tick
+static double const kTickTolerance = 1e-6;
+
+typedef struct PLStateMachineTimerFiring {
+    PLStateMachineTimerFunction function;
+    const void *context;
+    uintptr_t payload;
+} PLStateMachineTimerFiring;
+
+struct PLStateMachineTimerScheduler {
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    PLStateMachineTimingWheel wheel;
+    //the tick the thread sleeps until, 0 while it is awake or if there is no thread
+    uint64_t sleepingUntil;
+    uint64_t firedTimerCount;
+    uint64_t wakeupCount;
+
+    //manual schedulers only, the time they were advanced to
+    BOOL manual;
+    NSTimeInterval manualNow;
+
+    //firing side
+    PLStateMachineTimerFiring *firings;
+    NSUInteger firingCount;
+    NSUInteger firingCapacity;
+};
+
+//a deadline is due at the tick it rounds up to
+static uint64_t PLStateMachineTimerSchedulerTicks(NSTimeInterval time) {
+    return (uint64_t) ceil(time * kTicksPerSecond - kTickTolerance);
+}
+
+//the current time has only passed the ticks it rounds down to, rounding it up would fire timers up to a tick early
+static uint64_t PLStateMachineTimerSchedulerPassedTicks(NSTimeInterval time) {
+    return (uint64_t) floor(time * kTicksPerSecond + kTickTolerance);
+}
+
+static uint64_t PLStateMachineTimerSchedulerAlignedTick(uint64_t deadline, uint64_t leeway) {
+    if (leeway == 0) {
+        return deadline;
+    }
+
+    //rounds up to the largest power of two not exceeding leeway + 1 ticks, which can't overshoot the leeway
+    uint64_t alignment = (uint64_t) 1 << (63 - __builtin_clzll(leeway + 1));
+    return (deadline + alignment - 1) & ~(alignment - 1);
+}
+
+static void PLStateMachineTimerSchedulerCollect(PLStateMachineTimer *timer, void *info) {
+    PLStateMachineTimerScheduler *scheduler = info;
+    if (scheduler->firingCount == scheduler->firingCapacity) {
+        scheduler->firingCapacity = MAX(scheduler->firingCapacity * 2, 64);
+        scheduler->firings = realloc(scheduler->firings, scheduler->firingCapacity * sizeof(PLStateMachineTimerFiring));
+    }
+
+    //the timer may be armed again as soon as the lock is released, its context retain goes with the firing
+    PLStateMachineTimerFiring *firing = &scheduler->firings[scheduler->firingCount++];
+    firing->function = timer->function;
+    firing->context = timer->context;
+    firing->payload = timer->payload;
+}
+
+//called with the lock held, fires the collected timers without it
+static NSUInteger PLStateMachineTimerSchedulerFire(PLStateMachineTimerScheduler *scheduler) {
+    NSUInteger firingCount = scheduler->firingCount;
+    scheduler->firingCount = 0;
+    scheduler->firedTimerCount += firingCount;
+    pthread_mutex_unlock(&scheduler->lock);
+    PLStateMachineDrainBatchBegin();
+    for (NSUInteger i = 0; i < firingCount; ++i) {
+        PLStateMachineTimerFiring *firing = &scheduler->firings[i];
+        firing->function((void *) firing->context, firing->payload);
+        CFRelease(firing->context);
+    }
+    PLStateMachineDrainBatchCommit();
+    pthread_mutex_lock(&scheduler->lock);
+    return firingCount;
+}
+
+static void PLStateMachineTimerSchedulerSleep(PLStateMachineTimerScheduler *scheduler, uint64_t until) {
+    scheduler->sleepingUntil = until;
+    if (until == UINT64_MAX) {
+        pthread_cond_wait(&scheduler->wakeup, &scheduler->lock);
+    } else {
+        //a relative wait, an absolute one would be against the wall clock, which can be set back or forth
+        NSTimeInterval delay = MAX(until / kTicksPerSecond - PLStateMachineMonotonicTime(), 0);
+        struct timespec timeout = {(time_t) delay, (long) ((delay - floor(delay)) * 1e9)};
+        pthread_cond_timedwait_relative_np(&scheduler->wakeup, &scheduler->lock, &timeout);
+    }
+    scheduler->sleepingUntil = 0;
+    ++scheduler->wakeupCount;
+}
+
+static void *PLStateMachineTimerSchedulerMain(void *argument) {
+    PLStateMachineTimerScheduler *scheduler = argument;
+
+    pthread_mutex_lock(&scheduler->lock);
+    while (YES) {
+        PLStateMachineTimingWheelAdvance(&scheduler->wheel, PLStateMachineTimerSchedulerPassedTicks(PLStateMachineMonotonicTime()), PLStateMachineTimerSchedulerCollect, scheduler);
+        if (scheduler->firingCount == 0) {
+            PLStateMachineTimerSchedulerSleep(scheduler, PLStateMachineTimingWheelNextTick(&scheduler->wheel));
+            continue;
+        }
+        PLStateMachineTimerSchedulerFire(scheduler);
+    }
+    return NULL;
+}
+
+static PLStateMachineTimerScheduler *PLStateMachineTimerSchedulerCreate(NSTimeInterval now) {
+    PLStateMachineTimerScheduler *scheduler = calloc(1, sizeof(PLStateMachineTimerScheduler));
+    pthread_mutex_init(&scheduler->lock, NULL);
+    pthread_cond_init(&scheduler->wakeup, NULL);
+    PLStateMachineTimingWheelInit(&scheduler->wheel, PLStateMachineTimerSchedulerPassedTicks(now));
+    return scheduler;
+}
+
+static PLStateMachineTimerScheduler *sharedScheduler;
+static pthread_once_t sharedSchedulerOnce = PTHREAD_ONCE_INIT;
+
+static void PLStateMachineTimerSchedulerCreateShared(void) {
+    PLStateMachineTimerScheduler *scheduler = PLStateMachineTimerSchedulerCreate(PLStateMachineMonotonicTime());
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, PLStateMachineTimerSchedulerMain, scheduler);
+    pthread_detach(thread);
+    sharedScheduler = scheduler;
+}
+
+PLStateMachineTimerScheduler *PLStateMachineTimerSchedulerShared(void) {
+    pthread_once(&sharedSchedulerOnce, PLStateMachineTimerSchedulerCreateShared);
+    return sharedScheduler;
+}
+
+PLStateMachineTimerScheduler *PLStateMachineTimerSchedulerCreateManual(NSTimeInterval now) {
+    PLStateMachineTimerScheduler *scheduler = PLStateMachineTimerSchedulerCreate(now);
+    scheduler->manual = YES;
+    scheduler->manualNow = now;
+    return scheduler;
+}
+
+void PLStateMachineTimerSchedulerFree(PLStateMachineTimerScheduler *scheduler) {
+    //drops the context retains of the timers still armed
+    while (scheduler->wheel.count > 0) {
+        PLStateMachineTimingWheelAdvance(&scheduler->wheel, PLStateMachineTimingWheelNextTick(&scheduler->wheel), PLStateMachineTimerSchedulerCollect, scheduler);
+    }
+    for (NSUInteger i = 0; i < scheduler->firingCount; ++i) {
+        CFRelease(scheduler->firings[i].context);
+    }
+
+    pthread_mutex_destroy(&scheduler->lock);
+    pthread_cond_destroy(&scheduler->wakeup);
+    free(scheduler->firings);
+    free(scheduler);
+}
+
+NSTimeInterval PLStateMachineTimerSchedulerNow(PLStateMachineTimerScheduler *scheduler) {
+    if (!scheduler->manual) {
+        return PLStateMachineMonotonicTime();
+    }
+
+    pthread_mutex_lock(&scheduler->lock);
+    NSTimeInterval now = scheduler->manualNow;
+    pthread_mutex_unlock(&scheduler->lock);
+    return now;
+}
+
+NSUInteger PLStateMachineTimerSchedulerAdvance(PLStateMachineTimerScheduler *scheduler, NSTimeInterval time) {
+    //a timer is due at the tick its deadline rounds up to, only the ticks that passed completely fire
+    uint64_t target = PLStateMachineTimerSchedulerPassedTicks(time);
+    NSUInteger firedCount = 0;
+
+    pthread_mutex_lock(&scheduler->lock);
+    uint64_t tick;
+    while ((tick = PLStateMachineTimingWheelNextTick(&scheduler->wheel)) <= target) {
+        PLStateMachineTimingWheelAdvance(&scheduler->wheel, tick, PLStateMachineTimerSchedulerCollect, scheduler);
+        if (scheduler->firingCount > 0) {
+            scheduler->manualNow = MAX(scheduler->manualNow, tick / kTicksPerSecond);
+            ++scheduler->wakeupCount;
+            firedCount += PLStateMachineTimerSchedulerFire(scheduler);
+        }
+    }
+    PLStateMachineTimingWheelAdvance(&scheduler->wheel, target, PLStateMachineTimerSchedulerCollect, scheduler);
+    scheduler->manualNow = MAX(scheduler->manualNow, time);
+    pthread_mutex_unlock(&scheduler->lock);
+
+    return firedCount;
+}
+void PLStateMachineTimerSchedulerArm(PLStateMachineTimerScheduler *scheduler, PLStateMachineTimer *timer, NSTimeInterval deadline, NSTimeInterval leeway) {
+    uint64_t tick = PLStateMachineTimerSchedulerAlignedTick(PLStateMachineTimerSchedulerTicks(deadline), (uint64_t) (MAX(leeway, 0) * kTicksPerSecond));
+
+    pthread_mutex_lock(&scheduler->lock);
+    if (timer->armed) {
+        PLStateMachineTimingWheelRemove(&scheduler->wheel, timer);
+    } else {
+        CFRetain(timer->context);
+    }
+    PLStateMachineTimingWheelInsert(&scheduler->wheel, timer, tick);
+
+    //a sleeping thread only needs waking up if the timer is due before it would wake up anyway
+    if (scheduler->sleepingUntil != 0 && timer->deadline < scheduler->sleepingUntil) {
+        pthread_cond_signal(&scheduler->wakeup);
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+}
+
+BOOL PLStateMachineTimerSchedulerCancel(PLStateMachineTimerScheduler *scheduler, PLStateMachineTimer *timer) {
+    pthread_mutex_lock(&scheduler->lock);
+    BOOL armed = timer->armed;
+    if (armed) {
+        PLStateMachineTimingWheelRemove(&scheduler->wheel, timer);
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+
+    //the context can be the timer's owner
+    if (armed) {
+        CFRelease(timer->context);
+    }
+    return armed;
+}
+
+PLStateMachineTimerStatistics PLStateMachineTimerSchedulerGetStatistics(PLStateMachineTimerScheduler *scheduler) {
+    PLStateMachineTimerStatistics statistics;
+    pthread_mutex_lock(&scheduler->lock);
+    statistics.armedTimerCount = scheduler->wheel.count;
+    statistics.firedTimerCount = scheduler->firedTimerCount;
+    statistics.wakeupCount = scheduler->wakeupCount;
+    pthread_mutex_unlock(&scheduler->lock);
+    return statistics;
+}
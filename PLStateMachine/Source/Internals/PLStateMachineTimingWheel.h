@@ -0,0 +1,115 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+
+#import <Foundation/Foundation.h>
+
+#define PLSTATE_MACHINE_WHEEL_LEVELS 4
+#define PLSTATE_MACHINE_WHEEL_SLOT_BITS 6
+#define PLSTATE_MACHINE_WHEEL_SLOTS (1 << PLSTATE_MACHINE_WHEEL_SLOT_BITS)
+
+struct PLStateMachineTimer;
+
+typedef void (*PLStateMachineTimerFunction)(void *context, uintptr_t payload);
+
+/**
+* Intrusive timer node, usually embedded in its owner. Zero initialized nodes are disarmed.
+*/
+typedef struct PLStateMachineTimer {
+    struct PLStateMachineTimer *next;
+    struct PLStateMachineTimer *prev;
+    uint64_t deadline;
+    uint32_t level;
+    uint32_t slot;
+    BOOL armed;
+
+    PLStateMachineTimerFunction function;
+    //a CF object, retained by the scheduler while the timer is armed or firing
+    const void *context;
+    uintptr_t payload;
+} PLStateMachineTimer;
+
+/**
+* Hierarchical timing wheel counting time in ticks.
+*
+* Each level has 64 slots, a slot of level n spans 64^n ticks. A timer goes to the lowest level its deadline fits in,
+* and moves one level down each time the slot it is in comes up, so inserting and removing is O(1) no matter how many
+* timers are armed. Deadlines beyond the top level wait in an overflow list. Occupancy masks let the wheel jump over
+* empty slots, advancing over an idle period doesn't walk it tick by tick. Not thread safe.
+*/
+typedef struct PLStateMachineTimingWheel {
+    uint64_t now;
+    NSUInteger count;
+    uint64_t occupied[PLSTATE_MACHINE_WHEEL_LEVELS];
+    PLStateMachineTimer *slots[PLSTATE_MACHINE_WHEEL_LEVELS][PLSTATE_MACHINE_WHEEL_SLOTS];
+    PLStateMachineTimer *overflow;
+} PLStateMachineTimingWheel;
+
+typedef void (*PLStateMachineTimingWheelExpired)(PLStateMachineTimer *timer, void *info);
+
+void PLStateMachineTimingWheelInit(PLStateMachineTimingWheel *wheel, uint64_t now);
+
+/**
+* Inserts a disarmed timer. A deadline that already passed expires on the next tick.
+*/
+void PLStateMachineTimingWheelInsert(PLStateMachineTimingWheel *wheel, PLStateMachineTimer *timer, uint64_t deadline);
+
+/**
+* Removes an armed timer.
+*/
+void PLStateMachineTimingWheelRemove(PLStateMachineTimingWheel *wheel, PLStateMachineTimer *timer);
+
+/**
+* @return the next tick advancing to does any work, UINT64_MAX if the wheel is empty
+*/
+uint64_t PLStateMachineTimingWheelNextTick(const PLStateMachineTimingWheel *wheel);
+
+/**
+* Advances the wheel, expiring timers in deadline order. Expired timers are removed and disarmed before the callback
+* is called, the callback may insert them again.
+*/
+void PLStateMachineTimingWheelAdvance(PLStateMachineTimingWheel *wheel, uint64_t now, PLStateMachineTimingWheelExpired expired, void *info);
@@ -0,0 +1,189 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+
+#import "PLStateMachineTimingWheel.h"
+
+#define kWheelSlotMask ((uint64_t) PLSTATE_MACHINE_WHEEL_SLOTS - 1)
+#define kWheelOverflowLevel PLSTATE_MACHINE_WHEEL_LEVELS
+
+static void PLStateMachineTimingWheelLink(PLStateMachineTimer **head, PLStateMachineTimer *timer) {
+    timer->prev = NULL;
+    timer->next = *head;
+    if (*head != NULL) {
+        (*head)->prev = timer;
+    }
+    *head = timer;
+}
+
+static void PLStateMachineTimingWheelPlace(PLStateMachineTimingWheel *wheel, PLStateMachineTimer *timer) {
+    //due now only while a slot is cascaded, the slot of the current tick is expired right after
+    uint64_t delta = timer->deadline - wheel->now;
+    for (uint32_t level = 0; level < PLSTATE_MACHINE_WHEEL_LEVELS; ++level) {
+        if (delta < (uint64_t) 1 << (PLSTATE_MACHINE_WHEEL_SLOT_BITS * (level + 1))) {
+            uint32_t slot = (uint32_t) ((timer->deadline >> (PLSTATE_MACHINE_WHEEL_SLOT_BITS * level)) & kWheelSlotMask);
+            timer->level = level;
+            timer->slot = slot;
+            PLStateMachineTimingWheelLink(&wheel->slots[level][slot], timer);
+            wheel->occupied[level] |= (uint64_t) 1 << slot;
+            return;
+        }
+    }
+
+    timer->level = kWheelOverflowLevel;
+    timer->slot = 0;
+    PLStateMachineTimingWheelLink(&wheel->overflow, timer);
+}
+
+static void PLStateMachineTimingWheelUnlink(PLStateMachineTimingWheel *wheel, PLStateMachineTimer *timer) {
+    PLStateMachineTimer **head = timer->level == kWheelOverflowLevel ? &wheel->overflow : &wheel->slots[timer->level][timer->slot];
+    if (timer->prev != NULL) {
+        timer->prev->next = timer->next;
+    } else {
+        *head = timer->next;
+    }
+    if (timer->next != NULL) {
+        timer->next->prev = timer->prev;
+    }
+    if (*head == NULL && timer->level != kWheelOverflowLevel) {
+        wheel->occupied[timer->level] &= ~((uint64_t) 1 << timer->slot);
+    }
+    timer->next = NULL;
+    timer->prev = NULL;
+}
+
+static void PLStateMachineTimingWheelCascade(PLStateMachineTimingWheel *wheel, PLStateMachineTimer **head, uint32_t level, uint32_t slot) {
+    PLStateMachineTimer *timer = *head;
+    *head = NULL;
+    if (level != kWheelOverflowLevel) {
+        wheel->occupied[level] &= ~((uint64_t) 1 << slot);
+    }
+    while (timer != NULL) {
+        PLStateMachineTimer *next = timer->next;
+        PLStateMachineTimingWheelPlace(wheel, timer);
+        timer = next;
+    }
+}
+
+//ticks until the first occupied slot of a level comes up, 64 blocks away at most
+static uint64_t PLStateMachineTimingWheelBlocksUntil(uint64_t occupied, uint32_t position) {
+    //rotated so the slot after the current one is bit 0
+    uint32_t shift = (position + 1) & kWheelSlotMask;
+    uint64_t rotated = shift == 0 ? occupied : (occupied >> shift) | (occupied << (PLSTATE_MACHINE_WHEEL_SLOTS - shift));
+    return (uint64_t) __builtin_ctzll(rotated) + 1;
+}
+
+void PLStateMachineTimingWheelInit(PLStateMachineTimingWheel *wheel, uint64_t now) {
+    memset(wheel, 0, sizeof(PLStateMachineTimingWheel));
+    wheel->now = now;
+}
+
+void PLStateMachineTimingWheelInsert(PLStateMachineTimingWheel *wheel, PLStateMachineTimer *timer, uint64_t deadline) {
+    timer->deadline = MAX(deadline, wheel->now + 1);
+    timer->armed = YES;
+    PLStateMachineTimingWheelPlace(wheel, timer);
+    ++wheel->count;
+}
+
+void PLStateMachineTimingWheelRemove(PLStateMachineTimingWheel *wheel, PLStateMachineTimer *timer) {
+    PLStateMachineTimingWheelUnlink(wheel, timer);
+    timer->armed = NO;
+    --wheel->count;
+}
+
+uint64_t PLStateMachineTimingWheelNextTick(const PLStateMachineTimingWheel *wheel) {
+    if (wheel->count == 0) {
+        return UINT64_MAX;
+    }
+
+    //expiring a level 0 slot, or cascading a higher one, whichever comes first
+    uint64_t next = UINT64_MAX;
+    for (uint32_t level = 0; level < PLSTATE_MACHINE_WHEEL_LEVELS; ++level) {
+        if (wheel->occupied[level] == 0) {
+            continue;
+        }
+        uint32_t bits = PLSTATE_MACHINE_WHEEL_SLOT_BITS * level;
+        uint32_t position = (uint32_t) ((wheel->now >> bits) & kWheelSlotMask);
+        uint64_t block = (wheel->now >> bits) + PLStateMachineTimingWheelBlocksUntil(wheel->occupied[level], position);
+        next = MIN(next, block << bits);
+    }
+    if (wheel->overflow != NULL) {
+        uint32_t bits = PLSTATE_MACHINE_WHEEL_SLOT_BITS * PLSTATE_MACHINE_WHEEL_LEVELS;
+        next = MIN(next, ((wheel->now >> bits) + 1) << bits);
+    }
+    return next;
+}
+
+void PLStateMachineTimingWheelAdvance(PLStateMachineTimingWheel *wheel, uint64_t now, PLStateMachineTimingWheelExpired expired, void *info) {
+    while (wheel->now < now) {
+        //every tick in between is a no-op
+        uint64_t tick = MIN(PLStateMachineTimingWheelNextTick(wheel), now);
+        wheel->now = tick;
+
+        //the slots starting at this tick move down, the highest first
+        uint32_t cascaded = 0;
+        while (cascaded < PLSTATE_MACHINE_WHEEL_LEVELS && (tick & (((uint64_t) 1 << (PLSTATE_MACHINE_WHEEL_SLOT_BITS * (cascaded + 1))) - 1)) == 0) {
+            ++cascaded;
+        }
+        if (cascaded == PLSTATE_MACHINE_WHEEL_LEVELS) {
+            PLStateMachineTimingWheelCascade(wheel, &wheel->overflow, kWheelOverflowLevel, 0);
+        }
+        for (uint32_t level = MIN(cascaded, PLSTATE_MACHINE_WHEEL_LEVELS - 1); level > 0; --level) {
+            uint32_t slot = (uint32_t) ((tick >> (PLSTATE_MACHINE_WHEEL_SLOT_BITS * level)) & kWheelSlotMask);
+            if ((wheel->occupied[level] & ((uint64_t) 1 << slot)) != 0) {
+                PLStateMachineTimingWheelCascade(wheel, &wheel->slots[level][slot], level, slot);
+            }
+        }
+
+        uint32_t slot = (uint32_t) (tick & kWheelSlotMask);
+        while (wheel->slots[0][slot] != NULL) {
+            PLStateMachineTimer *timer = wheel->slots[0][slot];
+            PLStateMachineTimingWheelRemove(wheel, timer);
+            expired(timer, info);
+        }
+    }
+}
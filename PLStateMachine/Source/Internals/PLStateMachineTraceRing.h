@@ -0,0 +1,102 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+
+#import <Foundation/Foundation.h>
+#import "PLStateMachineTrace.h"
+
+@class PLStateMachineDefinition;
+
+/**
+* Fixed-size ring of packed trace records.
+*
+* A writer claims a slot with one atomic add and never waits, the oldest records are overwritten. Each slot carries a
+* sequence number written last, so readers can tell complete records from overwritten or half written ones without
+* stopping the writers. A writer lapped by another one on the same slot drops its record instead of waiting. Rings
+* are registered in a global list for PLStateMachineTraceWriteAll.
+*/
+typedef struct PLStateMachineTraceRing PLStateMachineTraceRing;
+
+/**
+* @param capacity rounded up to a power of two
+* @param owner the machine or pool, only its address is kept
+* @param ownerKind 0 for machines, 1 for pools
+* @return NULL if the capacity is 0
+*/
+PLStateMachineTraceRing *PLStateMachineTraceRingCreate(NSUInteger capacity, const void *owner, uint32_t ownerKind);
+
+void PLStateMachineTraceRingFree(PLStateMachineTraceRing *ring);
+
+NSUInteger PLStateMachineTraceRingCapacity(PLStateMachineTraceRing *ring);
+
+/**
+* Claims slots for count records written with PLStateMachineTraceRingWriteAt, e.g. by a bulk step.
+*
+* @return the index of the first slot
+*/
+uint64_t PLStateMachineTraceRingReserve(PLStateMachineTraceRing *ring, NSUInteger count);
+
+void PLStateMachineTraceRingWriteAt(PLStateMachineTraceRing *ring, uint64_t index, NSTimeInterval timestamp, PLStateMachineStateId prevState, PLStateMachineStateId state, PLStateMachineTriggerId triggerId, uint32_t instance, PLStateMachineTraceOutcome outcome);
+
+/**
+* Appends a record.
+*/
+void PLStateMachineTraceRingWrite(PLStateMachineTraceRing *ring, NSTimeInterval timestamp, PLStateMachineStateId prevState, PLStateMachineStateId state, PLStateMachineTriggerId triggerId, uint32_t instance, PLStateMachineTraceOutcome outcome);
+
+/**
+* Copies the most recent complete records, oldest first.
+*
+* @return the number of records copied
+*/
+NSUInteger PLStateMachineTraceRingCopy(PLStateMachineTraceRing *ring, PLStateMachineTraceRecord *records, NSUInteger maxCount);
+
+/**
+* Describes the most recent complete records, oldest first, one per line.
+*
+* @param definition names the states
+*/
+NSString *PLStateMachineTraceRingDescription(PLStateMachineTraceRing *ring, PLStateMachineDefinition *definition);
@@ -0,0 +1,294 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+
+#import <libkern/OSAtomic.h>
+#import <errno.h>
+#import <pthread.h>
+#import <unistd.h>
+#import "PLStateMachineTraceRing.h"
+#import "PLStateMachineDefinition.h"
+
+static uint32_t const kTraceDumpMagic = 0x504C5452;
+static uint32_t const kTraceDumpVersion = 1;
+//the sequence of a slot never written, as opposed to 0 for one being written
+static uint32_t const kTraceSlotFree = UINT32_MAX;
+//record sequences run from 1 to kTraceSequenceCount and wrap around, skipping the two above
+static uint64_t const kTraceSequenceCount = UINT32_MAX - 1;
+//records a dump copies at a time, on the stack of a possibly crashing thread
+#define PLSTATE_MACHINE_TRACE_DUMP_CHUNK 32
+
+struct PLStateMachineTraceRing {
+    struct PLStateMachineTraceRing *next;
+    struct PLStateMachineTraceRing *prev;
+    const void *owner;
+    uint32_t ownerKind;
+    uint64_t mask;
+    volatile int64_t head;
+    PLStateMachineTracePackedRecord slots[];
+};
+
+//all live rings, for dumps
+static PLStateMachineTraceRing *registeredRings;
+static uint32_t registeredRingCount;
+static pthread_mutex_t registeredRingsLock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t PLStateMachineTracePack(NSUInteger value) {
+    return value >= UINT32_MAX ? UINT32_MAX : (uint32_t) value;
+}
+
+static NSUInteger PLStateMachineTraceUnpack(uint32_t value) {
+    return value == UINT32_MAX ? NSUIntegerMax : value;
+}
+
+static uint32_t PLStateMachineTraceSequence(uint64_t index) {
+    return (uint32_t) (index % kTraceSequenceCount) + 1;
+}
+
+//whether the record of sequence was written after the one of otherSequence, across a wrap around
+static BOOL PLStateMachineTraceSequenceIsAfter(uint32_t sequence, uint32_t otherSequence) {
+    uint64_t distance = ((uint64_t) sequence + kTraceSequenceCount - otherSequence) % kTraceSequenceCount;
+    return distance != 0 && distance < kTraceSequenceCount / 2;
+}
+
+static BOOL PLStateMachineTraceRingRead(PLStateMachineTraceRing *ring, uint64_t index, PLStateMachineTracePackedRecord *copy) {
+    volatile PLStateMachineTracePackedRecord *slot = &ring->slots[index & ring->mask];
+    uint32_t sequence = slot->sequence;
+    OSMemoryBarrier();
+    copy->timestamp = slot->timestamp;
+    copy->prevState = slot->prevState;
+    copy->state = slot->state;
+    copy->triggerId = slot->triggerId;
+    copy->instance = slot->instance;
+    copy->outcome = slot->outcome;
+    OSMemoryBarrier();
+
+    //overwritten by a later lap, or being written
+    copy->sequence = sequence;
+    return sequence == PLStateMachineTraceSequence(index) && slot->sequence == sequence;
+}
+
+PLStateMachineTraceRing *PLStateMachineTraceRingCreate(NSUInteger capacity, const void *owner, uint32_t ownerKind) {
+    if (capacity == 0) {
+        return NULL;
+    }
+
+    NSUInteger slotCount = 1;
+    while (slotCount < capacity) {
+        slotCount <<= 1;
+    }
+    PLStateMachineTraceRing *ring = calloc(1, sizeof(PLStateMachineTraceRing) + slotCount * sizeof(PLStateMachineTracePackedRecord));
+    ring->owner = owner;
+    ring->ownerKind = ownerKind;
+    ring->mask = slotCount - 1;
+    for (NSUInteger i = 0; i < slotCount; ++i) {
+        ring->slots[i].sequence = kTraceSlotFree;
+    }
+
+    pthread_mutex_lock(&registeredRingsLock);
+    ring->next = registeredRings;
+    if (registeredRings != NULL) {
+        registeredRings->prev = ring;
+    }
+    registeredRings = ring;
+    ++registeredRingCount;
+    pthread_mutex_unlock(&registeredRingsLock);
+    return ring;
+}
+
+void PLStateMachineTraceRingFree(PLStateMachineTraceRing *ring) {
+    pthread_mutex_lock(&registeredRingsLock);
+    if (ring->prev != NULL) {
+        ring->prev->next = ring->next;
+    } else {
+        registeredRings = ring->next;
+    }
+    if (ring->next != NULL) {
+        ring->next->prev = ring->prev;
+    }
+    --registeredRingCount;
+    pthread_mutex_unlock(&registeredRingsLock);
+    free(ring);
+}
+
+NSUInteger PLStateMachineTraceRingCapacity(PLStateMachineTraceRing *ring) {
+    return (NSUInteger) ring->mask + 1;
+}
+
+uint64_t PLStateMachineTraceRingReserve(PLStateMachineTraceRing *ring, NSUInteger count) {
+    return (uint64_t) OSAtomicAdd64((int64_t) count, &ring->head) - count;
+}
+
+void PLStateMachineTraceRingWriteAt(PLStateMachineTraceRing *ring, uint64_t index, NSTimeInterval timestamp, PLStateMachineStateId prevState, PLStateMachineStateId state, PLStateMachineTriggerId triggerId, uint32_t instance, PLStateMachineTraceOutcome outcome) {
+    volatile PLStateMachineTracePackedRecord *slot = &ring->slots[index & ring->mask];
+    uint32_t sequence = PLStateMachineTraceSequence(index);
+
+    //a writer a lap ahead or behind holds the slot, or already wrote a newer record to it
+    uint32_t slotSequence = slot->sequence;
+    if (slotSequence == 0 || (slotSequence != kTraceSlotFree && PLStateMachineTraceSequenceIsAfter(slotSequence, sequence))) {
+        return;
+    }
+    if (!OSAtomicCompareAndSwap32Barrier((int32_t) slotSequence, 0, (volatile int32_t *) &slot->sequence)) {
+        return;
+    }
+
+    slot->timestamp = timestamp;
+    slot->prevState = PLStateMachineTracePack(prevState);
+    slot->state = PLStateMachineTracePack(state);
+    slot->triggerId = PLStateMachineTracePack(triggerId);
+    slot->instance = instance;
+    slot->outcome = outcome;
+    OSMemoryBarrier();
+    slot->sequence = sequence;
+}
+
+void PLStateMachineTraceRingWrite(PLStateMachineTraceRing *ring, NSTimeInterval timestamp, PLStateMachineStateId prevState, PLStateMachineStateId state, PLStateMachineTriggerId triggerId, uint32_t instance, PLStateMachineTraceOutcome outcome) {
+    uint64_t index = PLStateMachineTraceRingReserve(ring, 1);
+    PLStateMachineTraceRingWriteAt(ring, index, timestamp, prevState, state, triggerId, instance, outcome);
+}
+
+NSUInteger PLStateMachineTraceRingCopy(PLStateMachineTraceRing *ring, PLStateMachineTraceRecord *records, NSUInteger maxCount) {
+    uint64_t head = (uint64_t) OSAtomicAdd64Barrier(0, &ring->head);
+    uint64_t count = MIN(MIN(head, ring->mask + 1), (uint64_t) maxCount);
+
+    NSUInteger copiedCount = 0;
+    for (uint64_t index = head - count; index < head; ++index) {
+        PLStateMachineTracePackedRecord packed;
+        if (!PLStateMachineTraceRingRead(ring, index, &packed)) {
+            continue;
+        }
+        PLStateMachineTraceRecord *record = &records[copiedCount++];
+        record->timestamp = packed.timestamp;
+        record->prevState = PLStateMachineTraceUnpack(packed.prevState);
+        record->state = PLStateMachineTraceUnpack(packed.state);
+        record->triggerId = PLStateMachineTraceUnpack(packed.triggerId);
+        record->instance = packed.instance;
+        record->outcome = (PLStateMachineTraceOutcome) packed.outcome;
+    }
+    return copiedCount;
+}
+
+static NSString *PLStateMachineTraceStateName(PLStateMachineDefinition *definition, PLStateMachineStateId stateId) {
+    if (stateId == PLStateMachineStateUndefined) {
+        return @"-";
+    }
+    NSString *name = [definition nameForState:stateId];
+    return name != nil ? name : [NSString stringWithFormat:@"%lu", (unsigned long) stateId];
+}
+
+NSString *PLStateMachineTraceRingDescription(PLStateMachineTraceRing *ring, PLStateMachineDefinition *definition) {
+    static NSString *const outcomeNames[] = {@"started", @"transitioned", @"unresolved", @"dropped"};
+
+    NSUInteger capacity = PLStateMachineTraceRingCapacity(ring);
+    PLStateMachineTraceRecord *records = malloc(capacity * sizeof(PLStateMachineTraceRecord));
+    NSUInteger count = PLStateMachineTraceRingCopy(ring, records, capacity);
+
+    NSMutableString *description = [NSMutableString string];
+    for (NSUInteger i = 0; i < count; ++i) {
+        PLStateMachineTraceRecord *record = &records[i];
+        [description appendFormat:@"%.6f", record->timestamp];
+        if (ring->ownerKind == 1) {
+            [description appendFormat:@" #%u", record->instance];
+        }
+        [description appendFormat:@" %@ -> %@", PLStateMachineTraceStateName(definition, record->prevState), PLStateMachineTraceStateName(definition, record->state)];
+        if (record->triggerId != NSUIntegerMax) {
+            [description appendFormat:@" on %lu", (unsigned long) record->triggerId];
+        }
+        [description appendFormat:@" %@\n", outcomeNames[record->outcome]];
+    }
+    free(records);
+    return description;
+}
+
+static BOOL PLStateMachineTraceWriteFully(int fd, const void *bytes, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, bytes, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return NO;
+        }
+        bytes = (const uint8_t *) bytes + written;
+        length -= (size_t) written;
+    }
+    return YES;
+}
+
+BOOL PLStateMachineTraceWriteAll(int fd) {
+    //a crashing thread may hold the lock, the list can't be walked then
+    if (pthread_mutex_trylock(&registeredRingsLock) != 0) {
+        return NO;
+    }
+
+    PLStateMachineTraceDumpHeader header = {kTraceDumpMagic, kTraceDumpVersion, sizeof(PLStateMachineTracePackedRecord), registeredRingCount};
+    BOOL written = PLStateMachineTraceWriteFully(fd, &header, sizeof(header));
+    for (PLStateMachineTraceRing *ring = registeredRings; ring != NULL && written; ring = ring->next) {
+        uint64_t head = (uint64_t) ring->head;
+        uint64_t count = MIN(head, ring->mask + 1);
+        PLStateMachineTraceDumpRing ringHeader = {(uint64_t) (uintptr_t) ring->owner, (uint32_t) count, ring->ownerKind};
+        written = PLStateMachineTraceWriteFully(fd, &ringHeader, sizeof(ringHeader));
+
+        //incomplete records keep their slot with a 0 sequence
+        PLStateMachineTracePackedRecord chunk[PLSTATE_MACHINE_TRACE_DUMP_CHUNK];
+        uint64_t index = head - count;
+        while (index < head && written) {
+            NSUInteger chunkCount = 0;
+            while (chunkCount < PLSTATE_MACHINE_TRACE_DUMP_CHUNK && index < head) {
+                if (!PLStateMachineTraceRingRead(ring, index, &chunk[chunkCount])) {
+                    chunk[chunkCount].sequence = 0;
+                }
+                ++chunkCount;
+                ++index;
+            }
+            written = PLStateMachineTraceWriteFully(fd, chunk, chunkCount * sizeof(PLStateMachineTracePackedRecord));
+        }
+    }
+
+    pthread_mutex_unlock(&registeredRingsLock);
+    return written;
+}
@@ -0,0 +1,207 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+
+#import "PLStateMachineTransitionMap.h"
+
+typedef struct {
+    PLStateMachineStateId leaving;
+    PLStateMachineStateId entering;
+    const void *value;
+} PLStateMachineTransitionMapEntry;
+
+struct PLStateMachineTransitionMap {
+    NSUInteger capacity;
+    NSUInteger count;
+    PLStateMachineTransitionMapEntry *entries;
+};
+
+static NSUInteger const kTransitionMapInitialCapacity = 16;
+
+static inline uint64_t PLStateMachineTransitionMapMix(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+static inline NSUInteger PLStateMachineTransitionMapSlot(const PLStateMachineTransitionMap *map, PLStateMachineStateId leaving, PLStateMachineStateId entering) {
+    uint64_t hash = PLStateMachineTransitionMapMix((uint64_t) leaving ^ PLStateMachineTransitionMapMix((uint64_t) entering + 0x9e3779b97f4a7c15ULL));
+    return (NSUInteger) (hash & (map->capacity - 1));
+}
+
+static void PLStateMachineTransitionMapResize(PLStateMachineTransitionMap *map, NSUInteger capacity) {
+    PLStateMachineTransitionMapEntry *oldEntries = map->entries;
+    NSUInteger oldCapacity = map->capacity;
+
+    map->entries = calloc(capacity, sizeof(PLStateMachineTransitionMapEntry));
+    map->capacity = capacity;
+
+    for (NSUInteger i = 0; i < oldCapacity; ++i) {
+        if (oldEntries[i].value != NULL) {
+            NSUInteger slot = PLStateMachineTransitionMapSlot(map, oldEntries[i].leaving, oldEntries[i].entering);
+            while (map->entries[slot].value != NULL) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            map->entries[slot] = oldEntries[i];
+        }
+    }
+
+    free(oldEntries);
+}
+
+PLStateMachineTransitionMap *PLStateMachineTransitionMapCreate(void) {
+    PLStateMachineTransitionMap *map = calloc(1, sizeof(PLStateMachineTransitionMap));
+    map->capacity = kTransitionMapInitialCapacity;
+    map->entries = calloc(map->capacity, sizeof(PLStateMachineTransitionMapEntry));
+    return map;
+}
+
+PLStateMachineTransitionMap *PLStateMachineTransitionMapCopy(const PLStateMachineTransitionMap *map) {
+    PLStateMachineTransitionMap *copy = calloc(1, sizeof(PLStateMachineTransitionMap));
+    copy->capacity = map->capacity;
+    copy->count = map->count;
+    copy->entries = calloc(copy->capacity, sizeof(PLStateMachineTransitionMapEntry));
+    memcpy(copy->entries, map->entries, copy->capacity * sizeof(PLStateMachineTransitionMapEntry));
+    for (NSUInteger i = 0; i < copy->capacity; ++i) {
+        if (copy->entries[i].value != NULL) {
+            CFRetain(copy->entries[i].value);
+        }
+    }
+    return copy;
+}
+
+void PLStateMachineTransitionMapFree(PLStateMachineTransitionMap *map) {
+    if (map == NULL) {
+        return;
+    }
+
+    PLStateMachineTransitionMapRemoveAll(map);
+    free(map->entries);
+    free(map);
+}
+
+NSUInteger PLStateMachineTransitionMapCount(const PLStateMachineTransitionMap *map) {
+    return map->count;
+}
+
+id PLStateMachineTransitionMapGet(const PLStateMachineTransitionMap *map, PLStateMachineStateId leaving, PLStateMachineStateId entering) {
+    NSUInteger slot = PLStateMachineTransitionMapSlot(map, leaving, entering);
+    while (map->entries[slot].value != NULL) {
+        if (map->entries[slot].leaving == leaving && map->entries[slot].entering == entering) {
+            return (__bridge id) map->entries[slot].value;
+        }
+        slot = (slot + 1) & (map->capacity - 1);
+    }
+    return nil;
+}
+
+static void PLStateMachineTransitionMapRemoveSlot(PLStateMachineTransitionMap *map, NSUInteger slot) {
+    CFRelease(map->entries[slot].value);
+    map->entries[slot].value = NULL;
+    --map->count;
+
+    //backward shift deletion, keeps the probe sequences intact without tombstones
+    NSUInteger mask = map->capacity - 1;
+    NSUInteger hole = slot;
+    NSUInteger next = (slot + 1) & mask;
+    while (map->entries[next].value != NULL) {
+        NSUInteger home = PLStateMachineTransitionMapSlot(map, map->entries[next].leaving, map->entries[next].entering);
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            map->entries[hole] = map->entries[next];
+            map->entries[next].value = NULL;
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+}
+
+void PLStateMachineTransitionMapSet(PLStateMachineTransitionMap *map, PLStateMachineStateId leaving, PLStateMachineStateId entering, id value) {
+    NSUInteger slot = PLStateMachineTransitionMapSlot(map, leaving, entering);
+    while (map->entries[slot].value != NULL) {
+        if (map->entries[slot].leaving == leaving && map->entries[slot].entering == entering) {
+            if (value == nil) {
+                PLStateMachineTransitionMapRemoveSlot(map, slot);
+            } else {
+                const void *oldValue = map->entries[slot].value;
+                map->entries[slot].value = CFBridgingRetain(value);
+                CFRelease(oldValue);
+            }
+            return;
+        }
+        slot = (slot + 1) & (map->capacity - 1);
+    }
+
+    if (value == nil) {
+        return;
+    }
+
+    if ((map->count + 1) * 4 > map->capacity * 3) {
+        PLStateMachineTransitionMapResize(map, map->capacity * 2);
+        slot = PLStateMachineTransitionMapSlot(map, leaving, entering);
+        while (map->entries[slot].value != NULL) {
+            slot = (slot + 1) & (map->capacity - 1);
+        }
+    }
+
+    map->entries[slot].leaving = leaving;
+    map->entries[slot].entering = entering;
+    map->entries[slot].value = CFBridgingRetain(value);
+    ++map->count;
+}
+
+void PLStateMachineTransitionMapRemoveAll(PLStateMachineTransitionMap *map) {
+    for (NSUInteger i = 0; i < map->capacity; ++i) {
+        if (map->entries[i].value != NULL) {
+            CFRelease(map->entries[i].value);
+            map->entries[i].value = NULL;
+        }
+    }
+    map->count = 0;
+}
@@ -0,0 +1,118 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+
+#import <Foundation/Foundation.h>
+#import "PLStateMachine.h"
+
+typedef NS_ENUM(NSUInteger, PLStateMachineTriggerRecordKind) {
+    PLStateMachineTriggerRecordKindTrigger,
+    //a trigger that newer ones with the same id and key can replace while it waits
+    PLStateMachineTriggerRecordKindCoalescableTrigger,
+    PLStateMachineTriggerRecordKindTriggerBatch,
+    PLStateMachineTriggerRecordKindTriggerIdBatch,
+    PLStateMachineTriggerRecordKindStart,
+    //the timeout of the state entered count-th, stale once the machine left it
+    PLStateMachineTriggerRecordKindStateTimeout,
+    PLStateMachineTriggerRecordKindBarrier,
+    PLStateMachineTriggerRecordKindRetireListeners
+};
+
+/**
+* Plain record carrying a trigger (or a start/wait request) through the machine's mailbox.
+*
+* Records are recycled through a global lock-free pool and allocated in slabs, so emitting a trigger does not need a
+* malloc of its own. Slabs are never returned to the system, the pool size follows the highest number of triggers in
+* flight.
+*/
+typedef struct PLStateMachineTriggerRecord {
+    struct PLStateMachineTriggerRecord *next;
+    PLStateMachineTriggerRecordKind kind;
+    PLStateMachineStateId state;
+    //a retained object, a malloc'd buffer of count trigger ids for id batches, or a retired listener snapshot
+    const void *object;
+    //the number of triggers of a batch, or the state entry of a timeout
+    NSUInteger count;
+    //the retained coalescing key of a coalescable trigger
+    const void *key;
+    //the lane, PLStateMachineTriggerPriorityNormal unless set
+    PLStateMachineTriggerPriority priority;
+    NSTimeInterval enqueuedAt;
+    //bounded mailboxes only, the number of records its lane took in up to and including it
+    uint64_t sequence;
+    //single triggers only, the state entry the trigger is dropped after, 0 if it isn't scoped to one
+    NSUInteger scope;
+} PLStateMachineTriggerRecord;
+
+static inline BOOL PLStateMachineTriggerRecordIsTrigger(const PLStateMachineTriggerRecord *record) {
+    return record->kind == PLStateMachineTriggerRecordKindTrigger || record->kind == PLStateMachineTriggerRecordKindCoalescableTrigger;
+}
+
+//the emitted triggers a record carries, timeouts and bookkeeping records carry none
+static inline NSUInteger PLStateMachineTriggerRecordTriggerCount(const PLStateMachineTriggerRecord *record) {
+    if (PLStateMachineTriggerRecordIsTrigger(record)) {
+        return 1;
+    }
+    if (record->kind == PLStateMachineTriggerRecordKindTriggerBatch || record->kind == PLStateMachineTriggerRecordKindTriggerIdBatch) {
+        return record->count;
+    }
+    return 0;
+}
+
+PLStateMachineTriggerRecord *PLStateMachineTriggerRecordAcquire(void);
+
+void PLStateMachineTriggerRecordRelinquish(PLStateMachineTriggerRecord *record);
+
+/**
+* Releases whatever a record that is not going to be processed carries, and relinquishes the record.
+*/
+void PLStateMachineTriggerRecordDiscard(PLStateMachineTriggerRecord *record);
+
+/**
+* @return the number of slab allocations made so far
+*/
+NSUInteger PLStateMachineTriggerRecordAllocationCount(void);
@@ -51,13 +51,22 @@
 #define PLSTATE_MACHINE_VERSION 3.2
 
 @class PLStateMachine;
+@class PLStateMachineDefinition;
+@class PLStateMachineClock;
 @protocol PLStateMachineResolver;
+@protocol PLStateMachineExecutor;
 
 /**
 * Action callback type.
 */
 typedef void (^PLStateMachineStateChangeBlock)(PLStateMachine *fsm);
 
+/**
+* Coalescing key callback type. Triggers with equal keys replace each other, the key has to be usable as a dictionary
+* key. A nil key is a key of its own.
+*/
+typedef id <NSObject, NSCopying> (^PLStateMachineCoalescingKeyBlock)(PLStateMachineTrigger *trigger);
+
 /**
 * Base type for all machine state ids. When defining your states, you should use it as the base type for your NS_ENUM.
 */
@@ -68,6 +77,125 @@ typedef NSUInteger PLStateMachineStateId;
 */
 static PLStateMachineStateId const PLStateMachineStateUndefined = NSUIntegerMax;
 
+/**
+* What happens to a trigger emitted while the machine's queue is full.
+*/
+typedef NS_ENUM(NSUInteger, PLStateMachineOverflowPolicy) {
+    /**
+    * The emitting thread blocks until there is room. Never use it when emitting from the thread that processes the
+    * machine's triggers, e.g. with an inline or manual executor or a stepped machine. Triggers emitted by timers
+    * never block, they go over the capacity instead.
+    */
+    PLStateMachineOverflowPolicyBlock,
+    /**
+    * The trigger is rejected, emitting returns NO.
+    */
+    PLStateMachineOverflowPolicyFail,
+    /**
+    * The trigger is dropped, emitting returns NO.
+    */
+    PLStateMachineOverflowPolicyDropNewest,
+    /**
+    * The oldest queued trigger is dropped to make room.
+    */
+    PLStateMachineOverflowPolicyDropOldest,
+    /**
+    * The trigger replaces a queued trigger with the same id, priority and scope, keeping its place. If there is none,
+    * it is dropped and emitting returns NO.
+    */
+    PLStateMachineOverflowPolicyCoalesce
+};
+
+/**
+* Trigger lanes, from the least to the most urgent. Lanes are drained strictly by priority, the triggers of a lane in
+* the order they were emitted.
+*/
+typedef NS_ENUM(NSUInteger, PLStateMachineTriggerPriority) {
+    /**
+    * Floods of data triggers that can wait
+    */
+    PLStateMachineTriggerPriorityBulk,
+    /**
+    * The lane of triggers emitted without a priority
+    */
+    PLStateMachineTriggerPriorityNormal,
+    /**
+    * Control triggers, e.g. cancellations and timeouts
+    */
+    PLStateMachineTriggerPriorityUrgent
+};
+
+#define PLSTATE_MACHINE_PRIORITY_COUNT 3
+
+/**
+* Counters of one trigger lane.
+*/
+typedef struct PLStateMachineLaneStatistics {
+    /**
+    * Records waiting in the lane, a batch counts as one
+    */
+    NSUInteger depth;
+    /**
+    * Records taken from the lane so far
+    */
+    uint64_t processedRecordCount;
+    /**
+    * The time the processed records waited in the lane, in seconds. Divided by processedRecordCount it gives the
+    * average wait.
+    */
+    NSTimeInterval totalWaitTime;
+    /**
+    * The longest a processed record waited in the lane, in seconds
+    */
+    NSTimeInterval maxWaitTime;
+} PLStateMachineLaneStatistics;
+
+/**
+* Counters of a machine's trigger queue.
+*/
+typedef struct PLStateMachineQueueStatistics {
+    /**
+    * Triggers waiting to be processed
+    */
+    NSUInteger queuedTriggerCount;
+    /**
+    * The highest number of triggers that were waiting at once
+    */
+    NSUInteger highWaterMark;
+    /**
+    * Triggers dropped by PLStateMachineOverflowPolicyDropNewest, PLStateMachineOverflowPolicyDropOldest and
+    * PLStateMachineOverflowPolicyCoalesce
+    */
+    uint64_t droppedTriggerCount;
+    /**
+    * Triggers rejected by PLStateMachineOverflowPolicyFail
+    */
+    uint64_t rejectedTriggerCount;
+    /**
+    * Triggers replaced by newer ones, either by PLStateMachineOverflowPolicyCoalesce or because their id is coalesced
+    */
+    uint64_t coalescedTriggerCount;
+} PLStateMachineQueueStatistics;
+
+/**
+* Counters of the timers behind state timeouts and scheduled triggers, shared by all machines on a clock.
+*/
+typedef struct PLStateMachineTimerStatistics {
+    /**
+    * Timers waiting to fire
+    */
+    NSUInteger armedTimerCount;
+    /**
+    * Timers fired so far
+    */
+    uint64_t firedTimerCount;
+    /**
+    * The times the timer thread woke up so far, for virtual clocks the ticks timers fired at. Fewer wakeups than fired
+    * timers means timers fired together.
+    */
+    uint64_t wakeupCount;
+} PLStateMachineTimerStatistics;
+
 /**
 * PLStateMachine is a tool helping to model a Finite State Machine. A mathematical construct very useful when implementing
 * complex processes and decision flows.
@@ -94,6 +222,62 @@ static PLStateMachineStateId const PLStateMachineStateUndefined = NSUIntegerMax;
 */
 @property(nonatomic, copy, readwrite) PLStateMachineStateChangeBlock debugBlock;
 
+/**
+* The states and resolvers this machine runs, possibly shared with other machines
+*/
+@property(nonatomic, strong, readonly) PLStateMachineDefinition *definition;
+
+/**
+* The executor running the machine's work, nil for stepped machines
+*/
+@property(nonatomic, strong, readonly) id <PLStateMachineExecutor> executor;
+
+/**
+* YES for machines created with initSteppedWithDefinition:, which only process triggers when stepped
+*/
+@property(nonatomic, assign, readonly, getter=isStepped) BOOL stepped;
+
+/**
+* The most triggers that can wait to be processed, 0 if unbounded
+*/
+@property(nonatomic, assign, readonly) NSUInteger capacity;
+
+/**
+* What happens to triggers emitted while capacity triggers are waiting
+*/
+@property(nonatomic, assign, readonly) PLStateMachineOverflowPolicy overflowPolicy;
+
+/**
+* Counters of the trigger queue. Only the number of queued triggers is counted for unbounded machines.
+*/
+@property(nonatomic, assign, readonly) PLStateMachineQueueStatistics queueStatistics;
+
+/**
+* How many times in a row a waiting lane can be passed over for more urgent ones before it is drained once anyway.
+* 0, the default, drains the lanes strictly by priority.
+*/
+@property(nonatomic, assign) NSUInteger starvationLimit;
+
+/**
+* The clock time stamps and timers of the machine are read from
+*/
+@property(nonatomic, strong, readonly) PLStateMachineClock *clock;
+
+/**
+* The time scheduled triggers are emitted at, the clock's now
+*/
+@property(nonatomic, assign, readonly) NSTimeInterval currentTime;
+
+/**
+* YES after freeze was called
+*/
+@property(nonatomic, assign, readonly, getter=isFrozen) BOOL frozen;
+
+/**
+* @return counters of the timers behind the state timeouts and scheduled triggers of all machines on the system clock
+*/
++ (PLStateMachineTimerStatistics)timerStatistics;
+
 /**
 * Initializes fsm
 *
@@ -102,7 +286,84 @@ static PLStateMachineStateId const PLStateMachineStateUndefined = NSUIntegerMax;
 - (id)initWithQueue:(dispatch_queue_t)queue;
 
 /**
-* Blocks the caller thread until the machine settles.
+* Initializes fsm with a shared definition.
+*
+* States registered on the machine are registered on the definition, so a frozen definition can be shared by many
+* machines without copying it. Transition callbacks stay per machine.
+*
+* @param definition the definition to run. If nil is provided, a private one will be created.
+* @param queue the queue (DISPATCH_QUEUE_SERIAL) used internally by the fsm. If nil is provided, a queue will be created.
+*/
+- (id)initWithDefinition:(PLStateMachineDefinition *)definition queue:(dispatch_queue_t)queue;
+
+/**
+* Initializes fsm with a shared definition, running on an executor.
+*
+* All transition callbacks and KVO notifications will emit from the functions run by the executor. See
+* PLStateMachineQueueExecutor, PLStateMachineInlineExecutor, PLStateMachineManualExecutor and
+* PLStateMachineThreadPoolExecutor and PLStateMachineWorkStealingExecutor.
+*
+* @param definition the definition to run. If nil is provided, a private one will be created.
+* @param executor the executor to run on. If nil is provided, a queue executor will be created.
+*/
+- (id)initWithDefinition:(PLStateMachineDefinition *)definition executor:(id <PLStateMachineExecutor>)executor;
+
+/**
+* Initializes fsm with a shared definition, running on an executor and keeping time with a clock, see
+* initWithDefinition:executor:.
+*
+* @param definition the definition to run. If nil is provided, a private one will be created.
+* @param executor the executor to run on. If nil is provided, a queue executor will be created.
+* @param clock the clock to read time from and to run timers on. If nil is provided, the system clock is used.
+*/
+- (id)initWithDefinition:(PLStateMachineDefinition *)definition executor:(id <PLStateMachineExecutor>)executor clock:(PLStateMachineClock *)clock;
+
+/**
+* Initializes fsm with a bounded trigger queue, see initWithDefinition:executor:.
+*
+* Triggers emitted from the machine's own resolvers and callbacks are never subject to the capacity. Batches emitted
+* to a bounded machine are queued trigger by trigger.
+*
+* @param definition the definition to run. If nil is provided, a private one will be created.
+* @param executor the executor to run on. If nil is provided, a queue executor will be created.
+* @param capacity the most triggers that can wait to be processed, 0 for an unbounded queue
+* @param policy what happens to triggers emitted while capacity triggers are waiting
+*/
+- (id)initWithDefinition:(PLStateMachineDefinition *)definition executor:(id <PLStateMachineExecutor>)executor capacity:(NSUInteger)capacity overflowPolicy:(PLStateMachineOverflowPolicy)policy;
+
+/**
+* Initializes fsm with a bounded trigger queue, keeping time with a clock, see
+* initWithDefinition:executor:capacity:overflowPolicy:.
+*
+* @param definition the definition to run. If nil is provided, a private one will be created.
+* @param executor the executor to run on. If nil is provided, a queue executor will be created.
+* @param capacity the most triggers that can wait to be processed, 0 for an unbounded queue
+* @param policy what happens to triggers emitted while capacity triggers are waiting
+* @param clock the clock to read time from and to run timers on. If nil is provided, the system clock is used.
+*/
+- (id)initWithDefinition:(PLStateMachineDefinition *)definition executor:(id <PLStateMachineExecutor>)executor capacity:(NSUInteger)capacity overflowPolicy:(PLStateMachineOverflowPolicy)policy clock:(PLStateMachineClock *)clock;
+
+/**
+* Initializes a stepped fsm. Emitted triggers are buffered until stepWithBudget: or stepMaxTriggers: is called, and
+* are processed on the caller of those, e.g. once per display link tick on the main thread.
+*
+* @param definition the definition to run. If nil is provided, a private one will be created.
+*/
+- (id)initSteppedWithDefinition:(PLStateMachineDefinition *)definition;
+
+/**
+* Initializes a stepped fsm keeping time with a clock, see initSteppedWithDefinition:. Step budgets are always
+* measured in real time.
+*
+* @param definition the definition to run. If nil is provided, a private one will be created.
+* @param clock the clock to read time from and to run timers on. If nil is provided, the system clock is used.
+*/
+- (id)initSteppedWithDefinition:(PLStateMachineDefinition *)definition clock:(PLStateMachineClock *)clock;
+
+/**
+* Blocks the caller thread until the triggers emitted before the call, and those they emit in turn, are processed.
+* Triggers emitted meanwhile don't hold it up, whatever their priority. With a manual executor, the pending work is
+* drained on the caller thread, a stepped machine is stepped until it gets there.
 */
 - (void)wait;
 
@@ -117,23 +378,179 @@ static PLStateMachineStateId const PLStateMachineStateUndefined = NSUIntegerMax;
 * Constructs and emits a trigger (short form).
 *
 * @param triggerId the id of the trigger to emit
+* @return NO if the trigger was rejected or dropped because the machine is full, see capacity
 */
-- (void)emitTriggerId:(PLStateMachineTriggerId)triggerId;
+- (BOOL)emitTriggerId:(PLStateMachineTriggerId)triggerId;
 
 /**
 * Constructs and emits a trigger.
 *
 * @param triggerId the id of the trigger to emit
 * @param object a trigger attachment
+* @return NO if the trigger was rejected or dropped because the machine is full
 */
-- (void)emitTriggerId:(PLStateMachineTriggerId)triggerId object:(id <NSObject>)object;
+- (BOOL)emitTriggerId:(PLStateMachineTriggerId)triggerId object:(id <NSObject>)object;
 
 /**
 * Emits a trigger.
 *
+* Triggers emitted from resolvers or transition callbacks run to completion: they are processed right after the
+* current trigger, ahead of any triggers emitted from other threads in the meantime.
+*
+* @param trigger pre-constructed trigger
+* @return NO if the trigger was rejected or dropped because the machine is full
+*/
+- (BOOL)emitTrigger:(PLStateMachineTrigger *)trigger;
+
+/**
+* Emits a trigger into the lane of a priority. It is processed before the triggers waiting in less urgent lanes, and
+* after the ones emitted into its lane before. Triggers emitted without a priority use PLStateMachineTriggerPriorityNormal.
+*
 * @param trigger pre-constructed trigger
+* @param priority the lane to emit into
+* @return NO if the trigger was rejected or dropped because the machine is full
 */
-- (void)emitTrigger:(PLStateMachineTrigger *)trigger;
+- (BOOL)emitTrigger:(PLStateMachineTrigger *)trigger priority:(PLStateMachineTriggerPriority)priority;
+
+/**
+* Emits a batch of triggers at once.
+*
+* The triggers are resolved and applied one after another, exactly as if they were emitted separately, but the whole
+* batch is handed over to the machine's queue in one go.
+*
+* @param triggers an array of pre-constructed triggers
+* @return NO if any of the triggers was rejected or dropped because the machine is full
+*/
+- (BOOL)emitTriggers:(NSArray *)triggers;
+
+/**
+* Constructs and emits a batch of triggers at once (short form).
+*
+* @param triggerIds the ids of the triggers to emit, the array is copied
+* @param count the number of ids
+* @return NO if any of the triggers was rejected or dropped because the machine is full
+*/
+- (BOOL)emitTriggerIds:(const PLStateMachineTriggerId *)triggerIds count:(NSUInteger)count;
+
+/**
+* Emits a trigger once a delay passes (short form), see emitTrigger:atTime:cancelOnLeavingState:.
+*
+* @param trigger pre-constructed trigger
+* @param delay in seconds
+* @return a token that can be passed to cancelScheduledTrigger:
+*/
+- (id)emitTrigger:(PLStateMachineTrigger *)trigger afterDelay:(NSTimeInterval)delay;
+
+/**
+* Emits a trigger once a delay passes, see emitTrigger:atTime:cancelOnLeavingState:.
+*
+* @param trigger pre-constructed trigger
+* @param delay in seconds
+* @param cancelOnLeavingState YES to drop the trigger if the machine left its current state in the meantime
+* @return a token that can be passed to cancelScheduledTrigger:
+*/
+- (id)emitTrigger:(PLStateMachineTrigger *)trigger afterDelay:(NSTimeInterval)delay cancelOnLeavingState:(BOOL)cancelOnLeavingState;
+
+/**
+* Emits a trigger once a delay passes, allowing it to be late by up to a leeway, see
+* emitTrigger:atTime:leeway:cancelOnLeavingState:.
+*
+* @param trigger pre-constructed trigger
+* @param delay in seconds
+* @param leeway how much later than the delay the trigger may be emitted, in seconds
+* @param cancelOnLeavingState YES to drop the trigger if the machine left its current state in the meantime
+* @return a token that can be passed to cancelScheduledTrigger:
+*/
+- (id)emitTrigger:(PLStateMachineTrigger *)trigger afterDelay:(NSTimeInterval)delay leeway:(NSTimeInterval)leeway cancelOnLeavingState:(BOOL)cancelOnLeavingState;
+
+/**
+* Emits a trigger at a time (short form), see emitTrigger:atTime:cancelOnLeavingState:.
+*
+* @param trigger pre-constructed trigger
+* @param time in currentTime seconds
+* @return a token that can be passed to cancelScheduledTrigger:
+*/
+- (id)emitTrigger:(PLStateMachineTrigger *)trigger atTime:(NSTimeInterval)time;
+
+/**
+* Emits a trigger at a time.
+*
+* Scheduled triggers share the timing wheel of the state timeouts, there is no timer per trigger. A trigger scoped to
+* the current state is cancelled once the machine leaves the state, self transitions included, and is never processed
+* in another state even if it was due just as the machine left. The current state is best read by scheduling from the
+* machine's resolvers and callbacks. A machine doesn't wait for its scheduled triggers to stay alive.
+*
+* @param trigger pre-constructed trigger
+* @param time in currentTime seconds, with millisecond resolution
+* @param cancelOnLeavingState YES to drop the trigger if the machine left its current state in the meantime
+* @return a token that can be passed to cancelScheduledTrigger:
+*/
+- (id)emitTrigger:(PLStateMachineTrigger *)trigger atTime:(NSTimeInterval)time cancelOnLeavingState:(BOOL)cancelOnLeavingState;
+
+/**
+* Emits a trigger at a time, allowing it to be late by up to a leeway, see emitTrigger:atTime:cancelOnLeavingState:.
+*
+* Timers with a leeway expire at the roundest millisecond within it, so the triggers and timeouts of many machines due
+* around the same time fire together, with one timer wakeup and one hand-off to each executor. A leeway of a few
+* percent of the delay is usually unnoticeable and saves most of the wakeups, see timerStatistics.
+*
+* @param trigger pre-constructed trigger
+* @param time in currentTime seconds, with millisecond resolution
+* @param leeway how much later than the time the trigger may be emitted, in seconds
+* @param cancelOnLeavingState YES to drop the trigger if the machine left its current state in the meantime
+* @return a token that can be passed to cancelScheduledTrigger:
+*/
+- (id)emitTrigger:(PLStateMachineTrigger *)trigger atTime:(NSTimeInterval)time leeway:(NSTimeInterval)leeway cancelOnLeavingState:(BOOL)cancelOnLeavingState;
+
+/**
+* Cancels a scheduled trigger.
+*
+* @param token the token returned when the trigger was scheduled
+* @return YES if the trigger won't be emitted, NO if it was emitted or cancelled already
+*/
+- (BOOL)cancelScheduledTrigger:(id)token;
+
+/**
+* Marks a trigger id as idempotent. A trigger with that id replaces the one still waiting to be processed, taking over
+* its place in the queue, e.g. so that bursts of "refresh" triggers are processed once. Only triggers emitted with the
+* same priority, and scheduled to be cancelled on leaving the same state or not at all, replace each other. Triggers
+* emitted from the machine's own resolvers and callbacks are never coalesced.
+*
+* @param triggerId the id of the triggers to coalesce
+*/
+- (void)coalesceTriggerId:(PLStateMachineTriggerId)triggerId;
+
+/**
+* Marks a trigger id as idempotent per key, see coalesceTriggerId:. Only triggers with equal keys replace each other.
+*
+* @param triggerId the id of the triggers to coalesce
+* @param keyBlock extracts the key from a trigger, usually from its object. Called on the emitting thread.
+*/
+- (void)coalesceTriggerId:(PLStateMachineTriggerId)triggerId byKey:(PLStateMachineCoalescingKeyBlock)keyBlock;
+
+/**
+* @param priority the lane
+* @return counters of a trigger lane, e.g. to verify urgent triggers don't wait behind floods of bulk ones
+*/
+- (PLStateMachineLaneStatistics)statisticsForPriority:(PLStateMachineTriggerPriority)priority;
+
+/**
+* Processes buffered triggers on the caller thread until the time budget is used up. A trigger that has been started
+* is always finished, including the triggers emitted from its resolvers and callbacks, so the budget can be overrun
+* by one trigger. Only stepped machines can be stepped, steps from other threads wait for the current one.
+*
+* @param budget the time to spend, in seconds
+* @return the number of emitted triggers still buffered, a batch counts all of its triggers
+*/
+- (NSUInteger)stepWithBudget:(NSTimeInterval)budget;
+
+/**
+* Processes at most the given number of buffered triggers on the caller thread, see stepWithBudget:.
+*
+* @param maxTriggers the number of triggers to process
+* @return the number of emitted triggers still buffered, a batch counts all of its triggers
+*/
+- (NSUInteger)stepMaxTriggers:(NSUInteger)maxTriggers;
 
 /**
 * Registers a state.
@@ -144,6 +561,46 @@ static PLStateMachineStateId const PLStateMachineStateUndefined = NSUIntegerMax;
 */
 - (void)registerStateWithId:(PLStateMachineStateId)stateId name:(NSString *)name resolver:(id <PLStateMachineResolver>)resolver;
 
+/**
+* Registers a state with a timeout.
+*
+* The timeout is armed each time the state is entered, including self transitions, and cancelled when it is left.
+* Once it expires, the timeout trigger is emitted with PLStateMachineTriggerPriorityUrgent. A timeout that expired
+* just as the machine left the state is never processed in the next one. Timeouts are kept by one timing wheel per
+* clock, shared by its machines, so arming and cancelling them costs O(1) and doesn't create a timer each.
+*
+* @param stateId the id of the state. No two states with the same id can be registered at a time
+* @param name a human readable identifier for the state. It doesn't have to be unique
+* @param resolver the resolver to be used for this state. See PLStateMachineResolver for more info on resolvers
+* @param timeout the time after entering the state, in seconds, with millisecond resolution. 0 for no timeout
+* @param triggerId the id of the trigger emitted when the timeout expires
+*/
+- (void)registerStateWithId:(PLStateMachineStateId)stateId name:(NSString *)name resolver:(id <PLStateMachineResolver>)resolver timeout:(NSTimeInterval)timeout trigger:(PLStateMachineTriggerId)triggerId;
+
+/**
+* Registers a state with a timeout that can expire late by up to a leeway, see
+* registerStateWithId:name:resolver:timeout:trigger: and emitTrigger:atTime:leeway:cancelOnLeavingState:.
+*
+* @param stateId the id of the state. No two states with the same id can be registered at a time
+* @param name a human readable identifier for the state. It doesn't have to be unique
+* @param resolver the resolver to be used for this state. See PLStateMachineResolver for more info on resolvers
+* @param timeout the time after entering the state, in seconds, with millisecond resolution. 0 for no timeout
+* @param leeway how much later than the timeout it may expire, in seconds
+* @param triggerId the id of the trigger emitted when the timeout expires
+*/
+- (void)registerStateWithId:(PLStateMachineStateId)stateId name:(NSString *)name resolver:(id <PLStateMachineResolver>)resolver timeout:(NSTimeInterval)timeout leeway:(NSTimeInterval)leeway trigger:(PLStateMachineTriggerId)triggerId;
+
+/**
+* Freezes the registered states and compiles their resolvers into a states x triggers transition matrix.
+*
+* Map resolvers (including their parents and consultants) are flattened, so resolving a trigger becomes a single
+* indexed load. Only the cells backed by other resolvers (e.g. block resolvers) consult the resolver at runtime.
+* No states can be registered after the machine is frozen, and the resolvers must not be changed.
+*
+* @return the memory used by the compiled matrix, in bytes
+*/
+- (NSUInteger)freeze;
+
 /**
 * Checks if a state is registered.
 *
@@ -165,8 +622,9 @@ static PLStateMachineStateId const PLStateMachineStateUndefined = NSUIntegerMax;
 *
 * @param block the transition callback, you can register multiple callbacks for the same transition.
 * @param owner the owner(weak referenced) of this callback that can be used for targeted removal
+* @return a token that can be passed to removeListener:
 */
-- (void)onTransitionCall:(PLStateMachineStateChangeBlock)block owner:(id <NSObject>)owner;
+- (id)onTransitionCall:(PLStateMachineStateChangeBlock)block owner:(id <NSObject>)owner;
 
 /**
 * Registers a transition callback for leaving a state.
@@ -174,8 +632,9 @@ static PLStateMachineStateId const PLStateMachineStateUndefined = NSUIntegerMax;
 * @param stateId the id of the targeted state
 * @param block the transition callback
 * @param owner the owner(weak referenced) of this callback that can be used for targeted removal
+* @return a token that can be passed to removeListener:
 */
-- (void)onLeaving:(PLStateMachineStateId)stateId call:(PLStateMachineStateChangeBlock)block owner:(id <NSObject>)owner;
+- (id)onLeaving:(PLStateMachineStateId)stateId call:(PLStateMachineStateChangeBlock)block owner:(id <NSObject>)owner;
 
 /**
 * Registers a transition callback for entering a state.
@@ -183,8 +642,9 @@ static PLStateMachineStateId const PLStateMachineStateUndefined = NSUIntegerMax;
 * @param stateId the id of the targeted state
 * @param block the transition callback, you can register multiple callbacks for the same transition
 * @param owner the owner(weak referenced) of this callback that can be used for targeted removal
+* @return a token that can be passed to removeListener:
 */
-- (void)onEntering:(PLStateMachineStateId)stateId call:(PLStateMachineStateChangeBlock)block owner:(id <NSObject>)owner;
+- (id)onEntering:(PLStateMachineStateId)stateId call:(PLStateMachineStateChangeBlock)block owner:(id <NSObject>)owner;
 
 /**
 * Registers a transition callback between two defined states.
@@ -193,8 +653,16 @@ static PLStateMachineStateId const PLStateMachineStateUndefined = NSUIntegerMax;
 * @param newStateId the id of the state that's being entered
 * @param block the transition callback, you can register multiple callbacks for the same transition
 * @param owner the owner(weak referenced) of this callback that can be used for targeted removal
+* @return a token that can be passed to removeListener:
+*/
+- (id)onLeaving:(PLStateMachineStateId)prevStateId entering:(PLStateMachineStateId)newStateId call:(PLStateMachineStateChangeBlock)block owner:(id <NSObject>)owner;
+
+/**
+* Removes a single transition callback.
+*
+* @param listener the token returned when the callback was registered
 */
-- (void)onLeaving:(PLStateMachineStateId)prevStateId entering:(PLStateMachineStateId)newStateId call:(PLStateMachineStateChangeBlock)block owner:(id <NSObject>)owner;
+- (void)removeListener:(id)listener;
 
 /**
 * Removes all the transition callbacks that ware registered with the provided owner.
@@ -46,35 +46,155 @@
  */
 
 
+#import <libkern/OSAtomic.h>
+#import <pthread.h>
 #import "PLStateMachine.h"
-#import "PLStateMachineTransitionSignature.h"
-#import "PLStateMachineResolver.h"
+#import "PLStateMachineExecutor.h"
+#import "PLStateMachineQueueExecutor.h"
+#import "PLStateMachineDefinition.h"
+#import "PLStateMachineDefinition+Internals.h"
+#import "PLStateMachineClock.h"
+#import "PLStateMachineClock+Internals.h"
+#import "PLStateMachineTransitionMap.h"
+#import "PLStateMachineDispatchPlan.h"
+#import "PLStateMachineListener.h"
+#import "PLStateMachineListenerSnapshot.h"
+#import "PLStateMachineTriggerRecord.h"
+#import "PLStateMachineMailbox.h"
+#import "PLStateMachineBoundedMailbox.h"
+#import "PLStateMachineCoalescer.h"
+#import "PLStateMachineBarrier.h"
 #import "PLStateMachineStateNode.h"
+#import "PLStateMachineTimerScheduler.h"
+#import "PLStateMachineTimerTarget.h"
+#import "PLStateMachineScheduledTrigger.h"
+#import "PLStateMachineDrainBatch.h"
+#import "PLStateMachineTime.h"
+#import "PLStateMachineTrace.h"
+#import "PLStateMachineTraceRing.h"
 
 @interface PLStateMachine ()
 
-- (PLStateMachineStateNode *)nodeForState:(PLStateMachineStateId)state;
+- (id)initWithDefinition:(PLStateMachineDefinition *)definition executor:(id <PLStateMachineExecutor>)executor capacity:(NSUInteger)capacity overflowPolicy:(PLStateMachineOverflowPolicy)policy clock:(PLStateMachineClock *)clock stepped:(BOOL)stepped;
+
+- (BOOL)enqueueRecord:(PLStateMachineTriggerRecord *)record;
+
+- (BOOL)enqueueRecord:(PLStateMachineTriggerRecord *)record mayBlock:(BOOL)mayBlock;
+
+- (BOOL)pushRecord:(PLStateMachineTriggerRecord *)record mayBlock:(BOOL)mayBlock wasEmpty:(BOOL *)wasEmpty dropped:(PLStateMachineTriggerRecord **)dropped;
+
+- (BOOL)didPushRecord:(PLStateMachineTriggerRecord *)record accepted:(BOOL)accepted wasEmpty:(BOOL)wasEmpty dropped:(PLStateMachineTriggerRecord *)dropped;
+
+- (void)discardRecord:(PLStateMachineTriggerRecord *)record;
+
+- (BOOL)splitsBatches;
+
+- (NSUInteger)pendingRecordCount;
+
+- (NSUInteger)queuedTriggerCount;
+
+- (void)drainMailbox;
+
+- (NSUInteger)stepMaxTriggers:(NSUInteger)maxTriggers budget:(NSTimeInterval)budget;
+
+- (BOOL)isProcessingRecords;
+
+- (void)processReentrantRecords;
+
+- (BOOL)hasPoppedRecordsCountedBy:(PLStateMachineBarrier *)barrier;
+
+- (void)signalParkedBarriers;
+
+- (void)processRecord:(PLStateMachineTriggerRecord *)record;
+
+- (void)processTrigger:(PLStateMachineTrigger *)trigger;
+
+- (void)traceLeaving:(PLStateMachineStateId)prevState entering:(PLStateMachineStateId)state triggerId:(PLStateMachineTriggerId)triggerId outcome:(PLStateMachineTraceOutcome)outcome;
 
 - (void)setState:(PLStateMachineStateId)aState triggeredBy:(PLStateMachineTrigger *)trigger;
 
+- (void)armTimeoutOfState:(PLStateMachineStateId)stateId;
+
+- (void)emitTimeoutOfEntry:(NSUInteger)entry;
+
+- (BOOL)emitTrigger:(PLStateMachineTrigger *)trigger priority:(PLStateMachineTriggerPriority)priority scope:(NSUInteger)scope mayBlock:(BOOL)mayBlock;
+
+- (void)emitScheduledTrigger:(PLStateMachineScheduledTrigger *)scheduled;
+
+- (void)cancelScopedTriggers;
+
+- (BOOL)unregisterListener:(PLStateMachineListener *)listener from:(PLStateMachineListenerSnapshot *)snapshot;
+
+- (void)publishListeners:(PLStateMachineListenerSnapshot *)snapshot;
+
 - (void)notifyStateChange;
 
+- (PLStateMachineDispatchPlan *)buildDispatchPlanLeaving:(PLStateMachineStateId)prevState entering:(PLStateMachineStateId)newState from:(PLStateMachineListenerSnapshot *)snapshot;
+
 @end
 
+//the machine draining its mailbox on the current thread
+static pthread_key_t PLStateMachineDrainingKey;
+static pthread_once_t PLStateMachineDrainingKeyOnce = PTHREAD_ONCE_INIT;
+
+static void PLStateMachineCreateDrainingKey(void) {
+    pthread_key_create(&PLStateMachineDrainingKey, NULL);
+}
+
+static void PLStateMachineDrainMailbox(void *context) {
+    PLStateMachine *machine = (__bridge_transfer PLStateMachine *) context;
+    [machine drainMailbox];
+}
+
+static void PLStateMachineStateTimedOut(void *context, uintptr_t entry) {
+    PLStateMachine *machine = ((__bridge PLStateMachineTimerTarget *) context).machine;
+    [machine emitTimeoutOfEntry:entry];
+}
+
+static void PLStateMachineScheduledTriggerFired(void *context, uintptr_t payload) {
+    PLStateMachineScheduledTrigger *scheduled = (__bridge PLStateMachineScheduledTrigger *) context;
+    [scheduled.machine emitScheduledTrigger:scheduled];
+}
+
 @implementation PLStateMachine {
 @private
-    NSMutableDictionary *_registeredStates;
-    NSMutableDictionary *_transitionListeners;
-    dispatch_queue_t _queue;
+    PLStateMachineDefinition *_definition;
+    PLStateMachineListenerSnapshot *volatile _transitionListeners;
+    CFMutableDictionaryRef _listenersByOwner;
+    PLStateMachineTransitionMap *_dispatchPlans;
+    NSUInteger _dispatchPlansGeneration;
+    PLStateMachineMailbox _mailbox;
+    //replaces the mailbox once a capacity is set
+    PLStateMachineBoundedMailbox *_boundedMailbox;
+    //created once a trigger id is coalesced
+    PLStateMachineCoalescer *volatile _coalescer;
+    BOOL _stepped;
+    pthread_mutex_t _stepLock;
+    PLStateMachineTriggerRecord *_reentrantHead;
+    PLStateMachineTriggerRecord *_reentrantTail;
+    //consumer side, barriers taken out of the mailbox before the records they wait for
+    NSMutableArray *_parkedBarriers;
+    //counts state entries, tells the timeout of the current one from stale ones
+    NSUInteger _stateEntryCount;
+    PLStateMachineTimerTarget *_timeoutTarget;
+    //scheduled triggers to cancel when the state is left, created once one is scheduled
+    CFMutableSetRef _scopedTriggers;
+    pthread_mutex_t _scopedTriggersLock;
+    id <PLStateMachineExecutor> _executor;
+    PLStateMachineClock *_clock;
+    PLStateMachineTimerScheduler *_timerScheduler;
+    //NULL when built without tracing
+    PLStateMachineTraceRing *_traceRing;
 }
 
 @synthesize state = _state;
 @synthesize triggeredBy = _triggeredBy;
 @synthesize prevState = _prevState;
 @synthesize debugBlock = _debugBlock;
-
-NSString *const kStateMachineCallbackListenerBlockKey = @"callback";
-NSString *const kStateMachineCallbackListenerOwnerKey = @"owner";
+@synthesize definition = _definition;
+@synthesize executor = _executor;
+@synthesize stepped = _stepped;
+@synthesize clock = _clock;
 
 - (id)init {
     self = [self initWithQueue:nil];
@@ -82,34 +202,184 @@ NSString *const kStateMachineCallbackListenerOwnerKey = @"owner";
 }
 
 - (id)initWithQueue:(dispatch_queue_t)queue {
+    self = [self initWithDefinition:nil queue:queue];
+    return self;
+}
+
+- (id)initWithDefinition:(PLStateMachineDefinition *)definition queue:(dispatch_queue_t)queue {
+    self = [self initWithDefinition:definition executor:[[PLStateMachineQueueExecutor alloc] initWithQueue:queue]];
+    return self;
+}
+
+- (id)initWithDefinition:(PLStateMachineDefinition *)definition executor:(id <PLStateMachineExecutor>)executor {
+    self = [self initWithDefinition:definition executor:executor clock:nil];
+    return self;
+}
+
+- (id)initWithDefinition:(PLStateMachineDefinition *)definition executor:(id <PLStateMachineExecutor>)executor clock:(PLStateMachineClock *)clock {
+    self = [self initWithDefinition:definition executor:executor capacity:0 overflowPolicy:PLStateMachineOverflowPolicyBlock clock:clock];
+    return self;
+}
+
+- (id)initWithDefinition:(PLStateMachineDefinition *)definition executor:(id <PLStateMachineExecutor>)executor capacity:(NSUInteger)capacity overflowPolicy:(PLStateMachineOverflowPolicy)policy {
+    self = [self initWithDefinition:definition executor:executor capacity:capacity overflowPolicy:policy clock:nil];
+    return self;
+}
+
+- (id)initWithDefinition:(PLStateMachineDefinition *)definition executor:(id <PLStateMachineExecutor>)executor capacity:(NSUInteger)capacity overflowPolicy:(PLStateMachineOverflowPolicy)policy clock:(PLStateMachineClock *)clock {
+    if (executor == nil) {
+        executor = [[PLStateMachineQueueExecutor alloc] initWithQueue:nil];
+    }
+    self = [self initWithDefinition:definition executor:executor capacity:capacity overflowPolicy:policy clock:clock stepped:NO];
+    return self;
+}
+
+- (id)initWithDefinition:(PLStateMachineDefinition *)definition executor:(id <PLStateMachineExecutor>)executor capacity:(NSUInteger)capacity overflowPolicy:(PLStateMachineOverflowPolicy)policy clock:(PLStateMachineClock *)clock stepped:(BOOL)stepped {
     self = [super init];
     if (self) {
-        _queue = queue;
-        static int queueIdAutoKey = 0;
-        if (_queue == nil) {
-            _queue = dispatch_queue_create([[NSString stringWithFormat:@"fsm-%d", queueIdAutoKey] cStringUsingEncoding:NSASCIIStringEncoding], DISPATCH_QUEUE_SERIAL);
-            ++queueIdAutoKey;
+        pthread_once(&PLStateMachineDrainingKeyOnce, PLStateMachineCreateDrainingKey);
+
+        _definition = definition;
+        if (_definition == nil) {
+            _definition = [[PLStateMachineDefinition alloc] init];
+        }
+
+        //nil for a stepped machine, nothing drains its mailbox behind the stepping caller's back
+        _executor = executor;
+        _stepped = stepped;
+        if (_stepped) {
+            pthread_mutex_init(&_stepLock, NULL);
+        }
+        _clock = clock;
+        if (_clock == nil) {
+            _clock = [PLStateMachineClock systemClock];
+        }
+        _timerScheduler = _clock.timerScheduler;
+        PLStateMachineMailboxInit(&_mailbox, _timerScheduler);
+        if (capacity > 0) {
+            _boundedMailbox = PLStateMachineBoundedMailboxCreate(capacity, policy, _timerScheduler);
         }
 
         _state = PLStateMachineStateUndefined;
         _prevState = PLStateMachineStateUndefined;
         _triggeredBy = nil;
 
-        _registeredStates = [[NSMutableDictionary alloc] init];
 
-        _transitionListeners = [[NSMutableDictionary alloc] init];
+        _transitionListeners = PLStateMachineListenerSnapshotCreate();
+        //owners are weak, their addresses are the keys
+        _listenersByOwner = CFDictionaryCreateMutable(NULL, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+        _dispatchPlans = PLStateMachineTransitionMapCreate();
+        pthread_mutex_init(&_scopedTriggersLock, NULL);
+        _traceRing = PLStateMachineTraceRingCreate(PLSTATE_MACHINE_TRACE_CAPACITY, (__bridge const void *) self, 0);
     }
 
     return self;
 }
 
+- (id)initSteppedWithDefinition:(PLStateMachineDefinition *)definition {
+    self = [self initSteppedWithDefinition:definition clock:nil];
+    return self;
+}
+
+- (id)initSteppedWithDefinition:(PLStateMachineDefinition *)definition clock:(PLStateMachineClock *)clock {
+    self = [self initWithDefinition:definition executor:nil capacity:0 overflowPolicy:PLStateMachineOverflowPolicyBlock clock:clock stepped:YES];
+    return self;
+}
+
+- (void)dealloc {
+    if (_timeoutTarget != nil) {
+        PLStateMachineTimerSchedulerCancel(_timerScheduler, _timeoutTarget.timer);
+    }
+    if (_scopedTriggers != NULL) {
+        [self cancelScopedTriggers];
+        CFRelease(_scopedTriggers);
+    }
+    pthread_mutex_destroy(&_scopedTriggersLock);
+    if (_stepped) {
+        pthread_mutex_destroy(&_stepLock);
+    }
+    //a scheduled drain holds on to the machine, so only a stepped machine can get here with records left
+    PLStateMachineTriggerRecord *record;
+    while ((record = _boundedMailbox != NULL ? PLStateMachineBoundedMailboxPop(_boundedMailbox) : PLStateMachineMailboxPop(&_mailbox)) != NULL) {
+        [self discardRecord:record];
+    }
+    PLStateMachineMailboxDestroy(&_mailbox);
+    if (_boundedMailbox != NULL) {
+        PLStateMachineBoundedMailboxFree(_boundedMailbox);
+    }
+    PLStateMachineListenerSnapshotFree(_transitionListeners);
+    CFRelease(_listenersByOwner);
+    PLStateMachineTransitionMapFree(_dispatchPlans);
+    if (_traceRing != NULL) {
+        PLStateMachineTraceRingFree(_traceRing);
+    }
+}
+
 - (void)wait {
     dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
-    dispatch_async(_queue, ^{
-        dispatch_semaphore_signal(semaphore);
-    });
 
-    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    //waits for the records queued by now only, triggers emitted later into more urgent lanes can't hold it up
+    PLStateMachineBarrier *barrier = [[PLStateMachineBarrier alloc] initWithSemaphore:semaphore];
+    if (_boundedMailbox != NULL) {
+        PLStateMachineBoundedMailboxCopySequences(_boundedMailbox, barrier.sequences);
+    } else {
+        PLStateMachineMailboxCopySequences(&_mailbox, barrier.sequences);
+    }
+    //the most urgent lane takes it to the consumer, which keeps it until the lanes drained past it
+    PLStateMachineTriggerRecord *record = PLStateMachineTriggerRecordAcquire();
+    record->kind = PLStateMachineTriggerRecordKindBarrier;
+    record->priority = PLStateMachineTriggerPriorityUrgent;
+    record->object = CFBridgingRetain(barrier);
+    [self enqueueRecord:record];
+
+    if (_stepped) {
+        //a trigger at a time, triggers emitted meanwhile could keep a longer step going
+        while (dispatch_semaphore_wait(semaphore, DISPATCH_TIME_NOW) != 0) {
+            [self stepMaxTriggers:1];
+        }
+    } else {
+        [_executor waitForSemaphore:semaphore];
+    }
+}
+
+- (NSUInteger)capacity {
+    return _boundedMailbox != NULL ? _boundedMailbox->capacity : 0;
+}
+
+- (PLStateMachineOverflowPolicy)overflowPolicy {
+    return _boundedMailbox != NULL ? _boundedMailbox->policy : PLStateMachineOverflowPolicyBlock;
+}
+
+- (PLStateMachineQueueStatistics)queueStatistics {
+    PLStateMachineQueueStatistics statistics = {0};
+    if (_boundedMailbox != NULL) {
+        statistics = PLStateMachineBoundedMailboxStatistics(_boundedMailbox);
+    } else {
+        statistics.queuedTriggerCount = PLStateMachineMailboxQueuedTriggerCount(&_mailbox);
+    }
+    statistics.coalescedTriggerCount += _coalescer.coalescedTriggerCount;
+    return statistics;
+}
+
+- (NSUInteger)starvationLimit {
+    return _boundedMailbox != NULL ? _boundedMailbox->schedule.starvationLimit : _mailbox.schedule.starvationLimit;
+}
+
+- (void)setStarvationLimit:(NSUInteger)starvationLimit {
+    //picked up by the next pop
+    if (_boundedMailbox != NULL) {
+        _boundedMailbox->schedule.starvationLimit = starvationLimit;
+    } else {
+        _mailbox.schedule.starvationLimit = starvationLimit;
+    }
+}
+
+- (PLStateMachineLaneStatistics)statisticsForPriority:(PLStateMachineTriggerPriority)priority {
+    if (priority >= PLSTATE_MACHINE_PRIORITY_COUNT) {
+        @throw [NSException exceptionWithName:@"InvalidArgumentException" reason:@"unknown trigger priority" userInfo:nil];
+    }
+
+    return _boundedMailbox != NULL ? PLStateMachineBoundedMailboxLaneStatistics(_boundedMailbox, priority) : PLStateMachineMailboxLaneStatistics(&_mailbox, priority);
 }
 
 - (void)startWithState:(PLStateMachineStateId)stateId {
@@ -121,82 +391,568 @@ NSString *const kStateMachineCallbackListenerOwnerKey = @"owner";
         @throw [NSException exceptionWithName:@"InvalidArgumentException" reason:@"you canot enter a state that was not registered" userInfo:nil];
     }
 
-    dispatch_async(_queue, ^{
-        [self setState:stateId triggeredBy:nil];
-    });
+    //urgent triggers emitted after it must not find the machine unstarted
+    PLStateMachineTriggerRecord *record = PLStateMachineTriggerRecordAcquire();
+    record->kind = PLStateMachineTriggerRecordKindStart;
+    record->priority = PLStateMachineTriggerPriorityUrgent;
+    record->state = stateId;
+    [self enqueueRecord:record];
 }
 
-- (void)emitTriggerId:(PLStateMachineTriggerId)triggerId {
-    [self emitTrigger:[PLStateMachineTrigger triggerWithId:triggerId]];
+- (BOOL)emitTriggerId:(PLStateMachineTriggerId)triggerId {
+    return [self emitTrigger:[PLStateMachineTrigger triggerWithId:triggerId]];
 }
 
-- (void)emitTriggerId:(PLStateMachineTriggerId)triggerId object:(id <NSObject>)object {
-    [self emitTrigger:[PLStateMachineTrigger triggerWithId:triggerId object:object]];
+- (BOOL)emitTriggerId:(PLStateMachineTriggerId)triggerId object:(id <NSObject>)object {
+    return [self emitTrigger:[PLStateMachineTrigger triggerWithId:triggerId object:object]];
 }
 
-- (void)emitTrigger:(PLStateMachineTrigger *)trigger {
-    dispatch_async(_queue, ^{
-        PLStateMachineStateNode *node = [self nodeForState:_state];
+- (BOOL)emitTrigger:(PLStateMachineTrigger *)trigger {
+    return [self emitTrigger:trigger priority:PLStateMachineTriggerPriorityNormal];
+}
 
-        PLStateMachineStateId nextState = [node.resolver resolve:trigger in:self];
-        if (nextState != PLStateMachineStateUndefined) {
-            [self setState:nextState triggeredBy:trigger];
-            node = [self nodeForState:_state];
+- (BOOL)emitTrigger:(PLStateMachineTrigger *)trigger priority:(PLStateMachineTriggerPriority)priority {
+    if (priority >= PLSTATE_MACHINE_PRIORITY_COUNT) {
+        @throw [NSException exceptionWithName:@"InvalidArgumentException" reason:@"unknown trigger priority" userInfo:nil];
+    }
+
+    return [self emitTrigger:trigger priority:priority scope:0 mayBlock:YES];
+}
+
+- (BOOL)emitTrigger:(PLStateMachineTrigger *)trigger priority:(PLStateMachineTriggerPriority)priority scope:(NSUInteger)scope mayBlock:(BOOL)mayBlock {
+    //no block copy, the record comes from a pool
+    PLStateMachineTriggerRecord *record = PLStateMachineTriggerRecordAcquire();
+    record->kind = PLStateMachineTriggerRecordKindTrigger;
+    record->priority = priority;
+    record->scope = scope;
+    record->object = CFBridgingRetain(trigger);
+
+    PLStateMachineCoalescer *coalescer = _coalescer;
+    if (coalescer == nil || [self isProcessingRecords]) {
+        return [self enqueueRecord:record mayBlock:mayBlock];
+    }
+
+    __block BOOL accepted = YES;
+    __block BOOL wasEmpty = NO;
+    __block PLStateMachineTriggerRecord *dropped = NULL;
+    //only a full mailbox with the block policy holds the caller up, it never turns a record away
+    BOOL blocking = mayBlock && _boundedMailbox != NULL && _boundedMailbox->policy == PLStateMachineOverflowPolicyBlock;
+    BOOL replaced = [coalescer coalesceRecord:record blocking:blocking push:^BOOL(PLStateMachineTriggerRecord **droppedRecord) {
+        accepted = [self pushRecord:record mayBlock:mayBlock wasEmpty:&wasEmpty dropped:droppedRecord];
+        dropped = *droppedRecord;
+        return accepted;
+    }];
+    //a replaced trigger's record isn't queued, it carries the replaced trigger away
+    if (replaced) {
+        PLStateMachineTriggerRecordDiscard(record);
+        return YES;
+    }
+    return [self didPushRecord:record accepted:accepted wasEmpty:wasEmpty dropped:dropped];
+}
+
+- (BOOL)emitTriggers:(NSArray *)triggers {
+    if (triggers.count == 0) {
+        return YES;
+    }
+
+    if ([self splitsBatches]) {
+        BOOL accepted = YES;
+        for (PLStateMachineTrigger *trigger in triggers) {
+            accepted = [self emitTrigger:trigger] && accepted;
         }
-    });
+        return accepted;
+    }
+
+    PLStateMachineTriggerRecord *record = PLStateMachineTriggerRecordAcquire();
+    record->kind = PLStateMachineTriggerRecordKindTriggerBatch;
+    record->object = CFBridgingRetain([triggers copy]);
+    record->count = triggers.count;
+    return [self enqueueRecord:record];
 }
 
-- (void)registerStateWithId:(PLStateMachineStateId)stateId name:(NSString *)aName resolver:(id <PLStateMachineResolver>)aResolver {
-    @synchronized (_registeredStates) {
-        if (![self hasState:stateId]) {
-            if (stateId == PLStateMachineStateUndefined) {
-                @throw [NSException exceptionWithName:@"InvalidArgumentException" reason:@"you canot register the undefined state" userInfo:nil];
-            }
-            if (aName == nil || aResolver == nil || aName.length == 0) {
-                @throw [NSException exceptionWithName:@"InvalidArgumentException" reason:@"both name and resolver must be non-nil" userInfo:nil];
-            }
+- (BOOL)emitTriggerIds:(const PLStateMachineTriggerId *)triggerIds count:(NSUInteger)count {
+    if (count == 0) {
+        return YES;
+    }
+
+    if ([self splitsBatches]) {
+        BOOL accepted = YES;
+        for (NSUInteger i = 0; i < count; ++i) {
+            accepted = [self emitTriggerId:triggerIds[i]] && accepted;
+        }
+        return accepted;
+    }
+
+    PLStateMachineTriggerId *ids = malloc(count * sizeof(PLStateMachineTriggerId));
+    memcpy(ids, triggerIds, count * sizeof(PLStateMachineTriggerId));
+
+    PLStateMachineTriggerRecord *record = PLStateMachineTriggerRecordAcquire();
+    record->kind = PLStateMachineTriggerRecordKindTriggerIdBatch;
+    record->object = ids;
+    record->count = count;
+    return [self enqueueRecord:record];
+}
+
+- (id)emitTrigger:(PLStateMachineTrigger *)trigger afterDelay:(NSTimeInterval)delay {
+    return [self emitTrigger:trigger atTime:self.currentTime + delay cancelOnLeavingState:NO];
+}
+
+- (id)emitTrigger:(PLStateMachineTrigger *)trigger afterDelay:(NSTimeInterval)delay cancelOnLeavingState:(BOOL)cancelOnLeavingState {
+    return [self emitTrigger:trigger atTime:self.currentTime + delay cancelOnLeavingState:cancelOnLeavingState];
+}
+
+- (id)emitTrigger:(PLStateMachineTrigger *)trigger afterDelay:(NSTimeInterval)delay leeway:(NSTimeInterval)leeway cancelOnLeavingState:(BOOL)cancelOnLeavingState {
+    return [self emitTrigger:trigger atTime:self.currentTime + delay leeway:leeway cancelOnLeavingState:cancelOnLeavingState];
+}
+
+- (id)emitTrigger:(PLStateMachineTrigger *)trigger atTime:(NSTimeInterval)time {
+    return [self emitTrigger:trigger atTime:time cancelOnLeavingState:NO];
+}
+
+- (id)emitTrigger:(PLStateMachineTrigger *)trigger atTime:(NSTimeInterval)time cancelOnLeavingState:(BOOL)cancelOnLeavingState {
+    return [self emitTrigger:trigger atTime:time leeway:0 cancelOnLeavingState:cancelOnLeavingState];
+}
+
+- (id)emitTrigger:(PLStateMachineTrigger *)trigger atTime:(NSTimeInterval)time leeway:(NSTimeInterval)leeway cancelOnLeavingState:(BOOL)cancelOnLeavingState {
+    if (trigger == nil) {
+        @throw [NSException exceptionWithName:@"InvalidArgumentException" reason:@"the trigger must be non-nil" userInfo:nil];
+    }
+    if (leeway < 0) {
+        @throw [NSException exceptionWithName:@"InvalidArgumentException" reason:@"the leeway can't be negative" userInfo:nil];
+    }
+
+    //a machine that hasn't entered a state yet has nothing to scope to
+    NSUInteger scope = cancelOnLeavingState ? _stateEntryCount : 0;
+    PLStateMachineScheduledTrigger *scheduled = [[PLStateMachineScheduledTrigger alloc] initWithMachine:self function:PLStateMachineScheduledTriggerFired trigger:trigger scope:scope];
+    if (scope != 0) {
+        pthread_mutex_lock(&_scopedTriggersLock);
+        if (_scopedTriggers == NULL) {
+            _scopedTriggers = CFSetCreateMutable(NULL, 0, &kCFTypeSetCallBacks);
+        }
+        CFSetAddValue(_scopedTriggers, (__bridge const void *) scheduled);
+        pthread_mutex_unlock(&_scopedTriggersLock);
+    }
+
+    PLStateMachineTimerSchedulerArm(_timerScheduler, scheduled.timer, time, leeway);
+    return scheduled;
+}
+
+- (BOOL)cancelScheduledTrigger:(id)token {
+    if (![token isKindOfClass:[PLStateMachineScheduledTrigger class]]) {
+        @throw [NSException exceptionWithName:@"InvalidArgumentException" reason:@"not a scheduled trigger token" userInfo:nil];
+    }
+
+    PLStateMachineScheduledTrigger *scheduled = token;
+    if (scheduled.scope != 0) {
+        pthread_mutex_lock(&_scopedTriggersLock);
+        CFSetRemoveValue(_scopedTriggers, (__bridge const void *) scheduled);
+        pthread_mutex_unlock(&_scopedTriggersLock);
+    }
+    return PLStateMachineTimerSchedulerCancel(_timerScheduler, scheduled.timer);
+}
+
+- (void)emitScheduledTrigger:(PLStateMachineScheduledTrigger *)scheduled {
+    if (scheduled.scope != 0) {
+        pthread_mutex_lock(&_scopedTriggersLock);
+        CFSetRemoveValue(_scopedTriggers, (__bridge const void *) scheduled);
+        pthread_mutex_unlock(&_scopedTriggersLock);
+    }
+
+    //still dropped when processed if the machine left the state in the meantime, the shared timer thread can't wait
+    //for room in a full machine
+    [self emitTrigger:scheduled.trigger priority:PLStateMachineTriggerPriorityNormal scope:scheduled.scope mayBlock:NO];
+}
+
+- (void)cancelScopedTriggers {
+    pthread_mutex_lock(&_scopedTriggersLock);
+    if (CFSetGetCount(_scopedTriggers) == 0) {
+        pthread_mutex_unlock(&_scopedTriggersLock);
+        return;
+    }
+    NSArray *scopedTriggers = [(__bridge NSSet *) _scopedTriggers allObjects];
+    CFSetRemoveAllValues(_scopedTriggers);
+    pthread_mutex_unlock(&_scopedTriggersLock);
+
+    for (PLStateMachineScheduledTrigger *scheduled in scopedTriggers) {
+        PLStateMachineTimerSchedulerCancel(_timerScheduler, scheduled.timer);
+    }
+}
 
-            PLStateMachineStateNode *node = [[PLStateMachineStateNode alloc] initWithStateId:stateId name:aName resolver:aResolver];
-            [_registeredStates setObject:node forKey:[NSNumber numberWithUnsignedInteger:stateId]];
+- (BOOL)splitsBatches {
+    //stepped and bounded machines count triggers, not batches, coalescing replaces single triggers
+    return [self isProcessingRecords] || _stepped || _boundedMailbox != NULL || _coalescer != nil;
+}
+
+- (void)coalesceTriggerId:(PLStateMachineTriggerId)triggerId {
+    [self coalesceTriggerId:triggerId byKey:nil];
+}
+
+- (void)coalesceTriggerId:(PLStateMachineTriggerId)triggerId byKey:(PLStateMachineCoalescingKeyBlock)keyBlock {
+    PLStateMachineCoalescer *coalescer;
+    @synchronized (self) {
+        if (_coalescer == nil) {
+            coalescer = [[PLStateMachineCoalescer alloc] init];
+            //fully initialized before emitting threads can see it
+            OSMemoryBarrier();
+            _coalescer = coalescer;
+        }
+        coalescer = _coalescer;
+    }
+    [coalescer coalesceTriggerId:triggerId byKey:keyBlock];
+}
+
+- (BOOL)enqueueRecord:(PLStateMachineTriggerRecord *)record {
+    return [self enqueueRecord:record mayBlock:YES];
+}
+
+- (BOOL)enqueueRecord:(PLStateMachineTriggerRecord *)record mayBlock:(BOOL)mayBlock {
+    //emitted from a resolver or a callback, runs to completion before anything else is taken from the mailbox
+    if ([self isProcessingRecords]) {
+        if (_reentrantTail != NULL) {
+            _reentrantTail->next = record;
+        } else {
+            _reentrantHead = record;
+        }
+        _reentrantTail = record;
+        return YES;
+    }
+
+    BOOL wasEmpty;
+    PLStateMachineTriggerRecord *dropped;
+    BOOL accepted = [self pushRecord:record mayBlock:mayBlock wasEmpty:&wasEmpty dropped:&dropped];
+    return [self didPushRecord:record accepted:accepted wasEmpty:wasEmpty dropped:dropped];
+}
+
+- (BOOL)pushRecord:(PLStateMachineTriggerRecord *)record mayBlock:(BOOL)mayBlock wasEmpty:(BOOL *)wasEmpty dropped:(PLStateMachineTriggerRecord **)dropped {
+    if (_boundedMailbox != NULL) {
+        BOOL accepted;
+        *wasEmpty = PLStateMachineBoundedMailboxPush(_boundedMailbox, record, mayBlock, &accepted, dropped);
+        return accepted;
+    }
+    *wasEmpty = PLStateMachineMailboxPush(&_mailbox, record);
+    *dropped = NULL;
+    return YES;
+}
+
+- (BOOL)didPushRecord:(PLStateMachineTriggerRecord *)record accepted:(BOOL)accepted wasEmpty:(BOOL)wasEmpty dropped:(PLStateMachineTriggerRecord *)dropped {
+    //released outside of the mailbox lock, a trigger's attachment can do anything when deallocated
+    if (dropped != NULL) {
+        [self discardRecord:dropped];
+    }
+    if (!accepted) {
+        [self discardRecord:record];
+    }
+
+    //only the push that makes the mailbox non-empty schedules a drain, the drain holds on to the machine
+    if (wasEmpty && !_stepped) {
+        void *context = (__bridge_retained void *) self;
+        if (!PLStateMachineDrainBatchAdd(_executor, PLStateMachineDrainMailbox, context)) {
+            [_executor executeFunction:PLStateMachineDrainMailbox context:context];
+        }
+    }
+    return accepted;
+}
+
+- (void)discardRecord:(PLStateMachineTriggerRecord *)record {
+    if (record->kind == PLStateMachineTriggerRecordKindCoalescableTrigger) {
+        [_coalescer forgetRecord:record];
+    }
+    PLStateMachineTriggerRecordDiscard(record);
+}
+
+- (NSUInteger)pendingRecordCount {
+    return _boundedMailbox != NULL ? PLStateMachineBoundedMailboxPendingCount(_boundedMailbox) : PLStateMachineMailboxPendingCount(&_mailbox);
+}
+
+- (NSUInteger)queuedTriggerCount {
+    return _boundedMailbox != NULL ? PLStateMachineBoundedMailboxStatistics(_boundedMailbox).queuedTriggerCount : PLStateMachineMailboxQueuedTriggerCount(&_mailbox);
+}
+
+- (void)drainMailbox {
+    //an inline executor can run another machine's drain from within this one's callbacks
+    void *outerMachine = pthread_getspecific(PLStateMachineDrainingKey);
+    pthread_setspecific(PLStateMachineDrainingKey, (__bridge void *) self);
+    PLStateMachineBoundedMailbox *boundedMailbox = _boundedMailbox;
+    do {
+        PLStateMachineTriggerRecord *record = boundedMailbox != NULL ? PLStateMachineBoundedMailboxPop(boundedMailbox) : PLStateMachineMailboxPop(&_mailbox);
+        [self processRecord:record];
+        PLStateMachineTriggerRecordRelinquish(record);
+        [self processReentrantRecords];
+        if (_parkedBarriers != nil) {
+            [self signalParkedBarriers];
+        }
+    } while (boundedMailbox != NULL ? PLStateMachineBoundedMailboxDidProcess(boundedMailbox) : PLStateMachineMailboxDidProcess(&_mailbox));
+    pthread_setspecific(PLStateMachineDrainingKey, outerMachine);
+}
+
+- (NSUInteger)stepWithBudget:(NSTimeInterval)budget {
+    return [self stepMaxTriggers:NSUIntegerMax budget:budget];
+}
+
+- (NSUInteger)stepMaxTriggers:(NSUInteger)maxTriggers {
+    return [self stepMaxTriggers:maxTriggers budget:DBL_MAX];
+}
+
+- (NSUInteger)stepMaxTriggers:(NSUInteger)maxTriggers budget:(NSTimeInterval)budget {
+    if (!_stepped) {
+        @throw [NSException exceptionWithName:@"InvalidStateException" reason:@"only stepped machines can be stepped" userInfo:nil];
+    }
+
+    //stepped from a resolver or a callback, the current step goes on once it returns
+    if ([self isProcessingRecords]) {
+        return [self queuedTriggerCount];
+    }
+
+    pthread_mutex_lock(&_stepLock);
+    void *outerMachine = pthread_getspecific(PLStateMachineDrainingKey);
+    pthread_setspecific(PLStateMachineDrainingKey, (__bridge void *) self);
+
+    BOOL timed = budget < DBL_MAX;
+    NSTimeInterval deadline = timed ? PLStateMachineMonotonicTime() + budget : 0;
+    NSUInteger triggerCount = 0;
+    PLStateMachineBoundedMailbox *boundedMailbox = _boundedMailbox;
+    while (triggerCount < maxTriggers && [self pendingRecordCount] > 0) {
+        if (timed && PLStateMachineMonotonicTime() >= deadline) {
+            break;
+        }
+
+        PLStateMachineTriggerRecord *record = boundedMailbox != NULL ? PLStateMachineBoundedMailboxPop(boundedMailbox) : PLStateMachineMailboxPop(&_mailbox);
+        //bookkeeping records don't use up the step
+        if (record->kind != PLStateMachineTriggerRecordKindRetireListeners && record->kind != PLStateMachineTriggerRecordKindBarrier) {
+            ++triggerCount;
+        }
+        [self processRecord:record];
+        PLStateMachineTriggerRecordRelinquish(record);
+        [self processReentrantRecords];
+        if (_parkedBarriers != nil) {
+            [self signalParkedBarriers];
+        }
+        if (boundedMailbox != NULL) {
+            PLStateMachineBoundedMailboxDidProcess(boundedMailbox);
         } else {
-            @throw [NSException exceptionWithName:@"InvalidStateException" reason:@"this state was already registered" userInfo:nil];
+            PLStateMachineMailboxDidProcess(&_mailbox);
+        }
+    }
+
+    pthread_setspecific(PLStateMachineDrainingKey, outerMachine);
+    pthread_mutex_unlock(&_stepLock);
+
+    return [self queuedTriggerCount];
+}
+
+- (BOOL)isProcessingRecords {
+    //executors may run drains of one machine on different threads, so this can't ask the executor
+    return pthread_getspecific(PLStateMachineDrainingKey) == (__bridge void *) self;
+}
+
+- (void)processReentrantRecords {
+    //batches are split up when emitted reentrantly, so this never nests
+    while (_reentrantHead != NULL) {
+        PLStateMachineTriggerRecord *record = _reentrantHead;
+        _reentrantHead = record->next;
+        if (_reentrantHead == NULL) {
+            _reentrantTail = NULL;
+        }
+        record->next = NULL;
+
+        [self processRecord:record];
+        PLStateMachineTriggerRecordRelinquish(record);
+    }
+}
+
+- (BOOL)hasPoppedRecordsCountedBy:(PLStateMachineBarrier *)barrier {
+    return _boundedMailbox != NULL ? PLStateMachineBoundedMailboxHasPopped(_boundedMailbox, barrier.sequences) : PLStateMachineMailboxHasPopped(&_mailbox, barrier.sequences);
+}
+
+- (void)signalParkedBarriers {
+    NSUInteger i = 0;
+    while (i < _parkedBarriers.count) {
+        PLStateMachineBarrier *barrier = [_parkedBarriers objectAtIndex:i];
+        if ([self hasPoppedRecordsCountedBy:barrier]) {
+            [barrier signal];
+            [_parkedBarriers removeObjectAtIndex:i];
+        } else {
+            ++i;
+        }
+    }
+    if (_parkedBarriers.count == 0) {
+        _parkedBarriers = nil;
+    }
+}
+
+- (void)processRecord:(PLStateMachineTriggerRecord *)record {
+    switch (record->kind) {
+        case PLStateMachineTriggerRecordKindTrigger:
+        case PLStateMachineTriggerRecordKindCoalescableTrigger: {
+            //no newer trigger can take its place from now on
+            if (record->kind == PLStateMachineTriggerRecordKindCoalescableTrigger) {
+                [_coalescer forgetRecord:record];
+            }
+            PLStateMachineTrigger *trigger = CFBridgingRelease(record->object);
+            if (record->scope == 0 || record->scope == _stateEntryCount) {
+                [self processTrigger:trigger];
+            } else {
+                [self traceLeaving:_state entering:PLStateMachineStateUndefined triggerId:trigger.triggerId outcome:PLStateMachineTraceOutcomeDropped];
+            }
+            break;
+        }
+        case PLStateMachineTriggerRecordKindTriggerBatch:
+            for (PLStateMachineTrigger *trigger in (NSArray *) CFBridgingRelease(record->object)) {
+                [self processTrigger:trigger];
+                [self processReentrantRecords];
+            }
+            break;
+        case PLStateMachineTriggerRecordKindTriggerIdBatch: {
+            //id-only triggers are interned, resolving the batch doesn't allocate
+            PLStateMachineTriggerId *ids = (PLStateMachineTriggerId *) record->object;
+            for (NSUInteger i = 0; i < record->count; ++i) {
+                [self processTrigger:[PLStateMachineTrigger triggerWithId:ids[i]]];
+                [self processReentrantRecords];
+            }
+            free(ids);
+            break;
+        }
+        case PLStateMachineTriggerRecordKindStart:
+            [self traceLeaving:PLStateMachineStateUndefined entering:record->state triggerId:NSUIntegerMax outcome:PLStateMachineTraceOutcomeStarted];
+            [self setState:record->state triggeredBy:nil];
+            break;
+        case PLStateMachineTriggerRecordKindStateTimeout:
+            if (record->count == _stateEntryCount) {
+                PLStateMachineStateNode *node = [_definition nodeForState:_state];
+                [self processTrigger:[PLStateMachineTrigger triggerWithId:node.timeoutTriggerId]];
+            } else {
+                [self traceLeaving:_state entering:PLStateMachineStateUndefined triggerId:NSUIntegerMax outcome:PLStateMachineTraceOutcomeDropped];
+            }
+            break;
+        case PLStateMachineTriggerRecordKindRetireListeners:
+            PLStateMachineListenerSnapshotFree((PLStateMachineListenerSnapshot *) record->object);
+            break;
+        case PLStateMachineTriggerRecordKindBarrier: {
+            PLStateMachineBarrier *barrier = CFBridgingRelease(record->object);
+            if ([self hasPoppedRecordsCountedBy:barrier]) {
+                [barrier signal];
+            } else {
+                if (_parkedBarriers == nil) {
+                    _parkedBarriers = [[NSMutableArray alloc] init];
+                }
+                [_parkedBarriers addObject:barrier];
+            }
+            break;
         }
     }
 }
 
+- (void)processTrigger:(PLStateMachineTrigger *)trigger {
+    PLStateMachineStateId nextState = [_definition resolveTrigger:trigger inState:_state machine:self];
+    if (nextState != PLStateMachineStateUndefined) {
+        [self traceLeaving:_state entering:nextState triggerId:trigger.triggerId outcome:PLStateMachineTraceOutcomeTransitioned];
+        [self setState:nextState triggeredBy:trigger];
+    } else {
+        [self traceLeaving:_state entering:PLStateMachineStateUndefined triggerId:trigger.triggerId outcome:PLStateMachineTraceOutcomeUnresolved];
+    }
+}
+
+- (void)traceLeaving:(PLStateMachineStateId)prevState entering:(PLStateMachineStateId)state triggerId:(PLStateMachineTriggerId)triggerId outcome:(PLStateMachineTraceOutcome)outcome {
+    if (_traceRing != NULL) {
+        PLStateMachineTraceRingWrite(_traceRing, PLStateMachineTimerSchedulerNow(_timerScheduler), prevState, state, triggerId, 0, outcome);
+    }
+}
+
+- (NSUInteger)copyTrace:(PLStateMachineTraceRecord *)records maxCount:(NSUInteger)maxCount {
+    return _traceRing != NULL ? PLStateMachineTraceRingCopy(_traceRing, records, maxCount) : 0;
+}
+
+- (NSString *)traceDescription {
+    return _traceRing != NULL ? PLStateMachineTraceRingDescription(_traceRing, _definition) : @"";
+}
+
+- (void)registerStateWithId:(PLStateMachineStateId)stateId name:(NSString *)aName resolver:(id <PLStateMachineResolver>)aResolver {
+    [_definition registerStateWithId:stateId name:aName resolver:aResolver];
+}
+
+- (void)registerStateWithId:(PLStateMachineStateId)stateId name:(NSString *)aName resolver:(id <PLStateMachineResolver>)aResolver timeout:(NSTimeInterval)timeout trigger:(PLStateMachineTriggerId)triggerId {
+    [_definition registerStateWithId:stateId name:aName resolver:aResolver timeout:timeout trigger:triggerId];
+}
+
+- (void)registerStateWithId:(PLStateMachineStateId)stateId name:(NSString *)aName resolver:(id <PLStateMachineResolver>)aResolver timeout:(NSTimeInterval)timeout leeway:(NSTimeInterval)leeway trigger:(PLStateMachineTriggerId)triggerId {
+    [_definition registerStateWithId:stateId name:aName resolver:aResolver timeout:timeout leeway:leeway trigger:triggerId];
+}
+
+- (NSUInteger)freeze {
+    return [_definition freeze];
+}
+
+- (BOOL)isFrozen {
+    return _definition.isFrozen;
+}
+
 - (BOOL)hasState:(PLStateMachineStateId)stateId {
-    return [self nodeForState:stateId] != nil;
+    return [_definition hasState:stateId];
 }
 
 - (NSString *)nameForState:(PLStateMachineStateId)stateId {
-    return [[self nodeForState:stateId] name];
+    return [_definition nameForState:stateId];
 }
 
-- (void)onTransitionCall:(PLStateMachineStateChangeBlock)block owner:(id <NSObject>)owner {
-    [self onLeaving:PLStateMachineStateUndefined entering:PLStateMachineStateUndefined call:block owner:owner];
+- (id)onTransitionCall:(PLStateMachineStateChangeBlock)block owner:(id <NSObject>)owner {
+    return [self onLeaving:PLStateMachineStateUndefined entering:PLStateMachineStateUndefined call:block owner:owner];
 }
 
-- (void)onLeaving:(PLStateMachineStateId)stateId call:(PLStateMachineStateChangeBlock)block owner:(id <NSObject>)owner {
-    [self onLeaving:stateId entering:PLStateMachineStateUndefined call:block owner:owner];
+- (id)onLeaving:(PLStateMachineStateId)stateId call:(PLStateMachineStateChangeBlock)block owner:(id <NSObject>)owner {
+    return [self onLeaving:stateId entering:PLStateMachineStateUndefined call:block owner:owner];
 }
 
-- (void)onEntering:(PLStateMachineStateId)stateId call:(PLStateMachineStateChangeBlock)block owner:(id <NSObject>)owner {
-    [self onLeaving:PLStateMachineStateUndefined entering:stateId call:block owner:owner];
+- (id)onEntering:(PLStateMachineStateId)stateId call:(PLStateMachineStateChangeBlock)block owner:(id <NSObject>)owner {
+    return [self onLeaving:PLStateMachineStateUndefined entering:stateId call:block owner:owner];
 }
 
-- (void)onLeaving:(PLStateMachineStateId)prevStateId entering:(PLStateMachineStateId)newStateId call:(PLStateMachineStateChangeBlock)block owner:(id <NSObject>)owner {
-    PLStateMachineTransitionSignature *signature = [PLStateMachineTransitionSignature signatureForLeaving:prevStateId forEntering:newStateId];
+- (id)onLeaving:(PLStateMachineStateId)prevStateId entering:(PLStateMachineStateId)newStateId call:(PLStateMachineStateChangeBlock)block owner:(id <NSObject>)owner {
+    PLStateMachineListener *listener = [[PLStateMachineListener alloc] initForLeaving:prevStateId entering:newStateId block:block owner:owner];
+
+    //writers are serialized, the queue never takes this lock
+    @synchronized (self) {
+        PLStateMachineListenerSnapshot *snapshot = PLStateMachineListenerSnapshotCopy(_transitionListeners);
+        NSArray *listenersForTransition = PLStateMachineTransitionMapGet(snapshot->listeners, prevStateId, newStateId);
+        listenersForTransition = listenersForTransition != nil ? [listenersForTransition arrayByAddingObject:listener] : @[listener];
+        PLStateMachineTransitionMapSet(snapshot->listeners, prevStateId, newStateId, listenersForTransition);
+
+        if (owner != nil) {
+            NSMutableArray *listenersForOwner = (__bridge NSMutableArray *) CFDictionaryGetValue(_listenersByOwner, listener.owner);
+            if (listenersForOwner == nil) {
+                listenersForOwner = [NSMutableArray array];
+                CFDictionarySetValue(_listenersByOwner, listener.owner, (__bridge const void *) listenersForOwner);
+            }
+            [listenersForOwner addObject:listener];
+        }
 
-    NSMutableArray *listenersForSignature = [_transitionListeners objectForKey:signature];
-    if (listenersForSignature == nil) {
-        listenersForSignature = [NSMutableArray array];
-        [_transitionListeners setObject:listenersForSignature forKey:signature];
+        [self publishListeners:snapshot];
     }
 
-    if (owner == nil) {
-        [listenersForSignature addObject:@{kStateMachineCallbackListenerBlockKey : [block copy]}];
-    } else {
-        [listenersForSignature addObject:@{kStateMachineCallbackListenerBlockKey : [block copy], kStateMachineCallbackListenerOwnerKey : [NSValue valueWithNonretainedObject:owner]}];
+    return listener;
+}
+
+- (void)removeListener:(id)token {
+    if (![token isKindOfClass:[PLStateMachineListener class]]) {
+        return;
+    }
+
+    PLStateMachineListener *listener = token;
+    @synchronized (self) {
+        PLStateMachineListenerSnapshot *snapshot = PLStateMachineListenerSnapshotCopy(_transitionListeners);
+        if (![self unregisterListener:listener from:snapshot]) {
+            PLStateMachineListenerSnapshotFree(snapshot);
+            return;
+        }
+
+        if (listener.owner != NULL) {
+            NSMutableArray *listenersForOwner = (__bridge NSMutableArray *) CFDictionaryGetValue(_listenersByOwner, listener.owner);
+            [listenersForOwner removeObjectIdenticalTo:listener];
+            if (listenersForOwner != nil && listenersForOwner.count == 0) {
+                CFDictionaryRemoveValue(_listenersByOwner, listener.owner);
+            }
+        }
+
+        [self publishListeners:snapshot];
     }
 }
 
@@ -205,20 +961,86 @@ NSString *const kStateMachineCallbackListenerOwnerKey = @"owner";
         return;
     }
 
-    NSValue *nonRetainedOwner = [NSValue valueWithNonretainedObject:owner];
-    for (PLStateMachineTransitionSignature *signature in [_transitionListeners allKeys]) {
-        NSMutableArray *listenersForSignature = [_transitionListeners objectForKey:signature];
-        [listenersForSignature filterUsingPredicate:[NSPredicate predicateWithFormat:@"%K != %@", kStateMachineCallbackListenerOwnerKey, nonRetainedOwner]];
-        if (listenersForSignature.count == 0) {
-            [_transitionListeners removeObjectForKey:signature];
+    @synchronized (self) {
+        //only the owner's own listeners are visited
+        const void *ownerKey = (__bridge const void *) owner;
+        NSMutableArray *listenersForOwner = (__bridge NSMutableArray *) CFDictionaryGetValue(_listenersByOwner, ownerKey);
+        if (listenersForOwner == nil) {
+            return;
         }
+
+        PLStateMachineListenerSnapshot *snapshot = PLStateMachineListenerSnapshotCopy(_transitionListeners);
+        for (PLStateMachineListener *listener in listenersForOwner) {
+            [self unregisterListener:listener from:snapshot];
+        }
+        CFDictionaryRemoveValue(_listenersByOwner, ownerKey);
+
+        [self publishListeners:snapshot];
+    }
+}
+
+- (BOOL)unregisterListener:(PLStateMachineListener *)listener from:(PLStateMachineListenerSnapshot *)snapshot {
+    NSArray *listenersForTransition = PLStateMachineTransitionMapGet(snapshot->listeners, listener.leavingState, listener.enteringState);
+    NSUInteger index = [listenersForTransition indexOfObjectIdenticalTo:listener];
+    if (listenersForTransition == nil || index == NSNotFound) {
+        return NO;
     }
+
+    NSMutableArray *remaining = [listenersForTransition mutableCopy];
+    [remaining removeObjectAtIndex:index];
+    PLStateMachineTransitionMapSet(snapshot->listeners, listener.leavingState, listener.enteringState, remaining.count > 0 ? [remaining copy] : nil);
+    return YES;
+}
+
+- (void)publishListeners:(PLStateMachineListenerSnapshot *)snapshot {
+    PLStateMachineListenerSnapshot *retired = _transitionListeners;
+    OSMemoryBarrier();
+    _transitionListeners = snapshot;
+
+    //the queue reads a snapshot only while processing a single record, so once a record enqueued after the swap gets
+    //processed nobody can be using the old one anymore
+    PLStateMachineTriggerRecord *record = PLStateMachineTriggerRecordAcquire();
+    record->kind = PLStateMachineTriggerRecordKindRetireListeners;
+    record->object = retired;
+    [self enqueueRecord:record];
 }
 
 - (PLStateMachineStateId)state {
     return _state;
 }
 
++ (PLStateMachineTimerStatistics)timerStatistics {
+    return [PLStateMachineClock systemClock].timerStatistics;
+}
+
+- (NSTimeInterval)currentTime {
+    return PLStateMachineTimerSchedulerNow(_timerScheduler);
+}
+
+- (void)armTimeoutOfState:(PLStateMachineStateId)stateId {
+    if (_timeoutTarget != nil) {
+        PLStateMachineTimerSchedulerCancel(_timerScheduler, _timeoutTarget.timer);
+    }
+
+    PLStateMachineStateNode *node = [_definition nodeForState:stateId];
+    if (node.timeout > 0) {
+        if (_timeoutTarget == nil) {
+            _timeoutTarget = [[PLStateMachineTimerTarget alloc] initWithMachine:self function:PLStateMachineStateTimedOut];
+        }
+        _timeoutTarget.timer->payload = _stateEntryCount;
+        PLStateMachineTimerSchedulerArm(_timerScheduler, _timeoutTarget.timer, PLStateMachineTimerSchedulerNow(_timerScheduler) + node.timeout, node.timeoutLeeway);
+    }
+}
+
+- (void)emitTimeoutOfEntry:(NSUInteger)entry {
+    //a control trigger, it shouldn't wait behind data
+    PLStateMachineTriggerRecord *record = PLStateMachineTriggerRecordAcquire();
+    record->kind = PLStateMachineTriggerRecordKindStateTimeout;
+    record->priority = PLStateMachineTriggerPriorityUrgent;
+    record->count = entry;
+    [self enqueueRecord:record];
+}
+
 - (void)setState:(PLStateMachineStateId)aState triggeredBy:(PLStateMachineTrigger *)trigger {
     if (aState == PLStateMachineStateUndefined) {
         @throw [NSException exceptionWithName:@"InvalidArgumentException" reason:@"you canot enter the undefined state" userInfo:nil];
@@ -231,7 +1053,8 @@ NSString *const kStateMachineCallbackListenerOwnerKey = @"owner";
     BOOL stateChanges = aState != _state;
     BOOL triggerChanges = trigger != _triggeredBy;
 
-    if (!stateChanges && !triggerChanges) {
+    //id-only triggers are interned, so a self transition can legally carry the same trigger again
+    if (!stateChanges && !triggerChanges && trigger == nil) {
         @throw [NSException exceptionWithName:@"InvalidArgumentException" reason:@"at least one of state or trigger needs to change" userInfo:nil];
     }
 
@@ -244,6 +1067,15 @@ NSString *const kStateMachineCallbackListenerOwnerKey = @"owner";
     _prevState = _state;
     _state = aState;
     _triggeredBy = trigger;
+
+    //a scheduled trigger or timeout of the left state that fired already goes stale
+    ++_stateEntryCount;
+    if (_scopedTriggers != NULL) {
+        [self cancelScopedTriggers];
+    }
+    if ([_definition hasTimeouts]) {
+        [self armTimeoutOfState:aState];
+    }
     [self didChangeValueForKey:@"state"];
     [self didChangeValueForKey:@"prevState"];
 
@@ -258,46 +1090,44 @@ NSString *const kStateMachineCallbackListenerOwnerKey = @"owner";
     [self notifyStateChange];
 }
 
-- (PLStateMachineStateNode *)nodeForState:(PLStateMachineStateId)aState {
-    @synchronized (_registeredStates) {
-        return [_registeredStates objectForKey:[NSNumber numberWithUnsignedInteger:aState]];
+- (void)notifyStateChange {
+    //no lock, writers never change a published snapshot
+    PLStateMachineListenerSnapshot *snapshot = _transitionListeners;
+    if (PLStateMachineTransitionMapCount(snapshot->listeners) == 0) {
+        return;
     }
-}
 
-- (void)notifyStateChange {
-    if (_prevState != PLStateMachineStateUndefined) {
-        PLStateMachineTransitionSignature *leavingSignature = [PLStateMachineTransitionSignature signatureForLeaving:_prevState];
-        for (NSDictionary *listeners in [_transitionListeners objectForKey:leavingSignature]) {
-            PLStateMachineStateChangeBlock block = [listeners objectForKey:kStateMachineCallbackListenerBlockKey];
-            if (block) {
-                block(self);
-            }
-        }
+    //plans are only touched on the queue, a new snapshot just invalidates them
+    if (_dispatchPlansGeneration != snapshot->generation) {
+        PLStateMachineTransitionMapRemoveAll(_dispatchPlans);
+        _dispatchPlansGeneration = snapshot->generation;
+    }
 
-        PLStateMachineTransitionSignature *transitionSignature = [PLStateMachineTransitionSignature signatureForLeaving:_prevState forEntering:_state];
-        for (NSDictionary *listeners in [_transitionListeners objectForKey:transitionSignature]) {
-            PLStateMachineStateChangeBlock block = [listeners objectForKey:kStateMachineCallbackListenerBlockKey];
-            if (block) {
-                block(self);
-            }
-        }
+    PLStateMachineDispatchPlan *plan = PLStateMachineTransitionMapGet(_dispatchPlans, _prevState, _state);
+    if (plan == nil) {
+        plan = [self buildDispatchPlanLeaving:_prevState entering:_state from:snapshot];
+        PLStateMachineTransitionMapSet(_dispatchPlans, _prevState, _state, plan);
     }
 
+    [plan invokeWithMachine:self];
+}
 
-    PLStateMachineTransitionSignature *enteringSignature = [PLStateMachineTransitionSignature signatureForEntering:_state];
-    for (NSDictionary *listeners in [_transitionListeners objectForKey:enteringSignature]) {
-        PLStateMachineStateChangeBlock block = [listeners objectForKey:kStateMachineCallbackListenerBlockKey];
-        if (block) {
-            block(self);
-        }
-    }
+- (PLStateMachineDispatchPlan *)buildDispatchPlanLeaving:(PLStateMachineStateId)prevState entering:(PLStateMachineStateId)newState from:(PLStateMachineListenerSnapshot *)snapshot {
+    //leaving, between, entering and then the catch-all listeners
+    PLStateMachineStateId const leaving[] = {prevState, prevState, PLStateMachineStateUndefined, PLStateMachineStateUndefined};
+    PLStateMachineStateId const entering[] = {PLStateMachineStateUndefined, newState, newState, PLStateMachineStateUndefined};
+    NSUInteger first = prevState != PLStateMachineStateUndefined ? 0 : 2;
 
-    for (NSDictionary *listeners in [_transitionListeners objectForKey:[PLStateMachineTransitionSignature zeroSignature]]) {
-        PLStateMachineStateChangeBlock block = [listeners objectForKey:kStateMachineCallbackListenerBlockKey];
-        if (block) {
-            block(self);
+    NSMutableArray *blocks = [NSMutableArray array];
+    for (NSUInteger i = first; i < 4; ++i) {
+        for (PLStateMachineListener *listener in PLStateMachineTransitionMapGet(snapshot->listeners, leaving[i], entering[i])) {
+            if (listener.block) {
+                [blocks addObject:listener.block];
+            }
         }
     }
+
+    return blocks.count > 0 ? [[PLStateMachineDispatchPlan alloc] initWithBlocks:blocks] : [PLStateMachineDispatchPlan emptyPlan];
 }
 
 @end
@@ -0,0 +1,163 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+#import <Foundation/Foundation.h>
+#import "PLStateMachine.h"
+
+@class PLStateMachineInstance;
+@protocol PLStateMachineResolver;
+
+/**
+* Instance callback type.
+*/
+typedef void (^PLStateMachineInstanceChangeBlock)(PLStateMachineInstance *instance);
+
+/**
+* PLStateMachineDefinition holds everything about a state machine that doesn't change while it runs: the states, their
+* names and resolvers, and the callbacks every instance should call on its transitions.
+*
+* A definition is built once and then frozen. A frozen definition is immutable, so any number of PLStateMachine and
+* PLStateMachineInstance objects can share it across threads without copying it.
+*/
+@interface PLStateMachineDefinition : NSObject
+
+/**
+* YES after freeze was called
+*/
+@property(nonatomic, assign, readonly, getter=isFrozen) BOOL frozen;
+
+/**
+* Registers a state.
+*
+* @param stateId the id of the state. No two states with the same id can be registered at a time
+* @param name a human readable identifier for the state. It doesn't have to be unique
+* @param resolver the resolver to be used for this state. See PLStateMachineResolver for more info on resolvers
+*/
+- (void)registerStateWithId:(PLStateMachineStateId)stateId name:(NSString *)name resolver:(id <PLStateMachineResolver>)resolver;
+
+/**
+* Registers a state with a timeout. A PLStateMachine running the definition emits the timeout trigger once it spent the
+* timeout in the state, unless it left the state before. Instances don't keep time, their timeouts are ignored.
+*
+* @param stateId the id of the state. No two states with the same id can be registered at a time
+* @param name a human readable identifier for the state. It doesn't have to be unique
+* @param resolver the resolver to be used for this state. See PLStateMachineResolver for more info on resolvers
+* @param timeout the time after entering the state, in seconds. 0 for no timeout
+* @param triggerId the id of the trigger emitted when the timeout expires
+*/
+- (void)registerStateWithId:(PLStateMachineStateId)stateId name:(NSString *)name resolver:(id <PLStateMachineResolver>)resolver timeout:(NSTimeInterval)timeout trigger:(PLStateMachineTriggerId)triggerId;
+
+/**
+* Registers a state with a timeout that can expire late by up to a leeway, see registerStateWithId:name:resolver:timeout:trigger:.
+* Timeouts of many machines that are due within each other's leeway expire together, with one timer wakeup.
+*
+* @param stateId the id of the state. No two states with the same id can be registered at a time
+* @param name a human readable identifier for the state. It doesn't have to be unique
+* @param resolver the resolver to be used for this state. See PLStateMachineResolver for more info on resolvers
+* @param timeout the time after entering the state, in seconds. 0 for no timeout
+* @param leeway how much later than the timeout it may expire, in seconds
+* @param triggerId the id of the trigger emitted when the timeout expires
+*/
+- (void)registerStateWithId:(PLStateMachineStateId)stateId name:(NSString *)name resolver:(id <PLStateMachineResolver>)resolver timeout:(NSTimeInterval)timeout leeway:(NSTimeInterval)leeway trigger:(PLStateMachineTriggerId)triggerId;
+
+/**
+* Freezes the definition and compiles its resolvers into a states x triggers transition matrix. See PLStateMachine's
+* freeze for details. No states or instance callbacks can be registered afterwards.
+*
+* @return the memory used by the compiled matrix, in bytes
+*/
+- (NSUInteger)freeze;
+
+/**
+* Checks if a state is registered.
+*
+* @param stateId the id of the state to check
+* @return YES if the state was previously registered, NO otherwise
+*/
+- (BOOL)hasState:(PLStateMachineStateId)stateId;
+
+/**
+* Returns the name for a state.
+*
+* @param stateId the id of the state to check
+* @return the name of the state
+*/
+- (NSString *)nameForState:(PLStateMachineStateId)stateId;
+
+/**
+* Registers an instance callback for transitions between any two states.
+*
+* @param block the transition callback, called on the thread driving the instance
+*/
+- (void)onTransitionCall:(PLStateMachineInstanceChangeBlock)block;
+
+/**
+* Registers an instance callback for leaving a state.
+*
+* @param stateId the id of the targeted state
+* @param block the transition callback
+*/
+- (void)onLeaving:(PLStateMachineStateId)stateId call:(PLStateMachineInstanceChangeBlock)block;
+
+/**
+* Registers an instance callback for entering a state.
+*
+* @param stateId the id of the targeted state
+* @param block the transition callback
+*/
+- (void)onEntering:(PLStateMachineStateId)stateId call:(PLStateMachineInstanceChangeBlock)block;
+
+/**
+* Registers an instance callback between two defined states.
+*
+* @param prevStateId the id of the state that's being left
+* @param newStateId the id of the state that's being entered
+* @param block the transition callback
+*/
+- (void)onLeaving:(PLStateMachineStateId)prevStateId entering:(PLStateMachineStateId)newStateId call:(PLStateMachineInstanceChangeBlock)block;
+
+@end
@@ -0,0 +1,226 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+
+#import <libkern/OSAtomic.h>
+#import "PLStateMachineDefinition.h"
+#import "PLStateMachineDefinition+Internals.h"
+#import "PLStateMachineInstance.h"
+#import "PLStateMachineResolver.h"
+#import "PLStateMachineStateNode.h"
+#import "PLStateMachineStateTable.h"
+#import "PLStateMachineCompiledTable.h"
+#import "PLStateMachineTransitionMap.h"
+
+@implementation PLStateMachineDefinition {
+@private
+    PLStateMachineStateTable *_registeredStates;
+    PLStateMachineCompiledTable *volatile _compiledTable;
+    PLStateMachineTransitionMap *_instanceListeners;
+    BOOL _hasTimeouts;
+}
+
+- (id)init {
+    self = [super init];
+    if (self) {
+        _registeredStates = PLStateMachineStateTableCreate();
+        _instanceListeners = PLStateMachineTransitionMapCreate();
+    }
+
+    return self;
+}
+
+- (void)dealloc {
+    PLStateMachineTransitionMapFree(_instanceListeners);
+    PLStateMachineStateTableFree(_registeredStates);
+    PLStateMachineCompiledTableFree(_compiledTable);
+}
+
+- (void)registerStateWithId:(PLStateMachineStateId)stateId name:(NSString *)aName resolver:(id <PLStateMachineResolver>)aResolver {
+    [self registerStateWithId:stateId name:aName resolver:aResolver timeout:0 leeway:0 trigger:0];
+}
+
+- (void)registerStateWithId:(PLStateMachineStateId)stateId name:(NSString *)aName resolver:(id <PLStateMachineResolver>)aResolver timeout:(NSTimeInterval)timeout trigger:(PLStateMachineTriggerId)triggerId {
+    [self registerStateWithId:stateId name:aName resolver:aResolver timeout:timeout leeway:0 trigger:triggerId];
+}
+
+- (void)registerStateWithId:(PLStateMachineStateId)stateId name:(NSString *)aName resolver:(id <PLStateMachineResolver>)aResolver timeout:(NSTimeInterval)timeout leeway:(NSTimeInterval)leeway trigger:(PLStateMachineTriggerId)triggerId {
+    if (timeout < 0) {
+        @throw [NSException exceptionWithName:@"InvalidArgumentException" reason:@"the timeout can't be negative" userInfo:nil];
+    }
+    if (leeway < 0) {
+        @throw [NSException exceptionWithName:@"InvalidArgumentException" reason:@"the leeway can't be negative" userInfo:nil];
+    }
+
+    @synchronized (self) {
+        if (_compiledTable != NULL) {
+            @throw [NSException exceptionWithName:@"InvalidStateException" reason:@"no states can be registered after the machine was frozen" userInfo:nil];
+        }
+
+        if (![self hasState:stateId]) {
+            if (stateId == PLStateMachineStateUndefined) {
+                @throw [NSException exceptionWithName:@"InvalidArgumentException" reason:@"you canot register the undefined state" userInfo:nil];
+            }
+            if (aName == nil || aResolver == nil || aName.length == 0) {
+                @throw [NSException exceptionWithName:@"InvalidArgumentException" reason:@"both name and resolver must be non-nil" userInfo:nil];
+            }
+
+            PLStateMachineStateNode *node = [[PLStateMachineStateNode alloc] initWithStateId:stateId name:aName resolver:aResolver timeout:timeout leeway:leeway trigger:triggerId];
+            //published by the table, machines only look at it once they enter the state
+            if (timeout > 0) {
+                _hasTimeouts = YES;
+            }
+            PLStateMachineStateTableAdd(_registeredStates, node);
+        } else {
+            @throw [NSException exceptionWithName:@"InvalidStateException" reason:@"this state was already registered" userInfo:nil];
+        }
+    }
+}
+
+- (NSUInteger)freeze {
+    @synchronized (self) {
+        if (_compiledTable == NULL) {
+            PLStateMachineCompiledTable *compiledTable = PLStateMachineCompiledTableCreate(_registeredStates);
+            //publishes the instance callbacks too, they don't change after this point
+            OSMemoryBarrier();
+            _compiledTable = compiledTable;
+        }
+
+        return PLStateMachineCompiledTableSize(_compiledTable);
+    }
+}
+
+- (BOOL)isFrozen {
+    return _compiledTable != NULL;
+}
+
+- (BOOL)hasState:(PLStateMachineStateId)stateId {
+    return [self nodeForState:stateId] != nil;
+}
+
+- (NSString *)nameForState:(PLStateMachineStateId)stateId {
+    return [[self nodeForState:stateId] name];
+}
+
+- (void)onTransitionCall:(PLStateMachineInstanceChangeBlock)block {
+    [self onLeaving:PLStateMachineStateUndefined entering:PLStateMachineStateUndefined call:block];
+}
+
+- (void)onLeaving:(PLStateMachineStateId)stateId call:(PLStateMachineInstanceChangeBlock)block {
+    [self onLeaving:stateId entering:PLStateMachineStateUndefined call:block];
+}
+
+- (void)onEntering:(PLStateMachineStateId)stateId call:(PLStateMachineInstanceChangeBlock)block {
+    [self onLeaving:PLStateMachineStateUndefined entering:stateId call:block];
+}
+
+- (void)onLeaving:(PLStateMachineStateId)prevStateId entering:(PLStateMachineStateId)newStateId call:(PLStateMachineInstanceChangeBlock)block {
+    if (block == nil) {
+        @throw [NSException exceptionWithName:@"InvalidArgumentException" reason:@"the callback must be non-nil" userInfo:nil];
+    }
+
+    @synchronized (self) {
+        if (_compiledTable != NULL) {
+            @throw [NSException exceptionWithName:@"InvalidStateException" reason:@"no callbacks can be registered after the definition was frozen" userInfo:nil];
+        }
+
+        NSMutableArray *listenersForTransition = PLStateMachineTransitionMapGet(_instanceListeners, prevStateId, newStateId);
+        if (listenersForTransition == nil) {
+            listenersForTransition = [NSMutableArray array];
+            PLStateMachineTransitionMapSet(_instanceListeners, prevStateId, newStateId, listenersForTransition);
+        }
+        [listenersForTransition addObject:[block copy]];
+    }
+}
+
+- (PLStateMachineStateNode *)nodeForState:(PLStateMachineStateId)stateId {
+    return PLStateMachineStateTableGet(_registeredStates, stateId);
+}
+
+- (PLStateMachineCompiledTable *)compiledTable {
+    return _compiledTable;
+}
+
+- (BOOL)hasTimeouts {
+    return _hasTimeouts;
+}
+
+- (PLStateMachineStateId)resolveTrigger:(PLStateMachineTrigger *)trigger inState:(PLStateMachineStateId)stateId machine:(PLStateMachine *)machine {
+    PLStateMachineStateNode *node = [self nodeForState:stateId];
+
+    PLStateMachineCompiledTable *compiledTable = _compiledTable;
+    BOOL dynamic = YES;
+    if (compiledTable != NULL && node != nil) {
+        dynamic = NO;
+        PLStateMachineStateId nextState = PLStateMachineCompiledTableResolve(compiledTable, node.index, trigger.triggerId, &dynamic);
+        if (!dynamic) {
+            return nextState;
+        }
+    }
+    return [node.resolver resolve:trigger in:machine];
+}
+
+- (void)notifyInstance:(PLStateMachineInstance *)instance {
+    if (PLStateMachineTransitionMapCount(_instanceListeners) == 0) {
+        return;
+    }
+
+    //leaving, between, entering and then the catch-all callbacks
+    PLStateMachineStateId prevState = instance.prevState;
+    PLStateMachineStateId newState = instance.state;
+    PLStateMachineStateId const leaving[] = {prevState, prevState, PLStateMachineStateUndefined, PLStateMachineStateUndefined};
+    PLStateMachineStateId const entering[] = {PLStateMachineStateUndefined, newState, newState, PLStateMachineStateUndefined};
+    NSUInteger first = prevState != PLStateMachineStateUndefined ? 0 : 2;
+
+    for (NSUInteger i = first; i < 4; ++i) {
+        for (PLStateMachineInstanceChangeBlock block in PLStateMachineTransitionMapGet(_instanceListeners, leaving[i], entering[i])) {
+            block(instance);
+        }
+    }
+}
+
+@end
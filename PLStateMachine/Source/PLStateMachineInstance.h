@@ -0,0 +1,119 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+#import <Foundation/Foundation.h>
+#import "PLStateMachine.h"
+
+@class PLStateMachineDefinition;
+
+/**
+* A lightweight state machine driven by a shared, frozen PLStateMachineDefinition.
+*
+* An instance only holds its current and previous state, the last trigger and an optional context pointer. It has no
+* queue of its own: triggers are resolved and applied synchronously on the calling thread, and the definition's
+* instance callbacks are called before the emit returns. Instances are not thread safe, and they don't emit KVO
+* notifications. Resolvers consulted on behalf of an instance receive nil as the machine.
+*/
+@interface PLStateMachineInstance : NSObject
+
+/**
+* The definition this instance runs
+*/
+@property(nonatomic, strong, readonly) PLStateMachineDefinition *definition;
+
+/**
+* StateId of the previous state
+*/
+@property(nonatomic, assign, readonly) PLStateMachineStateId prevState;
+
+/**
+* StateId of the current state
+*/
+@property(nonatomic, assign, readonly) PLStateMachineStateId state;
+
+/**
+* Trigger that caused the transition to the current state
+*/
+@property(nonatomic, strong, readonly) PLStateMachineTrigger *triggeredBy;
+
+/**
+* Caller owned pointer, not retained
+*/
+@property(nonatomic, assign, readwrite) void *context;
+
+/**
+* Initializes the instance.
+*
+* @param definition a frozen definition
+* @param context caller owned pointer, not retained
+*/
+- (id)initWithDefinition:(PLStateMachineDefinition *)definition context:(void *)context;
+
+/**
+* Moves the instance to its initial state.
+*
+* @param stateId the id of the state the instance should start in.
+*/
+- (void)startWithState:(PLStateMachineStateId)stateId;
+
+/**
+* Constructs and applies a trigger (short form).
+*
+* @param triggerId the id of the trigger to emit
+* @return YES if the trigger caused a transition
+*/
+- (BOOL)emitTriggerId:(PLStateMachineTriggerId)triggerId;
+
+/**
+* Applies a trigger.
+*
+* @param trigger pre-constructed trigger
+* @return YES if the trigger caused a transition
+*/
+- (BOOL)emitTrigger:(PLStateMachineTrigger *)trigger;
+
+@end
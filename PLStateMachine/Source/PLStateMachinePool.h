@@ -0,0 +1,217 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+#import <Foundation/Foundation.h>
+#import "PLStateMachine.h"
+
+@class PLStateMachinePool;
+@class PLStateMachineDefinition;
+@class PLStateMachineClock;
+
+/**
+* Identifies an instance within a pool. Handles of removed instances are reused.
+*/
+typedef uint32_t PLStateMachinePoolHandle;
+
+static PLStateMachinePoolHandle const PLStateMachinePoolHandleInvalid = UINT32_MAX;
+
+/**
+* Options for stepping all instances of a pool.
+*/
+typedef NS_OPTIONS(NSUInteger, PLStateMachinePoolStepOptions) {
+    /**
+    * Partitions the instances across cores. Triggers resolved by resolvers at runtime are still stepped serially,
+    * resolvers are never called concurrently.
+    */
+    PLStateMachinePoolStepConcurrently = 1 << 0,
+    /**
+    * Calls the callbacks on the calling thread in handle order once all partitions are done, instead of concurrently
+    * from the partitions.
+    */
+    PLStateMachinePoolStepOrderedCallbacks = 1 << 1
+};
+
+/**
+* Pool callback type.
+*/
+typedef void (^PLStateMachinePoolChangeBlock)(PLStateMachinePool *pool, PLStateMachinePoolHandle handle);
+
+/**
+* PLStateMachinePool stores a large number of instances of one frozen definition in columns: the current state, the
+* previous state, the id of the last trigger and the time the state was entered, each in its own array indexed by the
+* instance handle. State columns hold state indexes narrowed to 8 or 16 bits when the definition is small enough, so
+* a pooled instance costs a few bytes instead of an object, and bulk operations are plain scans over these arrays.
+*
+* Triggers are identified by their ids only, and are applied synchronously on the calling thread. A pool is not
+* thread safe. Resolvers consulted on behalf of a pooled instance receive nil as the machine.
+*/
+@interface PLStateMachinePool : NSObject
+
+/**
+* The definition all instances in this pool run
+*/
+@property(nonatomic, strong, readonly) PLStateMachineDefinition *definition;
+
+/**
+* Number of live instances
+*/
+@property(nonatomic, assign, readonly) NSUInteger count;
+
+/**
+* Width of a state column entry, in bytes
+*/
+@property(nonatomic, assign, readonly) NSUInteger stateSize;
+
+/**
+* The clock the instances' state entries are stamped with
+*/
+@property(nonatomic, strong, readonly) PLStateMachineClock *clock;
+
+/**
+* Initializes the pool.
+*
+* @param definition a frozen definition
+* @param capacity the number of instances to reserve memory for, the pool grows as needed
+*/
+- (id)initWithDefinition:(PLStateMachineDefinition *)definition capacity:(NSUInteger)capacity;
+
+/**
+* Initializes the pool, stamping state entries with a clock.
+*
+* @param definition a frozen definition
+* @param capacity the number of instances to reserve memory for, the pool grows as needed
+* @param clock the clock to read time from. If nil is provided, the system clock is used.
+*/
+- (id)initWithDefinition:(PLStateMachineDefinition *)definition capacity:(NSUInteger)capacity clock:(PLStateMachineClock *)clock;
+
+/**
+* Adds an instance and starts it.
+*
+* @param stateId the id of the state the instance should start in
+* @return the handle of the new instance
+*/
+- (PLStateMachinePoolHandle)addInstanceWithState:(PLStateMachineStateId)stateId;
+
+/**
+* Removes an instance, its handle may be returned by a later addInstanceWithState:.
+*/
+- (void)removeInstance:(PLStateMachinePoolHandle)handle;
+
+- (BOOL)containsInstance:(PLStateMachinePoolHandle)handle;
+
+- (PLStateMachineStateId)stateOfInstance:(PLStateMachinePoolHandle)handle;
+
+- (PLStateMachineStateId)prevStateOfInstance:(PLStateMachinePoolHandle)handle;
+
+/**
+* @return the id of the trigger that caused the transition to the current state, NSUIntegerMax after start
+*/
+- (PLStateMachineTriggerId)lastTriggerIdOfInstance:(PLStateMachinePoolHandle)handle;
+
+/**
+* @return the clock time the current state was entered at, in seconds
+*/
+- (NSTimeInterval)enteredAtOfInstance:(PLStateMachinePoolHandle)handle;
+
+/**
+* Resolves and applies a trigger on a single instance.
+*
+* @return YES if the trigger caused a transition
+*/
+- (BOOL)emitTriggerId:(PLStateMachineTriggerId)triggerId toInstance:(PLStateMachinePoolHandle)handle;
+
+/**
+* Applies one trigger to every instance in the pool.
+*
+* The whole state column is stepped first, then the callbacks are called only for the instances that changed, in
+* handle order. When the definition has at most 16 states and all the cells for this trigger are compiled, the step
+* is a vectorized table lookup over the state column.
+*
+* @param triggerId the id of the trigger to apply
+* @param changedHandles if not NULL, receives the handles (PLStateMachinePoolHandle) of the changed instances, in handle order
+* @return the number of instances that changed
+*/
+- (NSUInteger)emitTriggerIdToAllInstances:(PLStateMachineTriggerId)triggerId changedHandles:(NSData **)changedHandles;
+
+/**
+* Applies one trigger to every instance in the pool, see emitTriggerIdToAllInstances:changedHandles:.
+*
+* @param options how to split the work and call the callbacks. The changed handles are always in handle order
+*/
+- (NSUInteger)emitTriggerIdToAllInstances:(PLStateMachineTriggerId)triggerId options:(PLStateMachinePoolStepOptions)options changedHandles:(NSData **)changedHandles;
+
+/**
+* Counts the instances in a state with a single scan of the state column.
+*/
+- (NSUInteger)countInstancesInState:(PLStateMachineStateId)stateId;
+
+/**
+* Calls the block for every instance in a state, in handle order.
+*/
+- (void)enumerateInstancesInState:(PLStateMachineStateId)stateId usingBlock:(void (^)(PLStateMachinePoolHandle handle))block;
+
+/**
+* Registers a transition callback between any two states.
+*/
+- (void)onTransitionCall:(PLStateMachinePoolChangeBlock)block;
+
+/**
+* Registers a transition callback for leaving a state.
+*/
+- (void)onLeaving:(PLStateMachineStateId)stateId call:(PLStateMachinePoolChangeBlock)block;
+
+/**
+* Registers a transition callback for entering a state.
+*/
+- (void)onEntering:(PLStateMachineStateId)stateId call:(PLStateMachinePoolChangeBlock)block;
+
+/**
+* Registers a transition callback between two defined states.
+*/
+- (void)onLeaving:(PLStateMachineStateId)prevStateId entering:(PLStateMachineStateId)newStateId call:(PLStateMachinePoolChangeBlock)block;
+
+@end
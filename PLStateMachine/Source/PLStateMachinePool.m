@@ -0,0 +1,559 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+
+#import "PLStateMachinePool.h"
+#import "PLStateMachineDefinition.h"
+#import "PLStateMachineDefinition+Internals.h"
+#import "PLStateMachineStateNode.h"
+#import "PLStateMachineCompiledTable.h"
+#import "PLStateMachineTransitionMap.h"
+#import "PLStateMachineClock.h"
+#import "PLStateMachineClock+Internals.h"
+#import "PLStateMachineBulkStep.h"
+#import "PLStateMachineTrace.h"
+#import "PLStateMachineTraceRing.h"
+
+static NSUInteger const kPoolMinimalCapacity = 64;
+//smaller partitions cost more in dispatching than they save
+static NSUInteger const kPoolMinimalPartitionLength = 16384;
+//partitions start on a cache line of the change list
+static NSUInteger const kPoolPartitionAlignment = 64;
+
+//one cache line per partition, workers never write to the same line
+typedef struct PLStateMachinePoolPartition {
+    NSUInteger changedCount;
+    char padding[64 - sizeof(NSUInteger)];
+} PLStateMachinePoolPartition;
+
+static inline uint32_t PLStateMachinePoolColumnGet(const void *column, NSUInteger width, NSUInteger handle) {
+    switch (width) {
+        case sizeof(uint8_t):
+            return ((const uint8_t *) column)[handle];
+        case sizeof(uint16_t):
+            return ((const uint16_t *) column)[handle];
+        default:
+            return ((const uint32_t *) column)[handle];
+    }
+}
+
+static inline void PLStateMachinePoolColumnSet(void *column, NSUInteger width, NSUInteger handle, uint32_t value) {
+    switch (width) {
+        case sizeof(uint8_t):
+            ((uint8_t *) column)[handle] = (uint8_t) value;
+            break;
+        case sizeof(uint16_t):
+            ((uint16_t *) column)[handle] = (uint16_t) value;
+            break;
+        default:
+            ((uint32_t *) column)[handle] = value;
+            break;
+    }
+}
+
+@interface PLStateMachinePool ()
+
+- (void)growToCapacity:(NSUInteger)capacity;
+
+- (void)validateHandle:(PLStateMachinePoolHandle)handle;
+
+- (uint32_t)indexOfState:(PLStateMachineStateId)stateId;
+
+- (PLStateMachineStateId)stateIdAtIndex:(uint32_t)stateIndex;
+
+- (void)moveInstance:(PLStateMachinePoolHandle)handle toIndex:(uint32_t)stateIndex triggerId:(PLStateMachineTriggerId)triggerId;
+
+- (void)notifyTransitionOfInstance:(PLStateMachinePoolHandle)handle;
+
+- (BOOL)prepareBulkStepTables:(PLStateMachineBulkStepTables *)tables triggerId:(PLStateMachineTriggerId)triggerId;
+
+- (BOOL)hasDynamicCellsForTriggerId:(PLStateMachineTriggerId)triggerId;
+
+- (NSUInteger)stepRange:(NSRange)range triggerId:(PLStateMachineTriggerId)triggerId tables:(const PLStateMachineBulkStepTables *)tables changed:(PLStateMachinePoolHandle *)changed;
+
+- (void)recordStepOf:(const PLStateMachinePoolHandle *)changed count:(NSUInteger)changedCount triggerId:(PLStateMachineTriggerId)triggerId at:(NSTimeInterval)time;
+
+@end
+
+@implementation PLStateMachinePool {
+@private
+    PLStateMachineCompiledTable *_compiledTable;
+    //marks both free slots and the missing previous state of a fresh instance
+    uint32_t _noneIndex;
+
+    NSUInteger _capacity;
+    NSUInteger _slotCount;
+    void *_states;
+    void *_prevStates;
+    PLStateMachineTriggerId *_lastTriggerIds;
+    NSTimeInterval *_enteredAt;
+
+    PLStateMachinePoolHandle *_freeHandles;
+    NSUInteger _freeCount;
+
+    PLStateMachineTransitionMap *_listeners;
+    PLStateMachineTimerScheduler *_timerScheduler;
+    //NULL when built without tracing
+    PLStateMachineTraceRing *_traceRing;
+}
+
+@synthesize definition = _definition;
+@synthesize count = _count;
+@synthesize stateSize = _stateSize;
+@synthesize clock = _clock;
+
+- (id)initWithDefinition:(PLStateMachineDefinition *)definition capacity:(NSUInteger)capacity {
+    self = [self initWithDefinition:definition capacity:capacity clock:nil];
+    return self;
+}
+
+- (id)initWithDefinition:(PLStateMachineDefinition *)definition capacity:(NSUInteger)capacity clock:(PLStateMachineClock *)clock {
+    if (!definition.isFrozen) {
+        @throw [NSException exceptionWithName:@"InvalidArgumentException" reason:@"pools can only be created from a frozen definition" userInfo:nil];
+    }
+
+    self = [super init];
+    if (self) {
+        _definition = definition;
+        _compiledTable = [definition compiledTable];
+        //the compiled matrix already picked the narrowest type able to hold a state index
+        _stateSize = PLStateMachineCompiledTableCellSize(_compiledTable);
+        _noneIndex = PLStateMachineCompiledTableNoneCell(_compiledTable);
+        _listeners = PLStateMachineTransitionMapCreate();
+        _clock = clock != nil ? clock : [PLStateMachineClock systemClock];
+        _timerScheduler = _clock.timerScheduler;
+        _traceRing = PLStateMachineTraceRingCreate(PLSTATE_MACHINE_TRACE_CAPACITY, (__bridge const void *) self, 1);
+
+        [self growToCapacity:MAX(capacity, kPoolMinimalCapacity)];
+    }
+
+    return self;
+}
+
+- (void)dealloc {
+    free(_states);
+    free(_prevStates);
+    free(_lastTriggerIds);
+    free(_enteredAt);
+    free(_freeHandles);
+    PLStateMachineTransitionMapFree(_listeners);
+    if (_traceRing != NULL) {
+        PLStateMachineTraceRingFree(_traceRing);
+    }
+}
+
+- (void)growToCapacity:(NSUInteger)capacity {
+    _states = realloc(_states, capacity * _stateSize);
+    _prevStates = realloc(_prevStates, capacity * _stateSize);
+    _lastTriggerIds = realloc(_lastTriggerIds, capacity * sizeof(PLStateMachineTriggerId));
+    _enteredAt = realloc(_enteredAt, capacity * sizeof(NSTimeInterval));
+    _freeHandles = realloc(_freeHandles, capacity * sizeof(PLStateMachinePoolHandle));
+    _capacity = capacity;
+}
+
+- (PLStateMachinePoolHandle)addInstanceWithState:(PLStateMachineStateId)stateId {
+    uint32_t stateIndex = [self indexOfState:stateId];
+
+    PLStateMachinePoolHandle handle;
+    if (_freeCount > 0) {
+        handle = _freeHandles[--_freeCount];
+    } else {
+        if (_slotCount == PLStateMachinePoolHandleInvalid) {
+            @throw [NSException exceptionWithName:@"InvalidStateException" reason:@"the pool is full" userInfo:nil];
+        }
+        if (_slotCount == _capacity) {
+            [self growToCapacity:MIN(_capacity * 2, (NSUInteger) PLStateMachinePoolHandleInvalid)];
+        }
+        handle = (PLStateMachinePoolHandle) _slotCount++;
+    }
+    ++_count;
+
+    PLStateMachinePoolColumnSet(_states, _stateSize, handle, _noneIndex);
+    [self moveInstance:handle toIndex:stateIndex triggerId:NSUIntegerMax];
+    return handle;
+}
+
+- (void)removeInstance:(PLStateMachinePoolHandle)handle {
+    [self validateHandle:handle];
+
+    PLStateMachinePoolColumnSet(_states, _stateSize, handle, _noneIndex);
+    _freeHandles[_freeCount++] = handle;
+    --_count;
+}
+
+- (BOOL)containsInstance:(PLStateMachinePoolHandle)handle {
+    return handle < _slotCount && PLStateMachinePoolColumnGet(_states, _stateSize, handle) != _noneIndex;
+}
+
+- (PLStateMachineStateId)stateOfInstance:(PLStateMachinePoolHandle)handle {
+    [self validateHandle:handle];
+    return [self stateIdAtIndex:PLStateMachinePoolColumnGet(_states, _stateSize, handle)];
+}
+
+- (PLStateMachineStateId)prevStateOfInstance:(PLStateMachinePoolHandle)handle {
+    [self validateHandle:handle];
+    return [self stateIdAtIndex:PLStateMachinePoolColumnGet(_prevStates, _stateSize, handle)];
+}
+
+- (PLStateMachineTriggerId)lastTriggerIdOfInstance:(PLStateMachinePoolHandle)handle {
+    [self validateHandle:handle];
+    return _lastTriggerIds[handle];
+}
+
+- (NSTimeInterval)enteredAtOfInstance:(PLStateMachinePoolHandle)handle {
+    [self validateHandle:handle];
+    return _enteredAt[handle];
+}
+
+- (BOOL)emitTriggerId:(PLStateMachineTriggerId)triggerId toInstance:(PLStateMachinePoolHandle)handle {
+    [self validateHandle:handle];
+
+    uint32_t stateIndex = PLStateMachinePoolColumnGet(_states, _stateSize, handle);
+    BOOL dynamic = NO;
+    PLStateMachineStateId nextState = PLStateMachineCompiledTableResolve(_compiledTable, stateIndex, triggerId, &dynamic);
+    if (dynamic) {
+        nextState = [_definition resolveTrigger:[PLStateMachineTrigger triggerWithId:triggerId] inState:[self stateIdAtIndex:stateIndex] machine:nil];
+    }
+    if (nextState == PLStateMachineStateUndefined) {
+        if (_traceRing != NULL) {
+            PLStateMachineTraceRingWrite(_traceRing, PLStateMachineTimerSchedulerNow(_timerScheduler), [self stateIdAtIndex:stateIndex], PLStateMachineStateUndefined, triggerId, handle, PLStateMachineTraceOutcomeUnresolved);
+        }
+        return NO;
+    }
+
+    [self moveInstance:handle toIndex:[self indexOfState:nextState] triggerId:triggerId];
+    return YES;
+}
+
+- (NSUInteger)emitTriggerIdToAllInstances:(PLStateMachineTriggerId)triggerId changedHandles:(NSData **)changedHandles {
+    return [self emitTriggerIdToAllInstances:triggerId options:0 changedHandles:changedHandles];
+}
+
+- (NSUInteger)emitTriggerIdToAllInstances:(PLStateMachineTriggerId)triggerId options:(PLStateMachinePoolStepOptions)options changedHandles:(NSData **)changedHandles {
+    PLStateMachineBulkStepTables tables;
+    const PLStateMachineBulkStepTables *stepTables = [self prepareBulkStepTables:&tables triggerId:triggerId] ? &tables : NULL;
+    NSTimeInterval now = PLStateMachineTimerSchedulerNow(_timerScheduler);
+    NSUInteger slotCount = _slotCount;
+
+    NSUInteger partitionCount = 1;
+    if ((options & PLStateMachinePoolStepConcurrently) && ![self hasDynamicCellsForTriggerId:triggerId]) {
+        NSUInteger processorCount = [[NSProcessInfo processInfo] activeProcessorCount];
+        partitionCount = MAX(1, MIN(processorCount * 4, slotCount / kPoolMinimalPartitionLength));
+    }
+    NSUInteger partitionLength = (slotCount + partitionCount - 1) / partitionCount;
+    partitionLength = MAX(kPoolPartitionAlignment, (partitionLength + kPoolPartitionAlignment - 1) / kPoolPartitionAlignment * kPoolPartitionAlignment);
+    partitionCount = MAX(1, (slotCount + partitionLength - 1) / partitionLength);
+
+    BOOL notify = PLStateMachineTransitionMapCount(_listeners) > 0;
+    BOOL notifyFromPartitions = notify && partitionCount > 1 && !(options & PLStateMachinePoolStepOrderedCallbacks);
+
+    //every partition fills its own aligned stretch of the change list, the stretches are compacted afterwards
+    PLStateMachinePoolHandle *changed = NULL;
+    PLStateMachinePoolPartition *partitions = NULL;
+    posix_memalign((void **) &changed, 64, MAX(slotCount, 1) * sizeof(PLStateMachinePoolHandle));
+    posix_memalign((void **) &partitions, 64, partitionCount * sizeof(PLStateMachinePoolPartition));
+
+    void (^stepPartition)(size_t) = ^(size_t partition) {
+        NSUInteger location = partition * partitionLength;
+        NSRange range = NSMakeRange(location, MIN(partitionLength, slotCount - location));
+        PLStateMachinePoolHandle *partitionChanged = changed + location;
+
+        NSUInteger changedCount = [self stepRange:range triggerId:triggerId tables:stepTables changed:partitionChanged];
+        [self recordStepOf:partitionChanged count:changedCount triggerId:triggerId at:now];
+        if (notifyFromPartitions) {
+            for (NSUInteger i = 0; i < changedCount; ++i) {
+                [self notifyTransitionOfInstance:partitionChanged[i]];
+            }
+        }
+        partitions[partition].changedCount = changedCount;
+    };
+
+    if (partitionCount > 1) {
+        dispatch_apply(partitionCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), stepPartition);
+    } else {
+        stepPartition(0);
+    }
+
+    NSUInteger changedCount = 0;
+    for (NSUInteger partition = 0; partition < partitionCount; ++partition) {
+        memmove(changed + changedCount, changed + partition * partitionLength, partitions[partition].changedCount * sizeof(PLStateMachinePoolHandle));
+        changedCount += partitions[partition].changedCount;
+    }
+    free(partitions);
+
+    if (notify && !notifyFromPartitions) {
+        for (NSUInteger i = 0; i < changedCount; ++i) {
+            [self notifyTransitionOfInstance:changed[i]];
+        }
+    }
+
+    if (changedHandles != NULL) {
+        *changedHandles = [NSData dataWithBytesNoCopy:changed length:changedCount * sizeof(PLStateMachinePoolHandle) freeWhenDone:YES];
+    } else {
+        free(changed);
+    }
+    return changedCount;
+}
+
+- (NSUInteger)countInstancesInState:(PLStateMachineStateId)stateId {
+    PLStateMachineStateNode *node = [_definition nodeForState:stateId];
+    if (node == nil) {
+        return 0;
+    }
+
+    NSUInteger count = 0;
+    NSUInteger stateIndex = node.index;
+    switch (_stateSize) {
+        case sizeof(uint8_t): {
+            const uint8_t *states = _states;
+            for (NSUInteger i = 0; i < _slotCount; ++i) {
+                count += states[i] == stateIndex;
+            }
+            break;
+        }
+        case sizeof(uint16_t): {
+            const uint16_t *states = _states;
+            for (NSUInteger i = 0; i < _slotCount; ++i) {
+                count += states[i] == stateIndex;
+            }
+            break;
+        }
+        default: {
+            const uint32_t *states = _states;
+            for (NSUInteger i = 0; i < _slotCount; ++i) {
+                count += states[i] == stateIndex;
+            }
+            break;
+        }
+    }
+    return count;
+}
+
+- (void)enumerateInstancesInState:(PLStateMachineStateId)stateId usingBlock:(void (^)(PLStateMachinePoolHandle handle))block {
+    PLStateMachineStateNode *node = [_definition nodeForState:stateId];
+    if (node == nil) {
+        return;
+    }
+
+    uint32_t stateIndex = (uint32_t) node.index;
+    for (NSUInteger i = 0; i < _slotCount; ++i) {
+        if (PLStateMachinePoolColumnGet(_states, _stateSize, i) == stateIndex) {
+            block((PLStateMachinePoolHandle) i);
+        }
+    }
+}
+
+- (void)onTransitionCall:(PLStateMachinePoolChangeBlock)block {
+    [self onLeaving:PLStateMachineStateUndefined entering:PLStateMachineStateUndefined call:block];
+}
+
+- (void)onLeaving:(PLStateMachineStateId)stateId call:(PLStateMachinePoolChangeBlock)block {
+    [self onLeaving:stateId entering:PLStateMachineStateUndefined call:block];
+}
+
+- (void)onEntering:(PLStateMachineStateId)stateId call:(PLStateMachinePoolChangeBlock)block {
+    [self onLeaving:PLStateMachineStateUndefined entering:stateId call:block];
+}
+
+- (void)onLeaving:(PLStateMachineStateId)prevStateId entering:(PLStateMachineStateId)newStateId call:(PLStateMachinePoolChangeBlock)block {
+    if (block == nil) {
+        @throw [NSException exceptionWithName:@"InvalidArgumentException" reason:@"the callback must be non-nil" userInfo:nil];
+    }
+
+    NSMutableArray *listenersForTransition = PLStateMachineTransitionMapGet(_listeners, prevStateId, newStateId);
+    if (listenersForTransition == nil) {
+        listenersForTransition = [NSMutableArray array];
+        PLStateMachineTransitionMapSet(_listeners, prevStateId, newStateId, listenersForTransition);
+    }
+    [listenersForTransition addObject:[block copy]];
+}
+
+- (void)validateHandle:(PLStateMachinePoolHandle)handle {
+    if (![self containsInstance:handle]) {
+        @throw [NSException exceptionWithName:@"InvalidArgumentException" reason:@"unknown instance handle" userInfo:nil];
+    }
+}
+
+- (uint32_t)indexOfState:(PLStateMachineStateId)stateId {
+    if (stateId == PLStateMachineStateUndefined) {
+        @throw [NSException exceptionWithName:@"InvalidArgumentException" reason:@"you canot enter the undefined state" userInfo:nil];
+    }
+
+    PLStateMachineStateNode *node = [_definition nodeForState:stateId];
+    if (node == nil) {
+        @throw [NSException exceptionWithName:@"InvalidArgumentException" reason:@"you canot enter a state that was not registered" userInfo:nil];
+    }
+    return (uint32_t) node.index;
+}
+
+- (PLStateMachineStateId)stateIdAtIndex:(uint32_t)stateIndex {
+    return stateIndex != _noneIndex ? PLStateMachineCompiledTableStateIdAtIndex(_compiledTable, stateIndex) : PLStateMachineStateUndefined;
+}
+
+- (void)moveInstance:(PLStateMachinePoolHandle)handle toIndex:(uint32_t)stateIndex triggerId:(PLStateMachineTriggerId)triggerId {
+    PLStateMachinePoolColumnSet(_prevStates, _stateSize, handle, PLStateMachinePoolColumnGet(_states, _stateSize, handle));
+    PLStateMachinePoolColumnSet(_states, _stateSize, handle, stateIndex);
+    _lastTriggerIds[handle] = triggerId;
+    _enteredAt[handle] = PLStateMachineTimerSchedulerNow(_timerScheduler);
+    if (_traceRing != NULL) {
+        PLStateMachineTraceOutcome outcome = triggerId != NSUIntegerMax ? PLStateMachineTraceOutcomeTransitioned : PLStateMachineTraceOutcomeStarted;
+        PLStateMachineTraceRingWrite(_traceRing, _enteredAt[handle], [self stateIdAtIndex:PLStateMachinePoolColumnGet(_prevStates, _stateSize, handle)], [self stateIdAtIndex:stateIndex], triggerId, handle, outcome);
+    }
+
+    [self notifyTransitionOfInstance:handle];
+}
+
+- (BOOL)prepareBulkStepTables:(PLStateMachineBulkStepTables *)tables triggerId:(PLStateMachineTriggerId)triggerId {
+    NSUInteger stateCount = PLStateMachineCompiledTableStateCount(_compiledTable);
+    if (_stateSize != sizeof(uint8_t) || stateCount > kBulkStepVectorStateLimit) {
+        return NO;
+    }
+
+    memset(tables, 0, sizeof(PLStateMachineBulkStepTables));
+    uint32_t noneCell = PLStateMachineCompiledTableNoneCell(_compiledTable);
+    uint32_t dynamicCell = PLStateMachineCompiledTableDynamicCell(_compiledTable);
+    for (NSUInteger i = 0; i < stateCount; ++i) {
+        uint32_t cell = PLStateMachineCompiledTableTargetIndex(_compiledTable, i, triggerId);
+        if (cell == dynamicCell) {
+            //resolvers can't be vectorized
+            return NO;
+        }
+        if (cell != noneCell) {
+            tables->targets[i] = (uint8_t) cell;
+            tables->fires[i] = 0xFF;
+        }
+    }
+    return YES;
+}
+
+- (BOOL)hasDynamicCellsForTriggerId:(PLStateMachineTriggerId)triggerId {
+    uint32_t dynamicCell = PLStateMachineCompiledTableDynamicCell(_compiledTable);
+    NSUInteger stateCount = PLStateMachineCompiledTableStateCount(_compiledTable);
+    for (NSUInteger i = 0; i < stateCount; ++i) {
+        if (PLStateMachineCompiledTableTargetIndex(_compiledTable, i, triggerId) == dynamicCell) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+- (NSUInteger)stepRange:(NSRange)range triggerId:(PLStateMachineTriggerId)triggerId tables:(const PLStateMachineBulkStepTables *)tables changed:(PLStateMachinePoolHandle *)changed {
+    if (tables != NULL) {
+        return PLStateMachineBulkStep8((uint8_t *) _states + range.location, (uint8_t *) _prevStates + range.location, range.length, tables, (PLStateMachinePoolHandle) range.location, changed);
+    }
+
+    NSUInteger changedCount = 0;
+    uint32_t dynamicCell = PLStateMachineCompiledTableDynamicCell(_compiledTable);
+    for (NSUInteger handle = range.location; handle < NSMaxRange(range); ++handle) {
+        uint32_t stateIndex = PLStateMachinePoolColumnGet(_states, _stateSize, handle);
+        if (stateIndex == _noneIndex) {
+            continue;
+        }
+
+        uint32_t target = PLStateMachineCompiledTableTargetIndex(_compiledTable, stateIndex, triggerId);
+        if (target == dynamicCell) {
+            PLStateMachineStateId nextState = [_definition resolveTrigger:[PLStateMachineTrigger triggerWithId:triggerId] inState:[self stateIdAtIndex:stateIndex] machine:nil];
+            target = nextState != PLStateMachineStateUndefined ? [self indexOfState:nextState] : _noneIndex;
+        }
+        if (target == _noneIndex) {
+            continue;
+        }
+
+        PLStateMachinePoolColumnSet(_prevStates, _stateSize, handle, stateIndex);
+        PLStateMachinePoolColumnSet(_states, _stateSize, handle, target);
+        changed[changedCount++] = (PLStateMachinePoolHandle) handle;
+    }
+    return changedCount;
+}
+
+- (void)recordStepOf:(const PLStateMachinePoolHandle *)changed count:(NSUInteger)changedCount triggerId:(PLStateMachineTriggerId)triggerId at:(NSTimeInterval)time {
+    for (NSUInteger i = 0; i < changedCount; ++i) {
+        _lastTriggerIds[changed[i]] = triggerId;
+        _enteredAt[changed[i]] = time;
+    }
+
+    //older changes would be overwritten by the newer ones of the same step anyway
+    if (_traceRing != NULL && changedCount > 0) {
+        NSUInteger tracedCount = MIN(changedCount, PLStateMachineTraceRingCapacity(_traceRing));
+        uint64_t index = PLStateMachineTraceRingReserve(_traceRing, tracedCount);
+        for (NSUInteger i = changedCount - tracedCount; i < changedCount; ++i) {
+            PLStateMachinePoolHandle handle = changed[i];
+            PLStateMachineStateId prevState = [self stateIdAtIndex:PLStateMachinePoolColumnGet(_prevStates, _stateSize, handle)];
+            PLStateMachineStateId state = [self stateIdAtIndex:PLStateMachinePoolColumnGet(_states, _stateSize, handle)];
+            PLStateMachineTraceRingWriteAt(_traceRing, index++, time, prevState, state, triggerId, handle, PLStateMachineTraceOutcomeTransitioned);
+        }
+    }
+}
+
+- (NSUInteger)copyTrace:(PLStateMachineTraceRecord *)records maxCount:(NSUInteger)maxCount {
+    return _traceRing != NULL ? PLStateMachineTraceRingCopy(_traceRing, records, maxCount) : 0;
+}
+
+- (NSString *)traceDescription {
+    return _traceRing != NULL ? PLStateMachineTraceRingDescription(_traceRing, _definition) : @"";
+}
+
+- (void)notifyTransitionOfInstance:(PLStateMachinePoolHandle)handle {
+    if (PLStateMachineTransitionMapCount(_listeners) == 0) {
+        return;
+    }
+
+    //leaving, between, entering and then the catch-all callbacks
+    PLStateMachineStateId prevState = [self stateIdAtIndex:PLStateMachinePoolColumnGet(_prevStates, _stateSize, handle)];
+    PLStateMachineStateId newState = [self stateIdAtIndex:PLStateMachinePoolColumnGet(_states, _stateSize, handle)];
+    PLStateMachineStateId const leaving[] = {prevState, prevState, PLStateMachineStateUndefined, PLStateMachineStateUndefined};
+    PLStateMachineStateId const entering[] = {PLStateMachineStateUndefined, newState, newState, PLStateMachineStateUndefined};
+    NSUInteger first = prevState != PLStateMachineStateUndefined ? 0 : 2;
+
+    for (NSUInteger i = first; i < 4; ++i) {
+        for (PLStateMachinePoolChangeBlock block in PLStateMachineTransitionMapGet(_listeners, leaving[i], entering[i])) {
+            block(self, handle);
+        }
+    }
+}
+
+@end
@@ -0,0 +1,189 @@
+/*
+ Copyright (c) 2012, Antoni Kędracki, Polidea
+ All rights reserved.
+
+ mailto: akedracki@gmail.com
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Polidea nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY ANTONI KĘDRACKI, POLIDEA ''AS IS'' AND ANY
+ EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL ANTONI KĘDRACKI, POLIDEA BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ Rev 4.0 (Feb 2014):
+ The FSM uses an internal GCD queue for transition and callback delivery.
+
+ Rev 3.0 (Oct 2012):
+ Major rewrite:
+ States now use resolvers instead of transition maps.
+
+ Rev 2.0 (Aug 2012):
+ Trigger based:
+ Instead of setting the next state explicitly, a trigger in pair with a transition map is used.
+ Triggers can be emitted with a optional object(holding some parameters). Execution is handled on a FIFO basis.
+
+ Rev 1.0 (May 2012):
+ Direct state based:
+ A state change is performed by directly setting the state property. Such a machine is mainly useful for tracking
+ handling transitions between states.
+
+ */
+
+#import <Foundation/Foundation.h>
+#import "PLStateMachine.h"
+#import "PLStateMachinePool.h"
+
+/**
+* The number of transitions each machine and pool keeps in its trace ring, rounded up to a power of two. Define it as
+* 0 to build without tracing.
+*/
+#ifndef PLSTATE_MACHINE_TRACE_CAPACITY
+#define PLSTATE_MACHINE_TRACE_CAPACITY 64
+#endif
+
+/**
+* What became of a traced trigger.
+*/
+typedef NS_ENUM(uint32_t, PLStateMachineTraceOutcome) {
+    /**
+    * The machine or instance was started, there is no trigger
+    */
+    PLStateMachineTraceOutcomeStarted,
+    /**
+    * The resolver picked a state and the machine entered it
+    */
+    PLStateMachineTraceOutcomeTransitioned,
+    /**
+    * The resolver picked no state, the trigger was ignored
+    */
+    PLStateMachineTraceOutcomeUnresolved,
+    /**
+    * The trigger was scoped to a state the machine left before processing it, e.g. a timeout that went stale
+    */
+    PLStateMachineTraceOutcomeDropped
+};
+
+/**
+* One traced trigger.
+*/
+typedef struct PLStateMachineTraceRecord {
+    /**
+    * The clock time the trigger was processed at
+    */
+    NSTimeInterval timestamp;
+    /**
+    * The state the trigger was resolved in, PLStateMachineStateUndefined for a start
+    */
+    PLStateMachineStateId prevState;
+    /**
+    * The state entered, PLStateMachineStateUndefined if the trigger didn't cause a transition
+    */
+    PLStateMachineStateId state;
+    /**
+    * The trigger's id, NSUIntegerMax for a start or a stale timeout
+    */
+    PLStateMachineTriggerId triggerId;
+    /**
+    * The handle of the pool instance, 0 for machines
+    */
+    uint32_t instance;
+    PLStateMachineTraceOutcome outcome;
+} PLStateMachineTraceRecord;
+
+/**
+* A trace record as written to a dump. Ids are stored in 32 bits, UINT32_MAX stands for NSUIntegerMax.
+*
+* A dump starts with a PLStateMachineTraceDumpHeader, followed by one PLStateMachineTraceDumpRing header and its records
+* per ring, oldest first. Records that were being written or overwritten while dumped have a 0 sequence.
+*/
+typedef struct PLStateMachineTracePackedRecord {
+    double timestamp;
+    //the record's position in the ring plus one, 0 while it is being written
+    uint32_t sequence;
+    uint32_t prevState;
+    uint32_t state;
+    uint32_t triggerId;
+    uint32_t instance;
+    uint32_t outcome;
+} PLStateMachineTracePackedRecord;
+
+typedef struct PLStateMachineTraceDumpHeader {
+    //'PLTR'
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t ringCount;
+} PLStateMachineTraceDumpHeader;
+
+typedef struct PLStateMachineTraceDumpRing {
+    //the address of the machine or pool
+    uint64_t owner;
+    uint32_t recordCount;
+    //0 for machines, 1 for pools
+    uint32_t ownerKind;
+} PLStateMachineTraceDumpRing;
+
+/**
+* Writes the trace rings of all live machines and pools to a file descriptor.
+*
+* Only reads memory and calls write, so it can be called from a crash handler, e.g. a signal handler. Records being
+* written at the time are kept with a 0 sequence.
+*
+* @param fd the file descriptor to write to
+* @return NO if a ring was being created or destroyed at the time, or writing failed
+*/
+BOOL PLStateMachineTraceWriteAll(int fd);
+
+@interface PLStateMachine (Trace)
+
+/**
+* Copies the traced triggers, oldest first. The ring keeps the last PLSTATE_MACHINE_TRACE_CAPACITY ones, tracing
+* doesn't stop while copying.
+*
+* @param records the buffer to copy to
+* @param maxCount the capacity of the buffer, the newest records are copied if it's too small
+* @return the number of records copied
+*/
+- (NSUInteger)copyTrace:(PLStateMachineTraceRecord *)records maxCount:(NSUInteger)maxCount;
+
+/**
+* @return the traced triggers, oldest first, one per line, with state names
+*/
+- (NSString *)traceDescription;
+
+@end
+
+@interface PLStateMachinePool (Trace)
+
+/**
+* Copies the traced triggers of all instances, oldest first. Instances stepped concurrently trace in no particular
+* order between each other.
+*
+* @param records the buffer to copy to
+* @param maxCount the capacity of the buffer, the newest records are copied if it's too small
+* @return the number of records copied
+*/
+- (NSUInteger)copyTrace:(PLStateMachineTraceRecord *)records maxCount:(NSUInteger)maxCount;
+
+/**
+* @return the traced triggers of all instances, oldest first, one per line, with state names
+*/
+- (NSString *)traceDescription;
+
+@end
@@ -79,6 +79,9 @@ typedef NSUInteger PLStateMachineTriggerId;
 /**
 * Shortcut constructor.
 *
+* Triggers without an attachment are immutable, so PLStateMachineTrigger interns them: the same instance is returned
+* for the same triggerId. Subclasses get a new instance on every call.
+*
 * @param triggerId the identifier for this trigger
 */
 + (PLStateMachineTrigger *)triggerWithId:(PLStateMachineTriggerId)triggerId;
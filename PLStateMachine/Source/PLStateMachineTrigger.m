@@ -45,7 +45,47 @@
 
  */
 
+#import <libkern/OSAtomic.h>
+#import <pthread.h>
 #import "PLStateMachineTrigger.h"
+#import "PLStateMachineTransitionMap.h"
+
+//ids below this limit are interned in a plain array, the rest in a map
+static PLStateMachineTriggerId const kInternedTriggerDenseLimit = 1024;
+
+static void *volatile internedTriggers[kInternedTriggerDenseLimit];
+static PLStateMachineTransitionMap *internedSparseTriggers = NULL;
+static pthread_mutex_t internedSparseTriggersLock = PTHREAD_MUTEX_INITIALIZER;
+
+static PLStateMachineTrigger *PLStateMachineInternedTrigger(PLStateMachineTriggerId triggerId) {
+    if (triggerId < kInternedTriggerDenseLimit) {
+        PLStateMachineTrigger *trigger = (__bridge PLStateMachineTrigger *) internedTriggers[triggerId];
+        if (trigger == nil) {
+            PLStateMachineTrigger *created = [[PLStateMachineTrigger alloc] initWithId:triggerId object:nil];
+            void *retained = (void *) CFBridgingRetain(created);
+            if (OSAtomicCompareAndSwapPtrBarrier(NULL, retained, &internedTriggers[triggerId])) {
+                trigger = created;
+            } else {
+                CFRelease(retained);
+                trigger = (__bridge PLStateMachineTrigger *) internedTriggers[triggerId];
+            }
+        }
+        return trigger;
+    }
+
+    pthread_mutex_lock(&internedSparseTriggersLock);
+    if (internedSparseTriggers == NULL) {
+        internedSparseTriggers = PLStateMachineTransitionMapCreate();
+    }
+    PLStateMachineTrigger *trigger = PLStateMachineTransitionMapGet(internedSparseTriggers, triggerId, 0);
+    if (trigger == nil) {
+        trigger = [[PLStateMachineTrigger alloc] initWithId:triggerId object:nil];
+        PLStateMachineTransitionMapSet(internedSparseTriggers, triggerId, 0, trigger);
+    }
+    pthread_mutex_unlock(&internedSparseTriggersLock);
+
+    return trigger;
+}
 
 
 @implementation PLStateMachineTrigger {
@@ -66,7 +106,11 @@
 }
 
 + (PLStateMachineTrigger *)triggerWithId:(PLStateMachineTriggerId)triggerId {
-    return [[self alloc] initWithId:triggerId object:nil];
+    if (self != [PLStateMachineTrigger class]) {
+        return [[self alloc] initWithId:triggerId object:nil];
+    }
+
+    return PLStateMachineInternedTrigger(triggerId);
 }
 
 + (PLStateMachineTrigger *)triggerWithId:(PLStateMachineTriggerId)triggerId object:(id <NSObject>)object {
@@ -50,6 +50,9 @@
 
 /**
 * Resolver based on a map. TriggerIds are used for keys. Values can be either stateId, or other resolvers.
+*
+* Map resolvers are flattened into the transition matrix by -[PLStateMachine freeze]. Changing the mapping of a resolver
+* used by a frozen machine has no effect on it.
 */
 @interface PLStateMachineMapResolver : NSObject<PLStateMachineResolver>
 
@@ -47,9 +47,10 @@
 
 #import "PLStateMachineMapResolver.h"
 #import "PLStateMachineTrigger.h"
+#import "PLStateMachineCompiledTable.h"
 
 
-@interface PLStateMachineMapResolver ()
+@interface PLStateMachineMapResolver () <PLStateMachineCompilableResolver>
 
 @property(nonatomic, retain, readonly) id <PLStateMachineResolver> parent;
 
@@ -119,6 +120,47 @@
     return nextState;
 }
 
+- (void)collectTriggerIds:(NSMutableIndexSet *)triggerIds {
+    for (NSNumber *key in map) {
+        PLStateMachineTriggerId triggerId = key.unsignedIntegerValue;
+        if (triggerId < NSNotFound) {
+            [triggerIds addIndex:triggerId];
+        }
+
+        NSObject *value = [map objectForKey:key];
+        if (![value isKindOfClass:[NSNumber class]]) {
+            PLStateMachineCollectTriggerIds((id <PLStateMachineResolver>) value, triggerIds);
+        }
+    }
+
+    if (parent != nil) {
+        PLStateMachineCollectTriggerIds(parent, triggerIds);
+    }
+}
+
+- (PLStateMachineStateId)compiledTargetForTriggerId:(PLStateMachineTriggerId)triggerId dynamic:(BOOL *)dynamic {
+    NSObject *value = [map objectForKey:[NSNumber numberWithUnsignedInteger:triggerId]];
+
+    PLStateMachineStateId nextState = PLStateMachineStateUndefined;
+
+    if (value != nil) {
+        if ([value isKindOfClass:[NSNumber class]]) {
+            nextState = [(NSNumber *) value unsignedIntegerValue];
+        } else {
+            nextState = PLStateMachineCompileResolver((id <PLStateMachineResolver>) value, triggerId, dynamic);
+            if (*dynamic) {
+                return PLStateMachineStateUndefined;
+            }
+        }
+    }
+
+    if (nextState == PLStateMachineStateUndefined && parent != nil) {
+        return PLStateMachineCompileResolver(parent, triggerId, dynamic);
+    }
+
+    return nextState;
+}
+
 @end
 
 PLStateMachineMapResolver *mapResolver(NSDictionary *map) {
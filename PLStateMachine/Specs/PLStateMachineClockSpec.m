@@ -0,0 +1,169 @@
+#import <Kiwi/Kiwi.h>
+#import "PLStateMachine.h"
+#import "PLStateMachineClock.h"
+#import "PLStateMachineVirtualClock.h"
+#import "PLStateMachineDefinition.h"
+#import "PLStateMachinePool.h"
+#import "PLStateMachineMapResolver.h"
+#import "PLStateMachineInlineExecutor.h"
+#import "PLStateMachineManualExecutor.h"
+
+SPEC_BEGIN(PLStateMachineClockSpec)
+
+describe(@"PLStateMachineClock", ^{
+    PLStateMachineStateId stateA = 1;
+    PLStateMachineStateId stateB = 2;
+    PLStateMachineTriggerId signalA = 1;
+    PLStateMachineTriggerId signalB = 2;
+    PLStateMachineTriggerId signalC = 3;
+    PLStateMachineTriggerId timeout = 4;
+
+    __block PLStateMachineVirtualClock *clock;
+    __block PLStateMachine *machine;
+
+    beforeEach(^{
+        clock = [[PLStateMachineVirtualClock alloc] initWithTime:100];
+        machine = [[PLStateMachine alloc] initWithDefinition:nil executor:[[PLStateMachineInlineExecutor alloc] init] clock:clock];
+    });
+
+    it(@"should run machines on the system clock by default", ^{
+        PLStateMachine *systemMachine = [[PLStateMachine alloc] init];
+
+        [[systemMachine.clock should] beIdenticalTo:[PLStateMachineClock systemClock]];
+        [[theValue(systemMachine.currentTime) should] beGreaterThan:theValue(0)];
+    });
+
+    it(@"should only move a virtual clock when advanced", ^{
+        [[theValue(clock.now) should] equal:theValue(100)];
+        [[theValue(machine.currentTime) should] equal:theValue(100)];
+
+        [clock advanceBy:2.5];
+        [[theValue(clock.now) should] equal:theValue(102.5)];
+
+        [clock advanceTo:200];
+        [[theValue(machine.currentTime) should] equal:theValue(200)];
+    });
+
+    it(@"should throw an exception if a virtual clock is moved back", ^{
+        [[theBlock(^{
+            [clock advanceTo:99];
+        }) should] raiseWithName:@"InvalidArgumentException"];
+        [[theBlock(^{
+            [clock advanceBy:-1];
+        }) should] raiseWithName:@"InvalidArgumentException"];
+    });
+
+    it(@"should fire a state timeout once the virtual clock reaches it", ^{
+        [machine registerStateWithId:stateA name:@"stateA" resolver:mapResolver(@{@(timeout) : @(stateB)}) timeout:30 trigger:timeout];
+        [machine registerStateWithId:stateB name:@"stateB" resolver:mapResolver(@{})];
+        [machine startWithState:stateA];
+
+        [[theValue([clock advanceBy:29.999]) should] equal:theValue(0)];
+        [[theValue(machine.state) should] equal:theValue(stateA)];
+
+        [[theValue([clock advanceBy:0.001]) should] equal:theValue(1)];
+        [[theValue(machine.state) should] equal:theValue(stateB)];
+        [[theValue(machine.triggeredBy.triggerId) should] equal:theValue(timeout)];
+    });
+
+    it(@"should fast-forward days of timeouts", ^{
+        __block NSUInteger entryCount = 0;
+        [machine registerStateWithId:stateA name:@"stateA" resolver:mapResolver(@{@(timeout) : @(stateB)}) timeout:60 trigger:timeout];
+        [machine registerStateWithId:stateB name:@"stateB" resolver:mapResolver(@{@(timeout) : @(stateA)}) timeout:60 trigger:timeout];
+        [machine onEntering:stateB call:^(PLStateMachine *stateMachine) {
+            ++entryCount;
+        } owner:nil];
+        [machine startWithState:stateA];
+
+        NSUInteger firedCount = [clock advanceBy:7 * 24 * 3600];
+
+        [[theValue(firedCount) should] equal:theValue(7 * 24 * 60)];
+        [[theValue(entryCount) should] equal:theValue(7 * 24 * 60 / 2)];
+        [[theValue(machine.state) should] equal:theValue(stateA)];
+    });
+
+    it(@"should fire scheduled triggers in deadline order, each at its own time", ^{
+        NSMutableArray *triggerIds = [NSMutableArray array];
+        NSMutableArray *times = [NSMutableArray array];
+        [machine registerStateWithId:stateA name:@"stateA" resolver:mapResolver(@{@(signalA) : @(stateA), @(signalB) : @(stateA), @(signalC) : @(stateA)})];
+        [machine onEntering:stateA call:^(PLStateMachine *stateMachine) {
+            [triggerIds addObject:@(stateMachine.triggeredBy.triggerId)];
+            [times addObject:@(stateMachine.currentTime)];
+        } owner:nil];
+        [machine startWithState:stateA];
+        [triggerIds removeAllObjects];
+        [times removeAllObjects];
+
+        [machine emitTrigger:[PLStateMachineTrigger triggerWithId:signalC] afterDelay:3];
+        [machine emitTrigger:[PLStateMachineTrigger triggerWithId:signalA] afterDelay:1];
+        [machine emitTrigger:[PLStateMachineTrigger triggerWithId:signalB] afterDelay:2];
+        [clock advanceBy:10];
+
+        [[triggerIds should] equal:@[@(signalA), @(signalB), @(signalC)]];
+        [[times should] equal:@[@101, @102, @103]];
+    });
+
+    it(@"should let triggers fired by timers into a full machine with the block policy", ^{
+        PLStateMachineManualExecutor *executor = [[PLStateMachineManualExecutor alloc] init];
+        PLStateMachine *boundedMachine = [[PLStateMachine alloc] initWithDefinition:nil executor:executor capacity:1 overflowPolicy:PLStateMachineOverflowPolicyBlock clock:clock];
+        [boundedMachine registerStateWithId:stateA name:@"stateA" resolver:mapResolver(@{@(signalA) : @(stateB)})];
+        [boundedMachine registerStateWithId:stateB name:@"stateB" resolver:mapResolver(@{@(signalB) : @(stateA)})];
+        [boundedMachine startWithState:stateA];
+        [executor drain];
+
+        [boundedMachine emitTriggerId:signalA];
+        [boundedMachine emitTrigger:[PLStateMachineTrigger triggerWithId:signalB] afterDelay:1];
+        [clock advanceBy:1];
+        [executor drain];
+
+        [[theValue(boundedMachine.state) should] equal:theValue(stateA)];
+        [[theValue(boundedMachine.queueStatistics.highWaterMark) should] equal:theValue(2)];
+    });
+
+    it(@"should stamp queued triggers with the clock", ^{
+        PLStateMachine *steppedMachine = [[PLStateMachine alloc] initSteppedWithDefinition:nil clock:clock];
+        [steppedMachine registerStateWithId:stateA name:@"stateA" resolver:mapResolver(@{@(signalA) : @(stateB)})];
+        [steppedMachine registerStateWithId:stateB name:@"stateB" resolver:mapResolver(@{})];
+        [steppedMachine startWithState:stateA];
+        [steppedMachine stepMaxTriggers:NSUIntegerMax];
+
+        [steppedMachine emitTriggerId:signalA];
+        [clock advanceBy:2];
+        [steppedMachine stepMaxTriggers:NSUIntegerMax];
+
+        PLStateMachineLaneStatistics statistics = [steppedMachine statisticsForPriority:PLStateMachineTriggerPriorityNormal];
+        [[theValue(statistics.maxWaitTime) should] equal:theValue(2)];
+    });
+
+    it(@"should stamp pool state entries with the clock", ^{
+        PLStateMachineDefinition *definition = [[PLStateMachineDefinition alloc] init];
+        [definition registerStateWithId:stateA name:@"stateA" resolver:mapResolver(@{@(signalA) : @(stateB)})];
+        [definition registerStateWithId:stateB name:@"stateB" resolver:mapResolver(@{})];
+        [definition freeze];
+        PLStateMachinePool *pool = [[PLStateMachinePool alloc] initWithDefinition:definition capacity:0 clock:clock];
+
+        PLStateMachinePoolHandle handle = [pool addInstanceWithState:stateA];
+        [clock advanceBy:5];
+        [pool emitTriggerId:signalA toInstance:handle];
+
+        [[theValue([pool enteredAtOfInstance:handle]) should] equal:theValue(105)];
+    });
+
+    it(@"should count the timers fired by a virtual clock", ^{
+        [machine registerStateWithId:stateA name:@"stateA" resolver:mapResolver(@{@(signalA) : @(stateA)})];
+        [machine startWithState:stateA];
+        [machine emitTrigger:[PLStateMachineTrigger triggerWithId:signalA] afterDelay:1];
+        [machine emitTrigger:[PLStateMachineTrigger triggerWithId:signalA] afterDelay:1];
+        [machine emitTrigger:[PLStateMachineTrigger triggerWithId:signalA] afterDelay:2];
+
+        [[theValue(clock.timerStatistics.armedTimerCount) should] equal:theValue(3)];
+        [clock advanceBy:5];
+
+        PLStateMachineTimerStatistics statistics = clock.timerStatistics;
+        [[theValue(statistics.armedTimerCount) should] equal:theValue(0)];
+        [[theValue(statistics.firedTimerCount) should] equal:theValue(3)];
+        [[theValue(statistics.wakeupCount) should] equal:theValue(2)];
+    });
+});
+
+SPEC_END
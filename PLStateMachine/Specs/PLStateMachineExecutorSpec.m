@@ -0,0 +1,243 @@
+#import <Kiwi/Kiwi.h>
+#import "PLStateMachine.h"
+#import "PLStateMachineMapResolver.h"
+#import "PLStateMachineQueueExecutor.h"
+#import "PLStateMachineInlineExecutor.h"
+#import "PLStateMachineManualExecutor.h"
+#import "PLStateMachineThreadPoolExecutor.h"
+#import "PLStateMachineWorkStealingExecutor.h"
+
+static void PLExecutorSpecReleaseContext(void *context) {
+    CFRelease(context);
+}
+
+SPEC_BEGIN(PLStateMachineExecutorSpec)
+
+describe(@"PLStateMachineExecutor", ^{
+    PLStateMachineStateId stateA = 1;
+    PLStateMachineStateId stateB = 2;
+    PLStateMachineTriggerId signalA = 1;
+
+    __block PLStateMachine *(^machineOn)(id <PLStateMachineExecutor>);
+
+    beforeEach(^{
+        machineOn = ^PLStateMachine *(id <PLStateMachineExecutor> executor) {
+            PLStateMachine *machine = [[PLStateMachine alloc] initWithDefinition:nil executor:executor];
+            [machine registerStateWithId:stateA name:@"stateA" resolver:mapResolver(@{@(signalA) : @(stateB)})];
+            [machine registerStateWithId:stateB name:@"stateB" resolver:mapResolver(@{@(signalA) : @(stateA)})];
+            return machine;
+        };
+    });
+
+    it(@"should run machines created with a queue on a queue executor", ^{
+        dispatch_queue_t queue = dispatch_queue_create("fsm-executor-spec", DISPATCH_QUEUE_SERIAL);
+        PLStateMachine *machine = [[PLStateMachine alloc] initWithQueue:queue];
+
+        [[(NSObject *) machine.executor should] beKindOfClass:[PLStateMachineQueueExecutor class]];
+        [[theValue(((PLStateMachineQueueExecutor *) machine.executor).queue == queue) should] beYes];
+    });
+
+    it(@"should report the queue executor as current only on its queue", ^{
+        PLStateMachineQueueExecutor *executor = [[PLStateMachineQueueExecutor alloc] initWithQueue:nil];
+        __block BOOL current = NO;
+        dispatch_sync(executor.queue, ^{
+            current = [executor isCurrent];
+        });
+
+        [[theValue(current) should] beYes];
+        [[theValue([executor isCurrent]) should] beNo];
+    });
+
+    it(@"should run the triggers on the caller thread with an inline executor", ^{
+        PLStateMachine *machine = machineOn([[PLStateMachineInlineExecutor alloc] init]);
+        __block NSThread *callbackThread = nil;
+        [machine onEntering:stateB call:^(PLStateMachine *fsm) {
+            callbackThread = [NSThread currentThread];
+        } owner:nil];
+
+        [machine startWithState:stateA];
+        [machine emitTriggerId:signalA];
+
+        [[theValue(machine.state) should] equal:theValue(stateB)];
+        [[callbackThread should] beIdenticalTo:[NSThread currentThread]];
+    });
+
+    it(@"should run triggers emitted from inline callbacks after the current one", ^{
+        PLStateMachine *machine = machineOn([[PLStateMachineInlineExecutor alloc] init]);
+        NSMutableArray *calls = [NSMutableArray array];
+        [machine onEntering:stateB call:^(PLStateMachine *fsm) {
+            [calls addObject:@"enteringB"];
+            [fsm emitTriggerId:signalA];
+            [calls addObject:@"emitted"];
+        } owner:nil];
+        [machine onEntering:stateA call:^(PLStateMachine *fsm) {
+            [calls addObject:@"enteringA"];
+        } owner:nil];
+
+        [machine startWithState:stateA];
+        [calls removeAllObjects];
+        [machine emitTriggerId:signalA];
+
+        [[calls should] equal:@[@"enteringB", @"emitted", @"enteringA"]];
+    });
+
+    it(@"should run nothing before a manual executor is drained", ^{
+        PLStateMachineManualExecutor *executor = [[PLStateMachineManualExecutor alloc] init];
+        PLStateMachine *machine = machineOn(executor);
+
+        [machine startWithState:stateA];
+        [machine emitTriggerId:signalA];
+        [[theValue(machine.state) should] equal:theValue(PLStateMachineStateUndefined)];
+        [[theValue(executor.pendingCount) should] equal:theValue(1)];
+
+        [[theValue([executor drain]) should] equal:theValue(1)];
+        [[theValue(machine.state) should] equal:theValue(stateB)];
+        [[theValue([executor drain]) should] equal:theValue(0)];
+    });
+
+    it(@"should drain a manual executor when waiting", ^{
+        PLStateMachineManualExecutor *executor = [[PLStateMachineManualExecutor alloc] init];
+        PLStateMachine *machine = machineOn(executor);
+
+        [machine startWithState:stateA];
+        [machine emitTriggerId:signalA];
+        [machine wait];
+
+        [[theValue(machine.state) should] equal:theValue(stateB)];
+        [[theValue(executor.pendingCount) should] equal:theValue(0)];
+    });
+
+    it(@"should run the functions still buffered when a manual executor is released", ^{
+        __weak NSObject *weakContext = nil;
+        @autoreleasepool {
+            NSObject *context = [[NSObject alloc] init];
+            weakContext = context;
+            PLStateMachineManualExecutor *executor = [[PLStateMachineManualExecutor alloc] init];
+            [executor executeFunction:PLExecutorSpecReleaseContext context:(__bridge_retained void *) context];
+        }
+
+        [[weakContext should] beNil];
+    });
+
+    void (^expectTriggerOrderKept)(id <PLStateMachineExecutor>) = ^(id <PLStateMachineExecutor> executor) {
+        NSMutableArray *machines = [NSMutableArray array];
+        __weak NSMutableArray *weakMachines = machines;
+        NSMutableArray *statesOfMachines = [NSMutableArray array];
+        for (NSUInteger i = 0; i < 16; ++i) {
+            PLStateMachine *machine = machineOn(executor);
+            NSMutableArray *states = [NSMutableArray array];
+            [machine onTransitionCall:^(PLStateMachine *fsm) {
+                [[theValue([executor isCurrent]) should] beYes];
+                [states addObject:@(fsm.state)];
+                //hops to another machine from a worker
+                if (fsm.state == stateB) {
+                    [weakMachines[(i + 1) % 16] emitTriggerId:signalA + 1];
+                }
+            } owner:nil];
+            [machine startWithState:stateA];
+            [machines addObject:machine];
+            [statesOfMachines addObject:states];
+        }
+
+        dispatch_apply(1000, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+            [machines[i % machines.count] emitTriggerId:signalA];
+        });
+        for (PLStateMachine *machine in machines) {
+            [machine wait];
+        }
+
+        for (NSUInteger machine = 0; machine < statesOfMachines.count; ++machine) {
+            NSArray *states = statesOfMachines[machine];
+            [[theValue(states.count) should] equal:theValue(1 + 1000 / 16 + (machine < 1000 % 16 ? 1 : 0))];
+            for (NSUInteger i = 0; i < states.count; ++i) {
+                [[states[i] should] equal:@(i % 2 == 0 ? stateA : stateB)];
+            }
+        }
+        [[theValue([executor isCurrent]) should] beNo];
+    };
+
+    it(@"should keep the trigger order of every machine on a thread pool executor", ^{
+        expectTriggerOrderKept([[PLStateMachineThreadPoolExecutor alloc] initWithThreadCount:4]);
+    });
+
+    it(@"should keep the trigger order of every machine on a work stealing executor", ^{
+        expectTriggerOrderKept([[PLStateMachineWorkStealingExecutor alloc] initWithThreadCount:4]);
+    });
+
+    void (^expectWaitFromWorker)(id <PLStateMachineExecutor>) = ^(id <PLStateMachineExecutor> executor) {
+        PLStateMachine *first = machineOn(executor);
+        PLStateMachine *second = machineOn(executor);
+        [first startWithState:stateA];
+        [second startWithState:stateA];
+        [first wait];
+        [second wait];
+
+        __weak PLStateMachine *weakSecond = second;
+        __block BOOL waited = NO;
+        [first onEntering:stateB call:^(PLStateMachine *fsm) {
+            //the drain of the second machine is queued on the only worker, the one waiting
+            [weakSecond emitTriggerId:signalA];
+            [weakSecond wait];
+            waited = weakSecond.state == stateB;
+        } owner:nil];
+        [first emitTriggerId:signalA];
+
+        [[expectFutureValue(theValue(waited)) shouldEventually] beYes];
+    };
+
+    it(@"should not deadlock a thread pool worker waiting for another machine from a callback", ^{
+        expectWaitFromWorker([[PLStateMachineThreadPoolExecutor alloc] initWithThreadCount:1]);
+    });
+
+    it(@"should not deadlock a work stealing worker waiting for another machine from a callback", ^{
+        expectWaitFromWorker([[PLStateMachineWorkStealingExecutor alloc] initWithThreadCount:1]);
+    });
+
+    it(@"should not let machines waking each other up starve other work on a work stealing executor", ^{
+        NSUInteger const hopLimit = 20000;
+        PLStateMachineWorkStealingExecutor *executor = [[PLStateMachineWorkStealingExecutor alloc] initWithThreadCount:1];
+        PLStateMachine *ping = machineOn(executor);
+        PLStateMachine *pong = machineOn(executor);
+        PLStateMachine *other = machineOn(executor);
+        for (PLStateMachine *machine in @[ping, pong, other]) {
+            [machine startWithState:stateA];
+            [machine wait];
+        }
+
+        __weak PLStateMachine *weakPong = pong;
+        __weak PLStateMachine *weakPing = ping;
+        __weak PLStateMachine *weakOther = other;
+        __block NSUInteger hopCount = 0;
+        __block NSUInteger hopsBeforeOther = NSUIntegerMax;
+        [ping onTransitionCall:^(PLStateMachine *fsm) {
+            //queued behind the pong that takes the run-next slot
+            if (hopCount == 0) {
+                [weakOther emitTriggerId:signalA];
+            }
+            if (++hopCount < hopLimit) {
+                [weakPong emitTriggerId:signalA];
+            }
+        } owner:nil];
+        [pong onTransitionCall:^(PLStateMachine *fsm) {
+            [weakPing emitTriggerId:signalA];
+        } owner:nil];
+        [other onTransitionCall:^(PLStateMachine *fsm) {
+            hopsBeforeOther = hopCount;
+        } owner:nil];
+        [ping emitTriggerId:signalA];
+
+        [[expectFutureValue(theValue(hopCount)) shouldEventuallyBeforeTimingOutAfter(10)] equal:theValue(hopLimit)];
+        [[theValue(hopsBeforeOther) should] beLessThan:theValue(hopLimit)];
+    });
+
+    it(@"should run machines created without a queue or an executor on a queue of their own", ^{
+        PLStateMachine *machine = [[PLStateMachine alloc] initWithQueue:nil];
+        PLStateMachine *otherMachine = [[PLStateMachine alloc] initWithDefinition:nil executor:nil];
+
+        [[(NSObject *) machine.executor should] beKindOfClass:[PLStateMachineQueueExecutor class]];
+        [[(NSObject *) otherMachine.executor should] beKindOfClass:[PLStateMachineQueueExecutor class]];
+        [[theValue(((PLStateMachineQueueExecutor *) machine.executor).queue == ((PLStateMachineQueueExecutor *) otherMachine.executor).queue) should] beNo];
+    });
+});
+
+SPEC_END
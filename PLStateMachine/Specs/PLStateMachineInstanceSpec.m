@@ -0,0 +1,114 @@
+#import <Kiwi/Kiwi.h>
+#import "PLStateMachineDefinition.h"
+#import "PLStateMachineInstance.h"
+#import "PLStateMachineMapResolver.h"
+#import "PLStateMachineBlockResolver.h"
+
+SPEC_BEGIN(PLStateMachineInstanceSpec)
+
+describe(@"PLStateMachineInstance", ^{
+    PLStateMachineStateId stateA = 1;
+    PLStateMachineStateId stateB = 2;
+    PLStateMachineStateId stateC = 3;
+    PLStateMachineTriggerId signalA = 1;
+    PLStateMachineTriggerId signalB = 2;
+
+    __block PLStateMachineDefinition *definition;
+
+    beforeEach(^{
+        definition = [[PLStateMachineDefinition alloc] init];
+        [definition registerStateWithId:stateA name:@"stateA" resolver:mapResolver(@{@(signalA) : @(stateB)})];
+        [definition registerStateWithId:stateB
+                                   name:@"stateB"
+                               resolver:blockResolver(^(PLStateMachineTrigger *trigger, PLStateMachine *machine) {
+                                   return trigger.triggerId == signalB ? stateC : PLStateMachineStateUndefined;
+                               })];
+        [definition registerStateWithId:stateC name:@"stateC" resolver:mapResolver(@{@(signalA) : @(stateA)})];
+    });
+
+    it(@"should not be created from a definition that is not frozen", ^{
+        [[theBlock(^{
+            (void) [[PLStateMachineInstance alloc] initWithDefinition:definition context:NULL];
+        }) should] raiseWithName:@"InvalidArgumentException"];
+    });
+
+    it(@"should apply triggers synchronously", ^{
+        [definition freeze];
+        int context = 0;
+        PLStateMachineInstance *instance = [[PLStateMachineInstance alloc] initWithDefinition:definition context:&context];
+
+        [instance startWithState:stateA];
+        [[theValue(instance.state) should] equal:theValue(stateA)];
+
+        [[theValue([instance emitTriggerId:signalB]) should] beNo];
+        [[theValue([instance emitTriggerId:signalA]) should] beYes];
+        [[theValue([instance emitTriggerId:signalB]) should] beYes];
+
+        [[theValue(instance.state) should] equal:theValue(stateC)];
+        [[theValue(instance.prevState) should] equal:theValue(stateB)];
+        [[theValue(instance.triggeredBy.triggerId) should] equal:theValue(signalB)];
+        [[theValue(instance.context == &context) should] beYes];
+    });
+
+    it(@"should keep the state of instances sharing a definition apart", ^{
+        [definition freeze];
+        PLStateMachineInstance *first = [[PLStateMachineInstance alloc] initWithDefinition:definition context:NULL];
+        PLStateMachineInstance *second = [[PLStateMachineInstance alloc] initWithDefinition:definition context:NULL];
+
+        [first startWithState:stateA];
+        [second startWithState:stateC];
+        [first emitTriggerId:signalA];
+        [second emitTriggerId:signalA];
+
+        [[theValue(first.state) should] equal:theValue(stateB)];
+        [[theValue(second.state) should] equal:theValue(stateA)];
+    });
+
+    it(@"should call the definition's callbacks in the right order", ^{
+        NSMutableArray *calls = [NSMutableArray array];
+        [definition onTransitionCall:^(PLStateMachineInstance *instance) {
+            [calls addObject:@"transition"];
+        }];
+        [definition onEntering:stateB call:^(PLStateMachineInstance *instance) {
+            [calls addObject:@"entering"];
+        }];
+        [definition onLeaving:stateA entering:stateB call:^(PLStateMachineInstance *instance) {
+            [calls addObject:@"between"];
+        }];
+        [definition onLeaving:stateA call:^(PLStateMachineInstance *instance) {
+            [calls addObject:@"leaving"];
+        }];
+        [definition freeze];
+
+        PLStateMachineInstance *instance = [[PLStateMachineInstance alloc] initWithDefinition:definition context:NULL];
+        [instance startWithState:stateA];
+        [calls removeAllObjects];
+        [instance emitTriggerId:signalA];
+
+        [[calls should] equal:@[@"leaving", @"between", @"entering", @"transition"]];
+    });
+
+    it(@"should not allow registering callbacks after the definition was frozen", ^{
+        [definition freeze];
+
+        [[theBlock(^{
+            [definition onTransitionCall:^(PLStateMachineInstance *instance) {
+            }];
+        }) should] raiseWithName:@"InvalidStateException"];
+    });
+
+    it(@"should share the definition with queue backed machines", ^{
+        [definition freeze];
+        PLStateMachine *machine = [[PLStateMachine alloc] initWithDefinition:definition queue:nil];
+
+        [machine startWithState:stateA];
+        [machine emitTriggerId:signalA];
+        [machine wait];
+
+        [[theValue(machine.state) should] equal:theValue(stateB)];
+        [[machine.definition should] beIdenticalTo:definition];
+        [[theValue(machine.isFrozen) should] beYes];
+    });
+});
+
+SPEC_END
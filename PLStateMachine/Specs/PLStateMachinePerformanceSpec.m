@@ -0,0 +1,524 @@
+#import <Kiwi/Kiwi.h>
+#import <objc/runtime.h>
+#import <libkern/OSAtomic.h>
+#import "PLStateMachine.h"
+#import "PLStateMachineDefinition.h"
+#import "PLStateMachineInstance.h"
+#import "PLStateMachinePool.h"
+#import "PLStateMachineMapResolver.h"
+#import "PLStateMachineTransitionMap.h"
+#import "PLStateMachineTimerScheduler.h"
+#import "PLStateMachineTime.h"
+#import "PLStateMachineQueueExecutor.h"
+#import "PLStateMachineWorkStealingExecutor.h"
+#import "PLStateMachineInlineExecutor.h"
+#import "PLStateMachineVirtualClock.h"
+#import "PLStateMachineTraceRing.h"
+
+//the object key the listener registry used before it was keyed by the state ids directly
+@interface PLPerformanceTransitionKey : NSObject <NSCopying>
+
+@property(nonatomic, assign) PLStateMachineStateId leaving;
+@property(nonatomic, assign) PLStateMachineStateId entering;
+
+@end
+
+@implementation PLPerformanceTransitionKey
+
+@synthesize leaving;
+@synthesize entering;
+
+- (BOOL)isEqual:(id)object {
+    return [object isKindOfClass:[PLPerformanceTransitionKey class]] && [object leaving] == leaving && [object entering] == entering;
+}
+
+- (NSUInteger)hash {
+    return entering * 17 + leaving * 7;
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    PLPerformanceTransitionKey *copy = [[PLPerformanceTransitionKey allocWithZone:zone] init];
+    copy.leaving = leaving;
+    copy.entering = entering;
+    return copy;
+}
+
+@end
+
+static void PLPerformanceTimerFired(void *context, uintptr_t payload) {
+}
+
+static volatile int32_t PLPerformanceFiredTimerCount;
+
+static void PLPerformanceTimerCounted(void *context, uintptr_t payload) {
+    OSAtomicIncrement32Barrier(&PLPerformanceFiredTimerCount);
+}
+
+SPEC_BEGIN(PLStateMachinePerformanceSpec)
+
+describe(@"PLStateMachine performance", ^{
+    PLStateMachineStateId stateA = 1;
+    PLStateMachineStateId stateB = 2;
+    PLStateMachineTriggerId signalA = 1;
+
+    __block PLStateMachine *stateMachine;
+    __block id <PLStateMachineResolver> resolverA;
+    __block id <PLStateMachineResolver> resolverB;
+
+    beforeEach(^{
+        resolverA = mapResolver(@{@(signalA) : @(stateB)});
+        resolverB = mapResolver(@{@(signalA) : @(stateA)});
+
+        stateMachine = [[PLStateMachine alloc] initWithQueue:nil];
+        [stateMachine registerStateWithId:stateA name:@"stateA" resolver:resolverA];
+        [stateMachine registerStateWithId:stateB name:@"stateB" resolver:resolverB];
+        [stateMachine startWithState:stateA];
+        [stateMachine wait];
+    });
+
+    it(@"should report the mailbox throughput against one dispatch_async per trigger", ^{
+        size_t const producerCount = 4;
+        NSUInteger const triggersPerProducer = 50000;
+        NSUInteger const triggerCount = producerCount * triggersPerProducer;
+
+        __block NSUInteger transitionCount = 0;
+        [stateMachine onTransitionCall:^(PLStateMachine *fsm) {
+            ++transitionCount;
+        }
+                                 owner:nil];
+
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        dispatch_apply(producerCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t producer) {
+            for (NSUInteger i = 0; i < triggersPerProducer; ++i) {
+                [stateMachine emitTriggerId:signalA];
+            }
+        });
+        [stateMachine wait];
+        CFAbsoluteTime mailboxTime = CFAbsoluteTimeGetCurrent() - start;
+
+        //the pre-mailbox delivery: every trigger posted to the queue on its own
+        dispatch_queue_t queue = dispatch_queue_create("fsm-baseline", DISPATCH_QUEUE_SERIAL);
+        PLStateMachineTrigger *trigger = [PLStateMachineTrigger triggerWithId:signalA];
+        __block NSUInteger resolvedCount = 0;
+        start = CFAbsoluteTimeGetCurrent();
+        dispatch_apply(producerCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t producer) {
+            for (NSUInteger i = 0; i < triggersPerProducer; ++i) {
+                dispatch_async(queue, ^{
+                    [resolverA resolve:trigger in:stateMachine];
+                    ++resolvedCount;
+                });
+            }
+        });
+        dispatch_sync(queue, ^{
+        });
+        CFAbsoluteTime baselineTime = CFAbsoluteTimeGetCurrent() - start;
+
+        NSLog(@"mailbox: %.0f triggers/s, dispatch_async per trigger: %.0f triggers/s", triggerCount / mailboxTime, triggerCount / baselineTime);
+
+        [[theValue(transitionCount) should] equal:theValue(triggerCount)];
+        [[theValue(resolvedCount) should] equal:theValue(triggerCount)];
+    });
+
+    it(@"should report the batch emission throughput against single emission", ^{
+        NSUInteger const batchSize = 64;
+        NSUInteger const batchCount = 4000;
+        NSUInteger const triggerCount = batchSize * batchCount;
+
+        __block NSUInteger transitionCount = 0;
+        [stateMachine onTransitionCall:^(PLStateMachine *fsm) {
+            ++transitionCount;
+        }
+                                 owner:nil];
+
+        PLStateMachineTriggerId triggerIds[batchSize];
+        for (NSUInteger i = 0; i < batchSize; ++i) {
+            triggerIds[i] = signalA;
+        }
+
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        for (NSUInteger i = 0; i < batchCount; ++i) {
+            [stateMachine emitTriggerIds:triggerIds count:batchSize];
+        }
+        [stateMachine wait];
+        CFAbsoluteTime batchTime = CFAbsoluteTimeGetCurrent() - start;
+
+        start = CFAbsoluteTimeGetCurrent();
+        for (NSUInteger i = 0; i < triggerCount; ++i) {
+            [stateMachine emitTriggerId:signalA];
+        }
+        [stateMachine wait];
+        CFAbsoluteTime singleTime = CFAbsoluteTimeGetCurrent() - start;
+
+        NSLog(@"batches of %lu: %.0f triggers/s, single emission: %.0f triggers/s", (unsigned long) batchSize, triggerCount / batchTime, triggerCount / singleTime);
+
+        [[theValue(transitionCount) should] equal:theValue(2 * triggerCount)];
+    });
+
+    it(@"should report the listener registry lookup cost with thousands of registered transitions", ^{
+        NSUInteger const transitionCount = 4096;
+        NSUInteger const rounds = 50;
+
+        //every state has a between, a leaving and an entering entry, like a densely observed machine
+        PLStateMachineTransitionMap *map = PLStateMachineTransitionMapCreate();
+        NSMutableDictionary *dictionary = [NSMutableDictionary dictionary];
+        for (PLStateMachineStateId i = 0; i < transitionCount; ++i) {
+            PLStateMachineStateId const leaving[] = {i, i, PLStateMachineStateUndefined};
+            PLStateMachineStateId const entering[] = {i + 1, PLStateMachineStateUndefined, i + 1};
+            for (NSUInteger j = 0; j < 3; ++j) {
+                PLStateMachineTransitionMapSet(map, leaving[j], entering[j], @(i));
+
+                PLPerformanceTransitionKey *key = [PLPerformanceTransitionKey new];
+                key.leaving = leaving[j];
+                key.entering = entering[j];
+                [dictionary setObject:@(i) forKey:key];
+            }
+        }
+
+        NSUInteger mapHits = 0;
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        for (NSUInteger round = 0; round < rounds; ++round) {
+            for (PLStateMachineStateId i = 0; i < transitionCount; ++i) {
+                if (PLStateMachineTransitionMapGet(map, i, i + 1) != nil) {
+                    ++mapHits;
+                }
+            }
+        }
+        CFAbsoluteTime mapTime = CFAbsoluteTimeGetCurrent() - start;
+
+        NSUInteger dictionaryHits = 0;
+        start = CFAbsoluteTimeGetCurrent();
+        for (NSUInteger round = 0; round < rounds; ++round) {
+            for (PLStateMachineStateId i = 0; i < transitionCount; ++i) {
+                @autoreleasepool {
+                    PLPerformanceTransitionKey *key = [PLPerformanceTransitionKey new];
+                    key.leaving = i;
+                    key.entering = i + 1;
+                    if ([dictionary objectForKey:key] != nil) {
+                        ++dictionaryHits;
+                    }
+                }
+            }
+        }
+        CFAbsoluteTime dictionaryTime = CFAbsoluteTimeGetCurrent() - start;
+
+        PLStateMachineTransitionMapFree(map);
+
+        NSUInteger const lookupCount = transitionCount * rounds;
+        NSLog(@"registry lookup: %.1f ns, signature object lookup: %.1f ns", mapTime * 1e9 / lookupCount, dictionaryTime * 1e9 / lookupCount);
+
+        [[theValue(mapHits) should] equal:theValue(lookupCount)];
+        [[theValue(dictionaryHits) should] equal:theValue(lookupCount)];
+    });
+
+    it(@"should report the cost of instances sharing one definition", ^{
+        NSUInteger const instanceCount = 200000;
+
+        PLStateMachineDefinition *definition = [[PLStateMachineDefinition alloc] init];
+        [definition registerStateWithId:stateA name:@"stateA" resolver:resolverA];
+        [definition registerStateWithId:stateB name:@"stateB" resolver:resolverB];
+        [definition freeze];
+
+        NSMutableArray *instances = [NSMutableArray arrayWithCapacity:instanceCount];
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        for (NSUInteger i = 0; i < instanceCount; ++i) {
+            PLStateMachineInstance *instance = [[PLStateMachineInstance alloc] initWithDefinition:definition context:NULL];
+            [instance startWithState:stateA];
+            [instances addObject:instance];
+        }
+        CFAbsoluteTime createTime = CFAbsoluteTimeGetCurrent() - start;
+
+        start = CFAbsoluteTimeGetCurrent();
+        for (PLStateMachineInstance *instance in instances) {
+            [instance emitTriggerId:signalA];
+        }
+        CFAbsoluteTime stepTime = CFAbsoluteTimeGetCurrent() - start;
+
+        NSLog(@"instance: %lu bytes, created in %.0f ns, stepped in %.0f ns (machine: %lu bytes)",
+                (unsigned long) class_getInstanceSize([PLStateMachineInstance class]), createTime * 1e9 / instanceCount, stepTime * 1e9 / instanceCount,
+                (unsigned long) class_getInstanceSize([PLStateMachine class]));
+
+        [[theValue(((PLStateMachineInstance *) [instances lastObject]).state) should] equal:theValue(stateB)];
+    });
+
+    it(@"should report the pool bulk step throughput against emitting to single machines", ^{
+        NSUInteger const instanceCount = 1000000;
+        NSUInteger const machineCount = 10000;
+
+        PLStateMachineDefinition *definition = [[PLStateMachineDefinition alloc] init];
+        [definition registerStateWithId:stateA name:@"stateA" resolver:resolverA];
+        [definition registerStateWithId:stateB name:@"stateB" resolver:resolverB];
+        [definition freeze];
+
+        PLStateMachinePool *pool = [[PLStateMachinePool alloc] initWithDefinition:definition capacity:instanceCount];
+        for (NSUInteger i = 0; i < instanceCount; ++i) {
+            [pool addInstanceWithState:stateA];
+        }
+
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        NSUInteger changedCount = [pool emitTriggerIdToAllInstances:signalA changedHandles:NULL];
+        CFAbsoluteTime bulkTime = CFAbsoluteTimeGetCurrent() - start;
+
+        dispatch_queue_t queue = dispatch_queue_create("fsm-machines", DISPATCH_QUEUE_SERIAL);
+        NSMutableArray *machines = [NSMutableArray arrayWithCapacity:machineCount];
+        for (NSUInteger i = 0; i < machineCount; ++i) {
+            PLStateMachine *machine = [[PLStateMachine alloc] initWithDefinition:definition queue:queue];
+            [machine startWithState:stateA];
+            [machines addObject:machine];
+        }
+        [[machines lastObject] wait];
+
+        start = CFAbsoluteTimeGetCurrent();
+        for (PLStateMachine *machine in machines) {
+            [machine emitTriggerId:signalA];
+        }
+        [[machines lastObject] wait];
+        CFAbsoluteTime machinesTime = CFAbsoluteTimeGetCurrent() - start;
+
+        NSLog(@"pool bulk step: %.2f ns per instance, emitTriggerId: per machine: %.2f ns per machine", bulkTime * 1e9 / instanceCount, machinesTime * 1e9 / machineCount);
+
+        [[theValue(changedCount) should] equal:theValue(instanceCount)];
+        [[theValue([pool countInstancesInState:stateB]) should] equal:theValue(instanceCount)];
+        [[theValue(((PLStateMachine *) [machines lastObject]).state) should] equal:theValue(stateB)];
+    });
+
+    it(@"should report the pool bulk step throughput partitioned across cores", ^{
+        NSUInteger const instanceCount = 4000000;
+
+        PLStateMachineDefinition *definition = [[PLStateMachineDefinition alloc] init];
+        [definition registerStateWithId:stateA name:@"stateA" resolver:resolverA];
+        [definition registerStateWithId:stateB name:@"stateB" resolver:resolverB];
+        [definition freeze];
+
+        PLStateMachinePool *pool = [[PLStateMachinePool alloc] initWithDefinition:definition capacity:instanceCount];
+        for (NSUInteger i = 0; i < instanceCount; ++i) {
+            [pool addInstanceWithState:stateA];
+        }
+
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        [pool emitTriggerIdToAllInstances:signalA changedHandles:NULL];
+        CFAbsoluteTime serialTime = CFAbsoluteTimeGetCurrent() - start;
+
+        start = CFAbsoluteTimeGetCurrent();
+        NSUInteger changedCount = [pool emitTriggerIdToAllInstances:signalA options:PLStateMachinePoolStepConcurrently changedHandles:NULL];
+        CFAbsoluteTime concurrentTime = CFAbsoluteTimeGetCurrent() - start;
+
+        NSLog(@"pool bulk step of %lu instances: serial %.2f ms, concurrent on %lu cores %.2f ms", (unsigned long) instanceCount, serialTime * 1e3, (unsigned long) [[NSProcessInfo processInfo] activeProcessorCount], concurrentTime * 1e3);
+
+        [[theValue(changedCount) should] equal:theValue(instanceCount)];
+        [[theValue([pool countInstancesInState:stateA]) should] equal:theValue(instanceCount)];
+    });
+
+    it(@"should report the work stealing executor throughput and tail latency against one queue per machine", ^{
+        NSUInteger const machineCount = 10000;
+        NSUInteger const triggersPerMachine = 20;
+        NSUInteger const triggerCount = machineCount * triggersPerMachine;
+
+        PLStateMachineDefinition *definition = [[PLStateMachineDefinition alloc] init];
+        [definition registerStateWithId:stateA name:@"stateA" resolver:resolverA];
+        [definition registerStateWithId:stateB name:@"stateB" resolver:resolverB];
+        [definition freeze];
+
+        void (^measure)(NSString *, id <PLStateMachineExecutor>(^)(void)) = ^(NSString *label, id <PLStateMachineExecutor>(^executorForMachine)(void)) {
+            double *latencies = malloc(triggerCount * sizeof(double));
+            __block volatile int32_t latencyCount = 0;
+
+            NSMutableArray *machines = [NSMutableArray arrayWithCapacity:machineCount];
+            for (NSUInteger i = 0; i < machineCount; ++i) {
+                PLStateMachine *machine = [[PLStateMachine alloc] initWithDefinition:definition executor:executorForMachine()];
+                [machine onTransitionCall:^(PLStateMachine *fsm) {
+                    NSNumber *emittedAt = (NSNumber *) fsm.triggeredBy.object;
+                    if (emittedAt != nil) {
+                        latencies[OSAtomicIncrement32(&latencyCount) - 1] = CFAbsoluteTimeGetCurrent() - emittedAt.doubleValue;
+                    }
+                } owner:nil];
+                [machine startWithState:stateA];
+                [machines addObject:machine];
+            }
+            for (PLStateMachine *machine in machines) {
+                [machine wait];
+            }
+
+            CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+            dispatch_apply(4, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t producer) {
+                for (NSUInteger i = producer; i < triggerCount; i += 4) {
+                    [machines[i % machineCount] emitTriggerId:signalA object:@(CFAbsoluteTimeGetCurrent())];
+                }
+            });
+            for (PLStateMachine *machine in machines) {
+                [machine wait];
+            }
+            CFAbsoluteTime time = CFAbsoluteTimeGetCurrent() - start;
+
+            qsort_b(latencies, (size_t) latencyCount, sizeof(double), ^int(const void *a, const void *b) {
+                double difference = *(const double *) a - *(const double *) b;
+                return difference < 0 ? -1 : difference > 0 ? 1 : 0;
+            });
+            NSLog(@"%@: %.0f triggers/s, p50 latency %.1f us, p99 latency %.1f us", label, triggerCount / time, latencies[latencyCount / 2] * 1e6, latencies[latencyCount * 99 / 100] * 1e6);
+
+            [[theValue(latencyCount) should] equal:theValue(triggerCount)];
+            free(latencies);
+        };
+
+        measure(@"one queue per machine", ^id <PLStateMachineExecutor> {
+            return [[PLStateMachineQueueExecutor alloc] initWithQueue:nil];
+        });
+        PLStateMachineWorkStealingExecutor *executor = [[PLStateMachineWorkStealingExecutor alloc] initWithThreadCount:0];
+        measure(@"work stealing executor", ^id <PLStateMachineExecutor> {
+            return executor;
+        });
+        NSLog(@"work stealing executor: %llu steals", executor.stealCount);
+    });
+
+    it(@"should report the wait of urgent triggers under a flood of bulk triggers", ^{
+        NSUInteger const triggerCount = 200000;
+        NSUInteger const urgentInterval = 1000;
+
+        uint64_t urgentProcessedBefore = [stateMachine statisticsForPriority:PLStateMachineTriggerPriorityUrgent].processedRecordCount;
+        dispatch_apply(2, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t producer) {
+            for (NSUInteger i = producer; i < triggerCount; i += 2) {
+                PLStateMachineTriggerPriority priority = i % urgentInterval == 0 ? PLStateMachineTriggerPriorityUrgent : PLStateMachineTriggerPriorityBulk;
+                [stateMachine emitTrigger:[PLStateMachineTrigger triggerWithId:signalA] priority:priority];
+            }
+        });
+        [stateMachine wait];
+
+        PLStateMachineLaneStatistics urgent = [stateMachine statisticsForPriority:PLStateMachineTriggerPriorityUrgent];
+        PLStateMachineLaneStatistics bulk = [stateMachine statisticsForPriority:PLStateMachineTriggerPriorityBulk];
+        NSLog(@"urgent lane: average wait %.1f us, max wait %.1f us; bulk lane: average wait %.1f us, max wait %.1f us",
+                urgent.totalWaitTime * 1e6 / urgent.processedRecordCount, urgent.maxWaitTime * 1e6,
+                bulk.totalWaitTime * 1e6 / bulk.processedRecordCount, bulk.maxWaitTime * 1e6);
+
+        [[theValue(urgent.processedRecordCount - urgentProcessedBefore) should] equal:theValue(triggerCount / urgentInterval)];
+        [[theValue(urgent.depth + bulk.depth) should] equal:theValue(0)];
+    });
+
+    it(@"should report the cost of arming and cancelling a million timeouts", ^{
+        NSUInteger const timerCount = 1000000;
+
+        PLStateMachineTimerScheduler *scheduler = PLStateMachineTimerSchedulerShared();
+        PLStateMachineTimer *timers = calloc(timerCount, sizeof(PLStateMachineTimer));
+        NSObject *context = [[NSObject alloc] init];
+        for (NSUInteger i = 0; i < timerCount; ++i) {
+            timers[i].function = PLPerformanceTimerFired;
+            timers[i].context = (__bridge const void *) context;
+        }
+
+        NSTimeInterval now = PLStateMachineMonotonicTime();
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        for (NSUInteger i = 0; i < timerCount; ++i) {
+            //spread over an hour, so all levels of the wheel are used
+            PLStateMachineTimerSchedulerArm(scheduler, &timers[i], now + 60 + (i * 7919 % 3600), 0);
+        }
+        CFAbsoluteTime armTime = CFAbsoluteTimeGetCurrent() - start;
+
+        start = CFAbsoluteTimeGetCurrent();
+        NSUInteger cancelledCount = 0;
+        for (NSUInteger i = 0; i < timerCount; ++i) {
+            cancelledCount += PLStateMachineTimerSchedulerCancel(scheduler, &timers[i]) ? 1 : 0;
+        }
+        CFAbsoluteTime cancelTime = CFAbsoluteTimeGetCurrent() - start;
+
+        NSLog(@"timing wheel: arm %.1f ns, cancel %.1f ns per timeout with %lu armed", armTime * 1e9 / timerCount, cancelTime * 1e9 / timerCount, (unsigned long) timerCount);
+
+        [[theValue(cancelledCount) should] equal:theValue(timerCount)];
+        free(timers);
+    });
+
+    it(@"should report the timer wakeups saved by a leeway", ^{
+        NSUInteger const timerCount = 10000;
+
+        PLStateMachineTimerScheduler *scheduler = PLStateMachineTimerSchedulerShared();
+        PLStateMachineTimer *timers = calloc(timerCount, sizeof(PLStateMachineTimer));
+        NSObject *context = [[NSObject alloc] init];
+        for (NSUInteger i = 0; i < timerCount; ++i) {
+            timers[i].function = PLPerformanceTimerCounted;
+            timers[i].context = (__bridge const void *) context;
+        }
+
+        uint64_t wakeups[2];
+        NSTimeInterval const leeways[2] = {0, 0.1};
+        for (NSUInteger run = 0; run < 2; ++run) {
+            PLPerformanceFiredTimerCount = 0;
+            uint64_t wakeupsBefore = PLStateMachineTimerSchedulerGetStatistics(scheduler).wakeupCount;
+
+            //due at every millisecond of half a second
+            NSTimeInterval now = PLStateMachineMonotonicTime();
+            for (NSUInteger i = 0; i < timerCount; ++i) {
+                PLStateMachineTimerSchedulerArm(scheduler, &timers[i], now + 0.1 + 0.5 * i / timerCount, leeways[run]);
+            }
+            NSTimeInterval giveUp = now + 5;
+            while (PLPerformanceFiredTimerCount < (int32_t) timerCount && PLStateMachineMonotonicTime() < giveUp) {
+                usleep(10000);
+            }
+
+            [[theValue(PLPerformanceFiredTimerCount) should] equal:theValue(timerCount)];
+            wakeups[run] = PLStateMachineTimerSchedulerGetStatistics(scheduler).wakeupCount - wakeupsBefore;
+        }
+
+        NSLog(@"timer wakeups for %lu timeouts over 500 ms: %llu without leeway, %llu with 100 ms leeway", (unsigned long) timerCount, wakeups[0], wakeups[1]);
+
+        [[theValue(wakeups[1]) should] beLessThan:theValue(wakeups[0])];
+        free(timers);
+    });
+
+    it(@"should report the speed of simulating a day of timeouts on a virtual clock", ^{
+        NSUInteger const machineCount = 1000;
+        PLStateMachineTriggerId const timeout = 2;
+
+        PLStateMachineVirtualClock *clock = [[PLStateMachineVirtualClock alloc] init];
+        PLStateMachineDefinition *definition = [[PLStateMachineDefinition alloc] init];
+        [definition registerStateWithId:stateA name:@"stateA" resolver:mapResolver(@{@(timeout) : @(stateB)}) timeout:60 trigger:timeout];
+        [definition registerStateWithId:stateB name:@"stateB" resolver:mapResolver(@{@(timeout) : @(stateA)}) timeout:90 trigger:timeout];
+        [definition freeze];
+
+        PLStateMachineInlineExecutor *executor = [[PLStateMachineInlineExecutor alloc] init];
+        NSMutableArray *machines = [NSMutableArray arrayWithCapacity:machineCount];
+        for (NSUInteger i = 0; i < machineCount; ++i) {
+            PLStateMachine *machine = [[PLStateMachine alloc] initWithDefinition:definition executor:executor clock:clock];
+            [machine startWithState:stateA];
+            [machines addObject:machine];
+            //spreads the machines over the first minute
+            [clock advanceBy:0.06];
+        }
+
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        NSUInteger firedCount = [clock advanceBy:24 * 3600];
+        CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - start;
+
+        NSLog(@"virtual clock: %lu timeouts of %lu machines over a day in %.3f s, %.0f ns per timeout", (unsigned long) firedCount, (unsigned long) machineCount, elapsed, elapsed * 1e9 / firedCount);
+
+        //one transition per 75 seconds on average
+        [[theValue(firedCount) should] beGreaterThan:theValue(machineCount * 24 * 3600 / 75 - machineCount)];
+    });
+
+    it(@"should report the cost of tracing a transition", ^{
+        NSUInteger const recordCount = 10000000;
+        NSUInteger const writerCount = 4;
+
+        PLStateMachineTraceRing *ring = PLStateMachineTraceRingCreate(PLSTATE_MACHINE_TRACE_CAPACITY, NULL, 0);
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        for (NSUInteger i = 0; i < recordCount; ++i) {
+            PLStateMachineTraceRingWrite(ring, i, stateA, stateB, i, 0, PLStateMachineTraceOutcomeTransitioned);
+        }
+        CFAbsoluteTime serial = CFAbsoluteTimeGetCurrent() - start;
+
+        //pool partitions share the ring of their pool
+        start = CFAbsoluteTimeGetCurrent();
+        dispatch_apply(writerCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t writer) {
+            for (NSUInteger i = 0; i < recordCount / writerCount; ++i) {
+                PLStateMachineTraceRingWrite(ring, i, stateA, stateB, i, (uint32_t) writer, PLStateMachineTraceOutcomeTransitioned);
+            }
+        });
+        CFAbsoluteTime concurrent = CFAbsoluteTimeGetCurrent() - start;
+
+        PLStateMachineTraceRecord records[PLSTATE_MACHINE_TRACE_CAPACITY];
+        NSUInteger copiedCount = PLStateMachineTraceRingCopy(ring, records, PLSTATE_MACHINE_TRACE_CAPACITY);
+        PLStateMachineTraceRingFree(ring);
+
+        NSLog(@"trace: %.1f ns per record from one writer, %.1f ns from %lu writers", serial * 1e9 / recordCount, concurrent * 1e9 / recordCount, (unsigned long) writerCount);
+
+        [[theValue(copiedCount) should] beGreaterThan:theValue(0)];
+    });
+});
+
+SPEC_END
@@ -0,0 +1,229 @@
+#import <Kiwi/Kiwi.h>
+#import "PLStateMachineDefinition.h"
+#import "PLStateMachinePool.h"
+#import "PLStateMachineMapResolver.h"
+#import "PLStateMachineBlockResolver.h"
+
+SPEC_BEGIN(PLStateMachinePoolSpec)
+
+describe(@"PLStateMachinePool", ^{
+    PLStateMachineStateId stateA = 1;
+    PLStateMachineStateId stateB = 2;
+    PLStateMachineStateId stateC = 3;
+    PLStateMachineTriggerId signalA = 1;
+    PLStateMachineTriggerId signalB = 2;
+
+    __block PLStateMachineDefinition *definition;
+    __block PLStateMachinePool *pool;
+
+    beforeEach(^{
+        definition = [[PLStateMachineDefinition alloc] init];
+        [definition registerStateWithId:stateA name:@"stateA" resolver:mapResolver(@{@(signalA) : @(stateB)})];
+        [definition registerStateWithId:stateB
+                                   name:@"stateB"
+                               resolver:blockResolver(^(PLStateMachineTrigger *trigger, PLStateMachine *machine) {
+                                   return trigger.triggerId == signalB ? stateC : PLStateMachineStateUndefined;
+                               })];
+        [definition registerStateWithId:stateC name:@"stateC" resolver:mapResolver(@{@(signalA) : @(stateA)})];
+        [definition freeze];
+
+        pool = [[PLStateMachinePool alloc] initWithDefinition:definition capacity:0];
+    });
+
+    it(@"should store states in the narrowest column the definition allows", ^{
+        [[theValue(pool.stateSize) should] equal:theValue(sizeof(uint8_t))];
+    });
+
+    it(@"should start instances in the provided state", ^{
+        PLStateMachinePoolHandle handle = [pool addInstanceWithState:stateC];
+
+        [[theValue([pool stateOfInstance:handle]) should] equal:theValue(stateC)];
+        [[theValue([pool prevStateOfInstance:handle]) should] equal:theValue(PLStateMachineStateUndefined)];
+        [[theValue(pool.count) should] equal:theValue(1)];
+    });
+
+    it(@"should apply triggers using both compiled and dynamic resolvers", ^{
+        PLStateMachinePoolHandle handle = [pool addInstanceWithState:stateA];
+
+        [[theValue([pool emitTriggerId:signalB toInstance:handle]) should] beNo];
+        [[theValue([pool emitTriggerId:signalA toInstance:handle]) should] beYes];
+        [[theValue([pool emitTriggerId:signalB toInstance:handle]) should] beYes];
+
+        [[theValue([pool stateOfInstance:handle]) should] equal:theValue(stateC)];
+        [[theValue([pool prevStateOfInstance:handle]) should] equal:theValue(stateB)];
+        [[theValue([pool lastTriggerIdOfInstance:handle]) should] equal:theValue(signalB)];
+    });
+
+    it(@"should reuse the handles of removed instances", ^{
+        PLStateMachinePoolHandle first = [pool addInstanceWithState:stateA];
+        [pool addInstanceWithState:stateA];
+
+        [pool removeInstance:first];
+        [[theValue([pool containsInstance:first]) should] beNo];
+        [[theBlock(^{
+            [pool stateOfInstance:first];
+        }) should] raiseWithName:@"InvalidArgumentException"];
+
+        [[theValue([pool addInstanceWithState:stateB]) should] equal:theValue(first)];
+        [[theValue(pool.count) should] equal:theValue(2)];
+    });
+
+    it(@"should grow past its initial capacity and count instances per state", ^{
+        for (NSUInteger i = 0; i < 1000; ++i) {
+            PLStateMachinePoolHandle handle = [pool addInstanceWithState:stateA];
+            if (i % 4 == 0) {
+                [pool emitTriggerId:signalA toInstance:handle];
+            }
+        }
+
+        [[theValue([pool countInstancesInState:stateA]) should] equal:theValue(750)];
+        [[theValue([pool countInstancesInState:stateB]) should] equal:theValue(250)];
+
+        __block NSUInteger enumerated = 0;
+        [pool enumerateInstancesInState:stateB usingBlock:^(PLStateMachinePoolHandle handle) {
+            [[theValue(handle % 4) should] equal:theValue(0)];
+            ++enumerated;
+        }];
+        [[theValue(enumerated) should] equal:theValue(250)];
+    });
+
+    describe(@"stepping all instances", ^{
+        __block PLStateMachinePool *mirror;
+
+        beforeEach(^{
+            mirror = [[PLStateMachinePool alloc] initWithDefinition:definition capacity:0];
+            PLStateMachineStateId const states[] = {stateA, stateB, stateC};
+            for (NSUInteger i = 0; i < 1003; ++i) {
+                [pool addInstanceWithState:states[i % 3]];
+                [mirror addInstanceWithState:states[i % 3]];
+            }
+            for (PLStateMachinePoolHandle handle = 5; handle < 1003; handle += 7) {
+                [pool removeInstance:handle];
+                [mirror removeInstance:handle];
+            }
+        });
+
+        void (^compare)(PLStateMachineTriggerId) = ^(PLStateMachineTriggerId triggerId) {
+            NSMutableData *expected = [NSMutableData data];
+            for (PLStateMachinePoolHandle handle = 0; handle < 1003; ++handle) {
+                if ([mirror containsInstance:handle] && [mirror emitTriggerId:triggerId toInstance:handle]) {
+                    [expected appendBytes:&handle length:sizeof(handle)];
+                }
+            }
+
+            NSData *changed = nil;
+            NSUInteger changedCount = [pool emitTriggerIdToAllInstances:triggerId changedHandles:&changed];
+
+            [[theValue(changedCount) should] equal:theValue(expected.length / sizeof(PLStateMachinePoolHandle))];
+            [[changed should] equal:expected];
+            for (PLStateMachinePoolHandle handle = 0; handle < 1003; ++handle) {
+                [[theValue([pool containsInstance:handle]) should] equal:theValue([mirror containsInstance:handle])];
+                if ([pool containsInstance:handle]) {
+                    [[theValue([pool stateOfInstance:handle]) should] equal:theValue([mirror stateOfInstance:handle])];
+                    [[theValue([pool prevStateOfInstance:handle]) should] equal:theValue([mirror prevStateOfInstance:handle])];
+                    [[theValue([pool lastTriggerIdOfInstance:handle]) should] equal:theValue([mirror lastTriggerIdOfInstance:handle])];
+                }
+            }
+        };
+
+        it(@"should match stepping the instances one by one for compiled cells", ^{
+            compare(signalA);
+            compare(signalA);
+        });
+
+        it(@"should match stepping the instances one by one for resolver backed cells", ^{
+            compare(signalB);
+            compare(signalA);
+        });
+
+        it(@"should only call the callbacks of the changed instances", ^{
+            __block NSUInteger callCount = 0;
+            [pool onLeaving:stateA call:^(PLStateMachinePool *aPool, PLStateMachinePoolHandle handle) {
+                [[theValue([aPool stateOfInstance:handle]) should] equal:theValue(stateB)];
+                ++callCount;
+            }];
+
+            NSUInteger changedCount = [pool emitTriggerIdToAllInstances:signalA changedHandles:NULL];
+
+            [[theValue(callCount) should] equal:theValue([mirror countInstancesInState:stateA])];
+            [[theValue(changedCount) should] equal:theValue([mirror countInstancesInState:stateA] + [mirror countInstancesInState:stateC])];
+        });
+    });
+
+    describe(@"stepping all instances concurrently", ^{
+        NSUInteger const instanceCount = 100003;
+        __block PLStateMachinePool *serial;
+
+        beforeEach(^{
+            serial = [[PLStateMachinePool alloc] initWithDefinition:definition capacity:instanceCount];
+            PLStateMachineStateId const states[] = {stateA, stateB, stateC};
+            for (NSUInteger i = 0; i < instanceCount; ++i) {
+                [pool addInstanceWithState:states[i % 3]];
+                [serial addInstanceWithState:states[i % 3]];
+            }
+            for (PLStateMachinePoolHandle handle = 11; handle < instanceCount; handle += 13) {
+                [pool removeInstance:handle];
+                [serial removeInstance:handle];
+            }
+        });
+
+        it(@"should match stepping serially and call the ordered callbacks in handle order", ^{
+            NSMutableData *notified = [NSMutableData data];
+            [pool onTransitionCall:^(PLStateMachinePool *aPool, PLStateMachinePoolHandle handle) {
+                [notified appendBytes:&handle length:sizeof(handle)];
+            }];
+
+            NSData *expected = nil;
+            NSData *changed = nil;
+            [serial emitTriggerIdToAllInstances:signalA changedHandles:&expected];
+            [pool emitTriggerIdToAllInstances:signalA options:PLStateMachinePoolStepConcurrently | PLStateMachinePoolStepOrderedCallbacks changedHandles:&changed];
+
+            [[changed should] equal:expected];
+            [[notified should] equal:expected];
+            for (PLStateMachinePoolHandle handle = 0; handle < instanceCount; ++handle) {
+                if ([serial containsInstance:handle]) {
+                    [[theValue([pool stateOfInstance:handle]) should] equal:theValue([serial stateOfInstance:handle])];
+                    [[theValue([pool prevStateOfInstance:handle]) should] equal:theValue([serial prevStateOfInstance:handle])];
+                }
+            }
+        });
+
+        it(@"should call the unordered callbacks once for every changed instance", ^{
+            __block NSUInteger callCount = 0;
+            [pool onLeaving:stateA call:^(PLStateMachinePool *aPool, PLStateMachinePoolHandle handle) {
+                @synchronized (serial) {
+                    ++callCount;
+                }
+            }];
+
+            [pool emitTriggerIdToAllInstances:signalA options:PLStateMachinePoolStepConcurrently changedHandles:NULL];
+
+            [[theValue(callCount) should] equal:theValue([serial countInstancesInState:stateA])];
+        });
+    });
+
+    it(@"should call the callbacks in the right order", ^{
+        NSMutableArray *calls = [NSMutableArray array];
+        [pool onTransitionCall:^(PLStateMachinePool *aPool, PLStateMachinePoolHandle handle) {
+            [calls addObject:@"transition"];
+        }];
+        [pool onEntering:stateB call:^(PLStateMachinePool *aPool, PLStateMachinePoolHandle handle) {
+            [calls addObject:@"entering"];
+        }];
+        [pool onLeaving:stateA entering:stateB call:^(PLStateMachinePool *aPool, PLStateMachinePoolHandle handle) {
+            [calls addObject:@"between"];
+        }];
+        [pool onLeaving:stateA call:^(PLStateMachinePool *aPool, PLStateMachinePoolHandle handle) {
+            [calls addObject:@"leaving"];
+        }];
+
+        PLStateMachinePoolHandle handle = [pool addInstanceWithState:stateA];
+        [[calls should] equal:@[@"transition"]];
+
+        [calls removeAllObjects];
+        [pool emitTriggerId:signalA toInstance:handle];
+        [[calls should] equal:@[@"leaving", @"between", @"entering", @"transition"]];
+    });
+});
+
+SPEC_END
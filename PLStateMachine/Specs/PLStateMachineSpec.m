@@ -1,6 +1,12 @@
 #import <Kiwi/Kiwi.h>
+#import <malloc/malloc.h>
 #import "PLStateMachine.h"
+#import "PLStateMachineDefinition.h"
 #import "PLStateMachineBlockResolver.h"
+#import "PLStateMachineMapResolver.h"
+#import "PLStateMachineTriggerRecord.h"
+#import "PLStateMachineManualExecutor.h"
+#import "PLStateMachineVirtualClock.h"
 #import "PLBlockKVOObserver.h"
 
 SPEC_BEGIN(PLStateMachineSpec)
@@ -56,6 +62,19 @@ describe(@"PLStateMachine", ^{
             }) should] raise];
         });
 
+        it(@"should register states with both dense and sparse ids", ^{
+            PLStateMachineStateId sparseState = 1 << 20;
+
+            [stateMachine registerStateWithId:placeholderState name:@"dense" resolver:resolver];
+            [stateMachine registerStateWithId:sparseState name:@"sparse" resolver:resolver];
+
+            [[theValue([stateMachine hasState:placeholderState]) should] beTrue];
+            [[theValue([stateMachine hasState:sparseState]) should] beTrue];
+            [[theValue([stateMachine hasState:placeholderState + 1]) should] beFalse];
+            [[theValue([stateMachine hasState:sparseState + 1]) should] beFalse];
+            [[[stateMachine nameForState:sparseState] should] equal:@"sparse"];
+        });
+
         it(@"should throw an exception if the same id is used twice to register two distinct states", ^{
             [[theBlock(^{
                 [stateMachine registerStateWithId:placeholderState name:@"first" resolver:resolver];
@@ -171,18 +190,259 @@ describe(@"PLStateMachine", ^{
             [[theValue(valid) should] beTrue];
         });
 
-//        it(@"should handle signals emited from inside transitions callbacks", ^{
-//            [stateMachine onLeaving:stateA
-//                               call:^(PLStateMachine *fsm) {
-//                                   [stateMachine emitTriggerId:signalA];
-//                               }
-//                              owner:nil];
-//
-//            [stateMachine emitTriggerId:signalA];
-//            synchronize();
-//
-//            [[theValue(stateMachine.state) should] equal:theValue(stateC)];
-//        });
+        it(@"should apply a batch of triggers one after another", ^{
+            __block NSUInteger transitionCount = 0;
+            [stateMachine onTransitionCall:^(PLStateMachine *fsm) {
+                ++transitionCount;
+            }
+                                     owner:nil];
+
+            [stateMachine emitTriggers:@[[PLStateMachineTrigger triggerWithId:signalA], [PLStateMachineTrigger triggerWithId:signalA object:@1]]];
+            [stateMachine wait];
+
+            [[theValue(stateMachine.state) should] equal:theValue(stateC)];
+            [[theValue(stateMachine.prevState) should] equal:theValue(stateB)];
+            [[stateMachine.triggeredBy.object should] equal:@1];
+            [[theValue(transitionCount) should] equal:theValue(2)];
+        });
+
+        it(@"should apply a batch of trigger ids one after another", ^{
+            PLStateMachineTriggerId triggerIds[] = {signalA, signalA};
+
+            [stateMachine emitTriggerIds:triggerIds count:2];
+            [stateMachine wait];
+
+            [[theValue(stateMachine.state) should] equal:theValue(stateC)];
+            [[theValue(stateMachine.prevState) should] equal:theValue(stateB)];
+        });
+
+        it(@"should handle signals emited from inside transitions callbacks", ^{
+            [stateMachine onLeaving:stateA
+                               call:^(PLStateMachine *fsm) {
+                                   [stateMachine emitTriggerId:signalA];
+                               }
+                              owner:nil];
+
+            [stateMachine emitTriggerId:signalA];
+            [stateMachine wait];
+
+            [[theValue(stateMachine.state) should] equal:theValue(stateC)];
+        });
+
+        it(@"should handle signals emited from inside transitions callbacks before the already queued ones", ^{
+            PLStateMachineStateId stateD = 7;
+            NSMutableArray *received = [NSMutableArray array];
+
+            [stateMachine registerStateWithId:stateD
+                                         name:@"stateD"
+                                     resolver:blockResolver(^(PLStateMachineTrigger *trigger, PLStateMachine *machine) {
+                                         [received addObject:trigger.object];
+                                         return PLStateMachineStateUndefined;
+                                     })];
+            [stateMachine onEntering:stateD
+                                call:^(PLStateMachine *fsm) {
+                                    [fsm emitTriggerId:signalA object:@"reentrant"];
+                                }
+                               owner:nil];
+
+            //both land in the mailbox before any of them is processed
+            dispatch_suspend(queue);
+            [stateMachine startWithState:stateD];
+            [stateMachine emitTriggerId:signalA object:@"queued"];
+            dispatch_resume(queue);
+            [stateMachine wait];
+
+            [[received should] equal:@[@"reentrant", @"queued"]];
+        });
+    });
+
+    describe(@"id-only triggers", ^{
+        PLStateMachineStateId stateA = 3;
+        PLStateMachineTriggerId signalA = 6;
+
+        __block NSUInteger callCount;
+
+        beforeEach(^{
+            callCount = 0;
+
+            [stateMachine registerStateWithId:stateA
+                                         name:@"stateA"
+                                     resolver:blockResolver(^(PLStateMachineTrigger *trigger, PLStateMachine *machine) {
+                                         return stateA;
+                                     })];
+            [stateMachine onEntering:stateA
+                                call:^(PLStateMachine *fsm) {
+                                    ++callCount;
+                                }
+                               owner:nil];
+
+            [stateMachine startWithState:stateA];
+            [stateMachine wait];
+        });
+
+        it(@"should be interned", ^{
+            [[[PLStateMachineTrigger triggerWithId:signalA] should] beIdenticalTo:[PLStateMachineTrigger triggerWithId:signalA]];
+            [[[PLStateMachineTrigger triggerWithId:1 << 20] should] beIdenticalTo:[PLStateMachineTrigger triggerWithId:1 << 20]];
+            [[[PLStateMachineTrigger triggerWithId:signalA object:@1] shouldNot] beIdenticalTo:[PLStateMachineTrigger triggerWithId:signalA]];
+        });
+
+        it(@"should be allowed to repeat the same self transition", ^{
+            [stateMachine emitTriggerId:signalA];
+            [stateMachine emitTriggerId:signalA];
+            [stateMachine wait];
+
+            [[theValue(callCount) should] equal:theValue(3)];
+        });
+
+        it(@"should keep the order of triggers emitted by each thread", ^{
+            PLStateMachineStateId stateB = 4;
+            size_t const producerCount = 4;
+            NSUInteger const triggersPerProducer = 1000;
+
+            NSMutableArray *received = [NSMutableArray array];
+            for (size_t i = 0; i < producerCount; ++i) {
+                [received addObject:[NSMutableArray array]];
+            }
+
+            [stateMachine registerStateWithId:stateB
+                                         name:@"stateB"
+                                     resolver:blockResolver(^(PLStateMachineTrigger *trigger, PLStateMachine *machine) {
+                                         NSArray *payload = (NSArray *) trigger.object;
+                                         [[received objectAtIndex:[[payload objectAtIndex:0] unsignedIntegerValue]] addObject:[payload objectAtIndex:1]];
+                                         return PLStateMachineStateUndefined;
+                                     })];
+            [stateMachine emitTriggerId:signalA];
+            [stateMachine startWithState:stateB];
+
+            dispatch_apply(producerCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t producer) {
+                for (NSUInteger i = 0; i < triggersPerProducer; ++i) {
+                    [stateMachine emitTriggerId:signalA object:@[@(producer), @(i)]];
+                }
+            });
+            [stateMachine wait];
+
+            [[theValue(stateMachine.state) should] equal:theValue(stateB)];
+            for (NSArray *sequence in received) {
+                [[theValue(sequence.count) should] equal:theValue(triggersPerProducer)];
+                [sequence enumerateObjectsUsingBlock:^(NSNumber *value, NSUInteger idx, BOOL *stop) {
+                    [[theValue(value.unsignedIntegerValue) should] equal:theValue(idx)];
+                }];
+            }
+        });
+
+        it(@"should not allocate anything per emitted trigger", ^{
+            //the queue is held, so both bursts have all the triggers in flight at once
+            dispatch_suspend(queue);
+            for (NSUInteger i = 0; i < 1000; ++i) {
+                [stateMachine emitTriggerId:signalA];
+            }
+            dispatch_resume(queue);
+            [stateMachine wait];
+
+            NSUInteger allocationCount = PLStateMachineTriggerRecordAllocationCount();
+            malloc_statistics_t before;
+            malloc_statistics_t inFlight;
+
+            dispatch_suspend(queue);
+            malloc_zone_statistics(malloc_default_zone(), &before);
+            for (NSUInteger i = 0; i < 1000; ++i) {
+                [stateMachine emitTriggerId:signalA];
+            }
+            //whatever an emit allocates is still held while its trigger waits, other threads may allocate a little
+            malloc_zone_statistics(malloc_default_zone(), &inFlight);
+            dispatch_resume(queue);
+            [stateMachine wait];
+
+            [[theValue(PLStateMachineTriggerRecordAllocationCount()) should] equal:theValue(allocationCount)];
+            [[theValue(inFlight.blocks_in_use - MIN(inFlight.blocks_in_use, before.blocks_in_use)) should] beLessThan:theValue(100)];
+            [[[PLStateMachineTrigger triggerWithId:signalA] should] beIdenticalTo:[PLStateMachineTrigger triggerWithId:signalA]];
+            [[theValue(callCount) should] equal:theValue(2001)];
+        });
+    });
+
+    describe(@"freezing", ^{
+        PLStateMachineStateId stateA = 3;
+        PLStateMachineStateId stateB = 5;
+        PLStateMachineStateId stateC = 6;
+        PLStateMachineTriggerId signalA = 1;
+        PLStateMachineTriggerId signalB = 2;
+        PLStateMachineTriggerId signalC = 3;
+
+        __block NSUInteger blockResolverCallCount;
+
+        beforeEach(^{
+            blockResolverCallCount = 0;
+
+            PLStateMachineMapResolver *commonResolver = mapResolver(@{
+                    @(signalC) : @(stateA)
+            });
+
+            [stateMachine registerStateWithId:stateA
+                                         name:@"stateA"
+                                     resolver:childMapResolver(commonResolver, @{
+                                             @(signalA) : @(stateB)
+                                     })];
+            [stateMachine registerStateWithId:stateB
+                                         name:@"stateB"
+                                     resolver:childMapResolver(commonResolver, @{
+                                             @(signalA) : mapResolver(@{
+                                                     @(signalA) : @(stateC)
+                                             }),
+                                             @(signalB) : blockResolver(^(PLStateMachineTrigger *trigger, PLStateMachine *machine) {
+                                                 ++blockResolverCallCount;
+                                                 return stateA;
+                                             })
+                                     })];
+            [stateMachine registerStateWithId:stateC name:@"stateC" resolver:commonResolver];
+        });
+
+        it(@"should report the size of the compiled matrix", ^{
+            [[theValue([stateMachine freeze]) should] beGreaterThan:theValue(0)];
+            [[theValue(stateMachine.isFrozen) should] beTrue];
+        });
+
+        it(@"should not allow registering states afterwards", ^{
+            [stateMachine freeze];
+
+            [[theBlock(^{
+                [stateMachine registerStateWithId:7 name:@"stateD" resolver:mapResolver(@{})];
+            }) should] raiseWithName:@"InvalidStateException"];
+        });
+
+        it(@"should resolve the same way the resolvers do", ^{
+            [stateMachine freeze];
+
+            [stateMachine startWithState:stateA];
+            [stateMachine emitTriggerId:signalB];
+            [stateMachine wait];
+            [[theValue(stateMachine.state) should] equal:theValue(stateA)];
+
+            [stateMachine emitTriggerId:signalA];
+            [stateMachine emitTriggerId:signalA];
+            [stateMachine wait];
+            [[theValue(stateMachine.state) should] equal:theValue(stateC)];
+
+            [stateMachine emitTriggerId:signalC];
+            [stateMachine emitTriggerId:signalA];
+            [stateMachine emitTriggerId:signalB];
+            [stateMachine wait];
+            [[theValue(stateMachine.state) should] equal:theValue(stateA)];
+            [[theValue(blockResolverCallCount) should] equal:theValue(1)];
+        });
+
+        it(@"should fall back to the resolver for trigger ids outside of the matrix", ^{
+            PLStateMachineStateId stateD = 7;
+            PLStateMachineTriggerId farSignal = 1 << 20;
+            [stateMachine registerStateWithId:stateD name:@"stateD" resolver:mapResolver(@{
+                    @(farSignal) : @(stateA)
+            })];
+            [stateMachine freeze];
+
+            [stateMachine startWithState:stateD];
+            [stateMachine emitTriggerId:farSignal];
+            [stateMachine wait];
+            [[theValue(stateMachine.state) should] equal:theValue(stateA)];
+        });
     });
 
     describe(@"transition between states", ^{
@@ -317,6 +577,23 @@ describe(@"PLStateMachine", ^{
             [stateMachine emitTriggerId:signalA];
             [stateMachine wait];
         });
+
+        it(@"should call callbacks registered after the same transition was already performed", ^{
+            [stateMachine onLeaving:stateA entering:stateB call:blockA owner:nil];
+
+            [stateMachine emitTriggerId:signalA];
+            [stateMachine emitTriggerId:signalA];
+            [stateMachine wait];
+
+            [[theValue(callCount) should] equal:theValue(3)];
+
+            [stateMachine onEntering:stateB call:blockB owner:nil];
+
+            [stateMachine emitTriggerId:signalA];
+            [stateMachine wait];
+
+            [[theValue(callCount) should] equal:theValue(11)];
+        });
     });
 
     describe(@"owned callbacks", ^{
@@ -422,6 +699,773 @@ describe(@"PLStateMachine", ^{
 
             [[theValue(callCount) should] equal:theValue(5)];
         });
+
+        it(@"should not call removed callbacks for an already performed transition", ^{
+            [stateMachine onLeaving:stateA call:blockA owner:ownerA];
+            [stateMachine onLeaving:stateA call:blockB owner:ownerB];
+
+            [stateMachine emitTriggerId:signalA];
+            [stateMachine emitTriggerId:signalA];
+            [stateMachine wait];
+
+            [[theValue(callCount) should] equal:theValue(8)];
+
+            [stateMachine removeListenersOwnedBy:ownerA];
+
+            [stateMachine emitTriggerId:signalA];
+            [stateMachine wait];
+
+            [[theValue(callCount) should] equal:theValue(13)];
+        });
+
+        it(@"should be removable one by one using the returned tokens", ^{
+            id listenerA = [stateMachine onLeaving:stateA call:blockA owner:ownerA];
+            [stateMachine onLeaving:stateA call:blockB owner:ownerA];
+            id listenerC = [stateMachine onLeaving:stateA call:blockC owner:nil];
+
+            [stateMachine removeListener:listenerA];
+            [stateMachine removeListener:listenerC];
+
+            [stateMachine emitTriggerId:signalA];
+            [stateMachine wait];
+
+            [[theValue(callCount) should] equal:theValue(5)];
+
+            [stateMachine removeListenersOwnedBy:ownerA];
+
+            [stateMachine emitTriggerId:signalA];
+            [stateMachine emitTriggerId:signalA];
+            [stateMachine wait];
+
+            [[theValue(callCount) should] equal:theValue(5)];
+        });
+
+        it(@"should ignore removing the same token twice", ^{
+            id listenerA = [stateMachine onTransitionCall:blockA owner:ownerA];
+            [stateMachine onTransitionCall:blockB owner:ownerA];
+
+            [stateMachine removeListener:listenerA];
+            [stateMachine removeListener:listenerA];
+            [stateMachine removeListener:nil];
+
+            [stateMachine emitTriggerId:signalA];
+            [stateMachine wait];
+
+            [[theValue(callCount) should] equal:theValue(5)];
+        });
+
+        it(@"should keep delivering transitions while other threads register and remove callbacks", ^{
+            NSUInteger const triggerCount = 2000;
+            __block NSUInteger transitionCount = 0;
+            [stateMachine onTransitionCall:^(PLStateMachine *fsm) {
+                ++transitionCount;
+            }
+                                     owner:nil];
+
+            dispatch_apply(4, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t worker) {
+                for (NSUInteger i = 0; i < triggerCount; ++i) {
+                    if (worker == 0) {
+                        [stateMachine emitTriggerId:signalA];
+                    } else {
+                        NSObject *owner = worker == 1 ? ownerA : ownerB;
+                        id listener = [stateMachine onLeaving:stateA call:blockB owner:owner];
+                        if (i % 2 == 0) {
+                            [stateMachine removeListener:listener];
+                        } else {
+                            [stateMachine removeListenersOwnedBy:owner];
+                        }
+                    }
+                }
+            });
+            [stateMachine wait];
+
+            [[theValue(transitionCount) should] equal:theValue(triggerCount)];
+        });
+    });
+
+    describe(@"stepping", ^{
+        PLStateMachineStateId stateA = 1;
+        PLStateMachineStateId stateB = 2;
+        PLStateMachineTriggerId signalA = 1;
+        PLStateMachineTriggerId signalB = 2;
+
+        __block PLStateMachine *steppedMachine;
+
+        beforeEach(^{
+            steppedMachine = [[PLStateMachine alloc] initSteppedWithDefinition:nil];
+            [steppedMachine registerStateWithId:stateA name:@"stateA" resolver:mapResolver(@{@(signalA) : @(stateB)})];
+            [steppedMachine registerStateWithId:stateB name:@"stateB" resolver:mapResolver(@{@(signalA) : @(stateA)})];
+            [steppedMachine startWithState:stateA];
+            [steppedMachine stepMaxTriggers:1];
+        });
+
+        it(@"should buffer the triggers until stepped", ^{
+            [steppedMachine emitTriggerId:signalA];
+            [steppedMachine emitTriggerId:signalA];
+            [steppedMachine emitTriggerId:signalA];
+
+            [[theValue(steppedMachine.state) should] equal:theValue(stateA)];
+            [[theValue([steppedMachine stepMaxTriggers:2]) should] equal:theValue(1)];
+            [[theValue(steppedMachine.state) should] equal:theValue(stateA)];
+            [[theValue([steppedMachine stepMaxTriggers:2]) should] equal:theValue(0)];
+            [[theValue(steppedMachine.state) should] equal:theValue(stateB)];
+        });
+
+        it(@"should count the triggers of a batch separately", ^{
+            PLStateMachineTriggerId const ids[] = {signalA, signalB, signalA};
+            [steppedMachine emitTriggerIds:ids count:3];
+
+            [[theValue([steppedMachine stepMaxTriggers:1]) should] equal:theValue(2)];
+            [[theValue(steppedMachine.state) should] equal:theValue(stateB)];
+        });
+
+        it(@"should only count the emitted triggers as buffered", ^{
+            PLStateMachine *machine = [[PLStateMachine alloc] initSteppedWithDefinition:nil];
+            [machine registerStateWithId:stateA name:@"stateA" resolver:mapResolver(@{@(signalA) : @(stateB)})];
+            [machine startWithState:stateA];
+            [machine emitTriggerId:signalA];
+            [machine emitTriggerId:signalB];
+
+            [[theValue([machine stepMaxTriggers:0]) should] equal:theValue(2)];
+            [[theValue(machine.queueStatistics.queuedTriggerCount) should] equal:theValue(2)];
+            [[(id) machine.executor should] beNil];
+        });
+
+        it(@"should process nothing without a budget", ^{
+            [steppedMachine emitTriggerId:signalA];
+
+            [[theValue([steppedMachine stepWithBudget:0]) should] equal:theValue(1)];
+            [[theValue([steppedMachine stepWithBudget:1]) should] equal:theValue(0)];
+            [[theValue(steppedMachine.state) should] equal:theValue(stateB)];
+        });
+
+        it(@"should finish the triggers emitted from callbacks within the step", ^{
+            [steppedMachine onEntering:stateB call:^(PLStateMachine *fsm) {
+                [fsm emitTriggerId:signalA];
+            } owner:nil];
+
+            [steppedMachine emitTriggerId:signalA];
+
+            [[theValue([steppedMachine stepMaxTriggers:1]) should] equal:theValue(0)];
+            [[theValue(steppedMachine.state) should] equal:theValue(stateA)];
+        });
+
+        it(@"should step when waiting", ^{
+            [steppedMachine emitTriggerId:signalA];
+            [steppedMachine wait];
+
+            [[theValue(steppedMachine.state) should] equal:theValue(stateB)];
+        });
+
+        it(@"should only wait for the triggers emitted before, whatever is emitted meanwhile", ^{
+            __block BOOL stopped = NO;
+            __block NSUInteger signalBCount = 0;
+            PLStateMachine *machine = [[PLStateMachine alloc] initSteppedWithDefinition:nil];
+            [machine registerStateWithId:stateA name:@"stateA" resolver:blockResolver(^PLStateMachineStateId(PLStateMachineTrigger *trigger, PLStateMachine *fsm) {
+                if (trigger.triggerId == signalB) {
+                    ++signalBCount;
+                } else if (!stopped) {
+                    //emitted from another thread, so it is queued and keeps the normal lane busy
+                    dispatch_sync(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+                        [fsm emitTriggerId:signalA];
+                    });
+                }
+                return PLStateMachineStateUndefined;
+            })];
+            [machine startWithState:stateA];
+            [machine emitTriggerId:signalA];
+            [machine emitTriggerId:signalB];
+
+            [machine wait];
+            stopped = YES;
+
+            [[theValue(signalBCount) should] equal:theValue(1)];
+        });
+
+        it(@"should release the triggers still queued when released", ^{
+            __weak NSObject *weakObject = nil;
+            __weak NSObject *weakBatchObject = nil;
+            @autoreleasepool {
+                NSObject *object = [[NSObject alloc] init];
+                NSObject *batchObject = [[NSObject alloc] init];
+                weakObject = object;
+                weakBatchObject = batchObject;
+                PLStateMachineTriggerId const ids[] = {signalA, signalB};
+                PLStateMachine *machine = [[PLStateMachine alloc] initSteppedWithDefinition:nil];
+                [machine registerStateWithId:stateA name:@"stateA" resolver:mapResolver(@{@(signalA) : @(stateB)})];
+                [machine startWithState:stateA];
+                [machine emitTriggerId:signalA object:object];
+                [machine emitTriggers:@[[PLStateMachineTrigger triggerWithId:signalA object:batchObject]]];
+                [machine emitTriggerIds:ids count:2];
+            }
+
+            [[weakObject should] beNil];
+            [[weakBatchObject should] beNil];
+        });
+
+        it(@"should not step machines running on an executor", ^{
+            [[theBlock(^{
+                [stateMachine stepMaxTriggers:1];
+            }) should] raiseWithName:@"InvalidStateException"];
+        });
+    });
+
+    describe(@"bounded queue", ^{
+        PLStateMachineStateId stateA = 1;
+        PLStateMachineStateId stateB = 2;
+        PLStateMachineTriggerId signalA = 1;
+        PLStateMachineTriggerId signalB = 2;
+
+        __block PLStateMachineManualExecutor *executor;
+        __block NSMutableArray *processed;
+        __block PLStateMachine *(^boundedMachine)(PLStateMachineOverflowPolicy);
+
+        beforeEach(^{
+            executor = [[PLStateMachineManualExecutor alloc] init];
+            processed = [NSMutableArray array];
+            boundedMachine = ^PLStateMachine *(PLStateMachineOverflowPolicy policy) {
+                PLStateMachine *machine = [[PLStateMachine alloc] initWithDefinition:nil executor:executor capacity:2 overflowPolicy:policy];
+                id <PLStateMachineResolver> resolver = blockResolver(^PLStateMachineStateId(PLStateMachineTrigger *trigger, PLStateMachine *fsm) {
+                    [processed addObject:trigger.object != nil ? trigger.object : @(trigger.triggerId)];
+                    return PLStateMachineStateUndefined;
+                });
+                [machine registerStateWithId:stateA name:@"stateA" resolver:resolver];
+                [machine startWithState:stateA];
+                [executor drain];
+                return machine;
+            };
+        });
+
+        it(@"should reject triggers when full with the fail policy", ^{
+            PLStateMachine *machine = boundedMachine(PLStateMachineOverflowPolicyFail);
+
+            [[theValue([machine emitTriggerId:signalA object:@1]) should] beYes];
+            [[theValue([machine emitTriggerId:signalA object:@2]) should] beYes];
+            [[theValue([machine emitTriggerId:signalA object:@3]) should] beNo];
+            [executor drain];
+
+            [[processed should] equal:@[@1, @2]];
+            [[theValue(machine.queueStatistics.rejectedTriggerCount) should] equal:theValue(1)];
+            [[theValue(machine.queueStatistics.droppedTriggerCount) should] equal:theValue(0)];
+            [[theValue(machine.queueStatistics.highWaterMark) should] equal:theValue(2)];
+        });
+
+        it(@"should drop the newest triggers when full", ^{
+            PLStateMachine *machine = boundedMachine(PLStateMachineOverflowPolicyDropNewest);
+
+            [machine emitTriggerId:signalA object:@1];
+            [machine emitTriggerId:signalA object:@2];
+            [[theValue([machine emitTriggerId:signalA object:@3]) should] beNo];
+            [executor drain];
+
+            [[processed should] equal:@[@1, @2]];
+            [[theValue(machine.queueStatistics.droppedTriggerCount) should] equal:theValue(1)];
+        });
+
+        it(@"should drop the oldest triggers when full", ^{
+            PLStateMachine *machine = boundedMachine(PLStateMachineOverflowPolicyDropOldest);
+
+            [machine emitTriggerId:signalA object:@1];
+            [machine emitTriggerId:signalA object:@2];
+            [[theValue([machine emitTriggerId:signalA object:@3]) should] beYes];
+            [[theValue([machine emitTriggerId:signalA object:@4]) should] beYes];
+            [[theValue(machine.queueStatistics.queuedTriggerCount) should] equal:theValue(2)];
+            [executor drain];
+
+            [[processed should] equal:@[@3, @4]];
+            [[theValue(machine.queueStatistics.droppedTriggerCount) should] equal:theValue(2)];
+            [[theValue(machine.queueStatistics.queuedTriggerCount) should] equal:theValue(0)];
+        });
+
+        it(@"should replace queued triggers with the same id when full with the coalesce policy", ^{
+            PLStateMachine *machine = boundedMachine(PLStateMachineOverflowPolicyCoalesce);
+
+            [machine emitTriggerId:signalA object:@1];
+            [machine emitTriggerId:signalB object:@2];
+            [[theValue([machine emitTriggerId:signalA object:@3]) should] beYes];
+            [[theValue([machine emitTriggerId:signalA + 2 object:@4]) should] beNo];
+            [executor drain];
+
+            [[processed should] equal:@[@3, @2]];
+            [[theValue(machine.queueStatistics.coalescedTriggerCount) should] equal:theValue(1)];
+            [[theValue(machine.queueStatistics.droppedTriggerCount) should] equal:theValue(1)];
+        });
+
+        it(@"should not replace a queued trigger emitted with another priority with the coalesce policy", ^{
+            PLStateMachine *machine = boundedMachine(PLStateMachineOverflowPolicyCoalesce);
+
+            [machine emitTrigger:[PLStateMachineTrigger triggerWithId:signalA object:@1] priority:PLStateMachineTriggerPriorityBulk];
+            [machine emitTriggerId:signalB object:@2];
+            [[theValue([machine emitTrigger:[PLStateMachineTrigger triggerWithId:signalA object:@3] priority:PLStateMachineTriggerPriorityUrgent]) should] beNo];
+            [executor drain];
+
+            [[processed should] equal:@[@2, @1]];
+            [[theValue(machine.queueStatistics.coalescedTriggerCount) should] equal:theValue(0)];
+            [[theValue(machine.queueStatistics.droppedTriggerCount) should] equal:theValue(1)];
+        });
+
+        it(@"should queue the triggers of a batch one by one", ^{
+            PLStateMachine *machine = boundedMachine(PLStateMachineOverflowPolicyDropNewest);
+
+            PLStateMachineTriggerId const ids[] = {signalA, signalB, signalA};
+            [[theValue([machine emitTriggerIds:ids count:3]) should] beNo];
+            [executor drain];
+
+            [[processed should] equal:@[@(signalA), @(signalB)]];
+        });
+
+        it(@"should block the producer until there is room with the block policy", ^{
+            PLStateMachine *machine = [[PLStateMachine alloc] initWithDefinition:nil executor:nil capacity:1 overflowPolicy:PLStateMachineOverflowPolicyBlock];
+            dispatch_semaphore_t release = dispatch_semaphore_create(0);
+            __block NSUInteger processedCount = 0;
+            id <PLStateMachineResolver> resolver = blockResolver(^PLStateMachineStateId(PLStateMachineTrigger *trigger, PLStateMachine *fsm) {
+                if (processedCount++ == 0) {
+                    dispatch_semaphore_wait(release, DISPATCH_TIME_FOREVER);
+                }
+                return PLStateMachineStateUndefined;
+            });
+            [machine registerStateWithId:stateB name:@"stateB" resolver:resolver];
+            [machine startWithState:stateB];
+
+            [machine emitTriggerId:signalA];
+            [machine emitTriggerId:signalA];
+            __block BOOL thirdEmitted = NO;
+            dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+                [machine emitTriggerId:signalA];
+                thirdEmitted = YES;
+            });
+
+            [NSThread sleepForTimeInterval:0.1];
+            [[theValue(thirdEmitted) should] beNo];
+
+            dispatch_semaphore_signal(release);
+            [[expectFutureValue(theValue(thirdEmitted)) shouldEventually] beYes];
+            [machine wait];
+            [[theValue(processedCount) should] equal:theValue(3)];
+        });
+    });
+
+    describe(@"coalescing", ^{
+        PLStateMachineStateId stateA = 1;
+        PLStateMachineStateId stateB = 2;
+        PLStateMachineTriggerId refresh = 1;
+        PLStateMachineTriggerId update = 2;
+        PLStateMachineTriggerId other = 3;
+
+        __block PLStateMachineManualExecutor *executor;
+        __block NSMutableArray *processed;
+        __block PLStateMachine *machine;
+
+        beforeEach(^{
+            executor = [[PLStateMachineManualExecutor alloc] init];
+            processed = [NSMutableArray array];
+            machine = [[PLStateMachine alloc] initWithDefinition:nil executor:executor];
+            id <PLStateMachineResolver> resolver = blockResolver(^PLStateMachineStateId(PLStateMachineTrigger *trigger, PLStateMachine *fsm) {
+                [processed addObject:trigger.object != nil ? trigger.object : @(trigger.triggerId)];
+                return PLStateMachineStateUndefined;
+            });
+            [machine registerStateWithId:stateA name:@"stateA" resolver:resolver];
+            [machine registerStateWithId:stateB name:@"stateB" resolver:resolver];
+            [machine startWithState:stateA];
+            [executor drain];
+        });
+
+        it(@"should replace a queued trigger with the same id, keeping its place", ^{
+            [machine coalesceTriggerId:refresh];
+
+            [[theValue([machine emitTriggerId:refresh object:@1]) should] beYes];
+            [machine emitTriggerId:other object:@2];
+            [[theValue([machine emitTriggerId:refresh object:@3]) should] beYes];
+            [machine emitTriggerId:refresh object:@4];
+            [[theValue(machine.queueStatistics.queuedTriggerCount) should] equal:theValue(2)];
+            [executor drain];
+
+            [[processed should] equal:@[@4, @2]];
+            [[theValue(machine.queueStatistics.coalescedTriggerCount) should] equal:theValue(2)];
+        });
+
+        it(@"should only replace triggers with an equal key", ^{
+            [machine coalesceTriggerId:update byKey:^id <NSObject, NSCopying>(PLStateMachineTrigger *trigger) {
+                return ((NSDictionary *) trigger.object)[@"key"];
+            }];
+
+            [machine emitTriggerId:update object:@{@"key" : @"a", @"value" : @1}];
+            [machine emitTriggerId:update object:@{@"key" : @"b", @"value" : @2}];
+            [machine emitTriggerId:update object:@{@"key" : @"a", @"value" : @3}];
+            [executor drain];
+
+            [[[processed valueForKey:@"value"] should] equal:@[@3, @2]];
+        });
+
+        it(@"should not replace a queued trigger emitted with another priority", ^{
+            [machine coalesceTriggerId:refresh];
+
+            [machine emitTrigger:[PLStateMachineTrigger triggerWithId:refresh object:@1] priority:PLStateMachineTriggerPriorityBulk];
+            [machine emitTriggerId:other object:@2];
+            [machine emitTrigger:[PLStateMachineTrigger triggerWithId:refresh object:@3] priority:PLStateMachineTriggerPriorityUrgent];
+            [executor drain];
+
+            [[processed should] equal:@[@3, @2, @1]];
+            [[theValue(machine.queueStatistics.coalescedTriggerCount) should] equal:theValue(0)];
+        });
+
+        it(@"should not replace a queued trigger scoped to another state entry", ^{
+            PLStateMachineVirtualClock *clock = [[PLStateMachineVirtualClock alloc] initWithTime:100];
+            PLStateMachine *scopedMachine = [[PLStateMachine alloc] initWithDefinition:nil executor:executor clock:clock];
+            id <PLStateMachineResolver> resolver = blockResolver(^PLStateMachineStateId(PLStateMachineTrigger *trigger, PLStateMachine *fsm) {
+                [processed addObject:trigger.object];
+                return PLStateMachineStateUndefined;
+            });
+            [scopedMachine registerStateWithId:stateA name:@"stateA" resolver:resolver];
+            [scopedMachine registerStateWithId:stateB name:@"stateB" resolver:resolver];
+            [scopedMachine startWithState:stateA];
+            [executor drain];
+            [scopedMachine coalesceTriggerId:refresh];
+
+            [scopedMachine emitTrigger:[PLStateMachineTrigger triggerWithId:refresh object:@1] afterDelay:1 cancelOnLeavingState:YES];
+            [clock advanceBy:1];
+            [scopedMachine emitTriggerId:refresh object:@2];
+            //urgent, leaves the state before the triggers are processed
+            [scopedMachine startWithState:stateB];
+            [executor drain];
+
+            [[processed should] equal:@[@2]];
+        });
+
+        it(@"should queue a trigger again once the replaced one was processed", ^{
+            [machine coalesceTriggerId:refresh];
+
+            [machine emitTriggerId:refresh object:@1];
+            [executor drain];
+            [machine emitTriggerId:refresh object:@2];
+            [executor drain];
+
+            [[processed should] equal:@[@1, @2]];
+        });
+
+        it(@"should coalesce into a full bounded queue, never into the triggers it turned away", ^{
+            PLStateMachine *boundedMachine = [[PLStateMachine alloc] initWithDefinition:machine.definition executor:executor capacity:1 overflowPolicy:PLStateMachineOverflowPolicyFail];
+            [boundedMachine startWithState:stateA];
+            [executor drain];
+            [boundedMachine coalesceTriggerId:refresh];
+
+            [[theValue([boundedMachine emitTriggerId:refresh object:@1]) should] beYes];
+            [[theValue([boundedMachine emitTriggerId:refresh object:@2]) should] beYes];
+            [[theValue([boundedMachine emitTriggerId:other object:@3]) should] beNo];
+            [executor drain];
+            [boundedMachine emitTriggerId:other object:@4];
+
+            //rejected on several threads at once, none of them may be told it replaced another one's trigger
+            __block NSUInteger acceptedCount = 0;
+            dispatch_apply(4, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t producer) {
+                for (NSUInteger i = 0; i < 1000; ++i) {
+                    if ([boundedMachine emitTriggerId:refresh object:@(i)]) {
+                        @synchronized (processed) {
+                            ++acceptedCount;
+                        }
+                    }
+                }
+            });
+            [executor drain];
+
+            [[theValue(acceptedCount) should] equal:theValue(0)];
+            [[processed should] equal:@[@2, @4]];
+            [[theValue(boundedMachine.queueStatistics.rejectedTriggerCount) should] equal:theValue(4001)];
+        });
+
+        it(@"should not coalesce other trigger ids nor batches of them", ^{
+            [machine coalesceTriggerId:refresh];
+
+            PLStateMachineTriggerId const ids[] = {other, refresh, other, refresh};
+            [machine emitTriggerIds:ids count:4];
+            [executor drain];
+
+            [[processed should] equal:@[@(other), @(refresh), @(other)]];
+        });
+
+        it(@"should not coalesce triggers emitted from the machine itself", ^{
+            [machine coalesceTriggerId:refresh];
+            [machine onEntering:stateB call:^(PLStateMachine *fsm) {
+                [fsm emitTriggerId:refresh object:@1];
+                [fsm emitTriggerId:refresh object:@2];
+            } owner:nil];
+
+            [machine startWithState:stateB];
+            [executor drain];
+
+            [[processed should] equal:@[@1, @2]];
+        });
+
+        it(@"should throw an exception if a trigger id is coalesced twice", ^{
+            [machine coalesceTriggerId:refresh];
+
+            [[theBlock(^{
+                [machine coalesceTriggerId:refresh];
+            }) should] raiseWithName:@"InvalidArgumentException"];
+        });
+    });
+
+    describe(@"priority lanes", ^{
+        PLStateMachineStateId stateA = 1;
+        PLStateMachineTriggerId signalA = 1;
+
+        __block PLStateMachineManualExecutor *executor;
+        __block NSMutableArray *processed;
+        __block PLStateMachine *machine;
+        __block void (^emit)(NSNumber *, PLStateMachineTriggerPriority);
+
+        beforeEach(^{
+            executor = [[PLStateMachineManualExecutor alloc] init];
+            processed = [NSMutableArray array];
+            machine = [[PLStateMachine alloc] initWithDefinition:nil executor:executor];
+            id <PLStateMachineResolver> resolver = blockResolver(^PLStateMachineStateId(PLStateMachineTrigger *trigger, PLStateMachine *fsm) {
+                [processed addObject:trigger.object];
+                return PLStateMachineStateUndefined;
+            });
+            [machine registerStateWithId:stateA name:@"stateA" resolver:resolver];
+            [machine startWithState:stateA];
+            [executor drain];
+            emit = ^(NSNumber *object, PLStateMachineTriggerPriority priority) {
+                [machine emitTrigger:[PLStateMachineTrigger triggerWithId:signalA object:object] priority:priority];
+            };
+        });
+
+        it(@"should drain the lanes strictly by priority, each in emission order", ^{
+            emit(@1, PLStateMachineTriggerPriorityBulk);
+            emit(@2, PLStateMachineTriggerPriorityBulk);
+            emit(@3, PLStateMachineTriggerPriorityNormal);
+            emit(@4, PLStateMachineTriggerPriorityUrgent);
+            emit(@5, PLStateMachineTriggerPriorityUrgent);
+            [machine emitTriggerId:signalA object:@6];
+            [executor drain];
+
+            [[processed should] equal:@[@4, @5, @3, @6, @1, @2]];
+        });
+
+        it(@"should drain a starving lane once it was passed over starvationLimit times", ^{
+            machine.starvationLimit = 2;
+
+            emit(@1, PLStateMachineTriggerPriorityBulk);
+            emit(@2, PLStateMachineTriggerPriorityBulk);
+            for (NSUInteger i = 3; i <= 7; ++i) {
+                emit(@(i), PLStateMachineTriggerPriorityUrgent);
+            }
+            [executor drain];
+
+            [[processed should] equal:@[@3, @4, @1, @5, @6, @2, @7]];
+        });
+
+        it(@"should count the depth and the waits of each lane", ^{
+            emit(@1, PLStateMachineTriggerPriorityBulk);
+            emit(@2, PLStateMachineTriggerPriorityBulk);
+            emit(@3, PLStateMachineTriggerPriorityUrgent);
+
+            [[theValue([machine statisticsForPriority:PLStateMachineTriggerPriorityBulk].depth) should] equal:theValue(2)];
+            [[theValue([machine statisticsForPriority:PLStateMachineTriggerPriorityUrgent].depth) should] equal:theValue(1)];
+            [executor drain];
+
+            PLStateMachineLaneStatistics bulk = [machine statisticsForPriority:PLStateMachineTriggerPriorityBulk];
+            [[theValue(bulk.depth) should] equal:theValue(0)];
+            [[theValue(bulk.processedRecordCount) should] equal:theValue(2)];
+            [[theValue(bulk.maxWaitTime) should] beGreaterThan:theValue(0)];
+            [[theValue(bulk.totalWaitTime) should] beGreaterThanOrEqualTo:theValue(bulk.maxWaitTime)];
+        });
+
+        it(@"should keep the lanes of a bounded machine", ^{
+            machine = [[PLStateMachine alloc] initWithDefinition:machine.definition executor:executor capacity:2 overflowPolicy:PLStateMachineOverflowPolicyDropOldest];
+            [machine startWithState:stateA];
+            [executor drain];
+
+            emit(@1, PLStateMachineTriggerPriorityBulk);
+            emit(@2, PLStateMachineTriggerPriorityUrgent);
+            emit(@3, PLStateMachineTriggerPriorityNormal);
+            [executor drain];
+
+            [[processed should] equal:@[@2, @3]];
+        });
+
+        it(@"should throw an exception for an unknown priority", ^{
+            [[theBlock(^{
+                emit(@1, (PLStateMachineTriggerPriority) PLSTATE_MACHINE_PRIORITY_COUNT);
+            }) should] raiseWithName:@"InvalidArgumentException"];
+        });
+    });
+
+    describe(@"state timeouts", ^{
+        PLStateMachineStateId stateA = 1;
+        PLStateMachineStateId stateB = 2;
+        PLStateMachineTriggerId signalB = 1;
+        PLStateMachineTriggerId timeout = 2;
+
+        __block PLStateMachine *machine;
+
+        beforeEach(^{
+            machine = [[PLStateMachine alloc] initWithQueue:nil];
+            [machine registerStateWithId:stateA name:@"stateA" resolver:mapResolver(@{@(signalB) : @(stateB), @(timeout) : @(stateB)}) timeout:0.05 trigger:timeout];
+            [machine registerStateWithId:stateB name:@"stateB" resolver:mapResolver(@{@(timeout) : @(stateA)})];
+        });
+
+        it(@"should emit the timeout trigger once the timeout passed in the state", ^{
+            [machine startWithState:stateA];
+
+            [[expectFutureValue(theValue(machine.state)) shouldEventually] equal:theValue(stateB)];
+            [[theValue(machine.triggeredBy.triggerId) should] equal:theValue(timeout)];
+        });
+
+        it(@"should cancel the timeout when the state is left", ^{
+            [machine startWithState:stateA];
+            [machine emitTriggerId:signalB];
+            [machine wait];
+
+            [NSThread sleepForTimeInterval:0.15];
+            [machine wait];
+            [[theValue(machine.state) should] equal:theValue(stateB)];
+            [[theValue(machine.triggeredBy.triggerId) should] equal:theValue(signalB)];
+        });
+
+        it(@"should not keep the machine alive while a timeout is armed", ^{
+            __weak PLStateMachine *weakMachine;
+            @autoreleasepool {
+                PLStateMachineDefinition *definition = machine.definition;
+                PLStateMachine *timedMachine = [[PLStateMachine alloc] initWithDefinition:definition executor:[[PLStateMachineManualExecutor alloc] init]];
+                [timedMachine startWithState:stateA];
+                [timedMachine wait];
+                weakMachine = timedMachine;
+            }
+
+            [[weakMachine should] beNil];
+        });
+
+        it(@"should throw an exception if the timeout is negative", ^{
+            [[theBlock(^{
+                [machine registerStateWithId:3 name:@"stateC" resolver:mapResolver(@{}) timeout:-1 trigger:timeout];
+            }) should] raiseWithName:@"InvalidArgumentException"];
+        });
+
+        it(@"should throw an exception if the leeway is negative", ^{
+            [[theBlock(^{
+                [machine registerStateWithId:3 name:@"stateC" resolver:mapResolver(@{}) timeout:1 leeway:-1 trigger:timeout];
+            }) should] raiseWithName:@"InvalidArgumentException"];
+        });
+    });
+
+    describe(@"scheduled triggers", ^{
+        PLStateMachineStateId stateA = 1;
+        PLStateMachineStateId stateB = 2;
+        PLStateMachineTriggerId signalB = 1;
+        PLStateMachineTriggerId signalC = 2;
+
+        __block PLStateMachine *machine;
+
+        beforeEach(^{
+            machine = [[PLStateMachine alloc] initWithQueue:nil];
+            [machine registerStateWithId:stateA name:@"stateA" resolver:mapResolver(@{@(signalB) : @(stateB), @(signalC) : @(stateB)})];
+            [machine registerStateWithId:stateB name:@"stateB" resolver:mapResolver(@{@(signalC) : @(stateA)})];
+            [machine startWithState:stateA];
+            [machine wait];
+        });
+
+        it(@"should emit a trigger after a delay", ^{
+            [machine emitTrigger:[PLStateMachineTrigger triggerWithId:signalB] afterDelay:0.05];
+            [machine wait];
+            [[theValue(machine.state) should] equal:theValue(stateA)];
+
+            [[expectFutureValue(theValue(machine.state)) shouldEventually] equal:theValue(stateB)];
+        });
+
+        it(@"should emit a trigger at a time", ^{
+            [machine emitTrigger:[PLStateMachineTrigger triggerWithId:signalB] atTime:machine.currentTime + 0.05];
+
+            [[expectFutureValue(theValue(machine.state)) shouldEventually] equal:theValue(stateB)];
+        });
+
+        it(@"should never emit a trigger before its time", ^{
+            __block NSTimeInterval enteredAt = 0;
+            [machine onEntering:stateB call:^(PLStateMachine *fsm) {
+                enteredAt = fsm.currentTime;
+            } owner:nil];
+
+            //between two ticks, rounding the current time up would fire it early
+            NSTimeInterval time = machine.currentTime + 0.0205;
+            [machine emitTrigger:[PLStateMachineTrigger triggerWithId:signalB] atTime:time];
+
+            [[expectFutureValue(theValue(machine.state)) shouldEventually] equal:theValue(stateB)];
+            [[theValue(enteredAt) should] beGreaterThanOrEqualTo:theValue(time)];
+        });
+
+        it(@"should not emit a cancelled trigger", ^{
+            id token = [machine emitTrigger:[PLStateMachineTrigger triggerWithId:signalB] afterDelay:0.05];
+            [[theValue([machine cancelScheduledTrigger:token]) should] beYes];
+            [[theValue([machine cancelScheduledTrigger:token]) should] beNo];
+
+            [NSThread sleepForTimeInterval:0.1];
+            [machine wait];
+            [[theValue(machine.state) should] equal:theValue(stateA)];
+        });
+
+        it(@"should cancel a trigger scoped to the state once the state is left", ^{
+            id token = [machine emitTrigger:[PLStateMachineTrigger triggerWithId:signalC] afterDelay:0.05 cancelOnLeavingState:YES];
+            [machine emitTriggerId:signalB];
+            [machine wait];
+
+            [NSThread sleepForTimeInterval:0.1];
+            [machine wait];
+            [[theValue(machine.state) should] equal:theValue(stateB)];
+            [[theValue([machine cancelScheduledTrigger:token]) should] beNo];
+        });
+
+        it(@"should emit a trigger scoped to the state while the state isn't left", ^{
+            [machine emitTrigger:[PLStateMachineTrigger triggerWithId:signalC] afterDelay:0.05 cancelOnLeavingState:YES];
+
+            [[expectFutureValue(theValue(machine.state)) shouldEventually] equal:theValue(stateB)];
+        });
+
+        it(@"should not emit a trigger with a leeway before its time", ^{
+            __block NSTimeInterval emittedAt = 0;
+            [machine onEntering:stateB call:^(PLStateMachine *stateMachine) {
+                emittedAt = stateMachine.currentTime;
+            } owner:nil];
+            NSTimeInterval time = machine.currentTime + 0.05;
+            [machine emitTrigger:[PLStateMachineTrigger triggerWithId:signalB] atTime:time leeway:0.1 cancelOnLeavingState:NO];
+
+            [[expectFutureValue(theValue(machine.state)) shouldEventually] equal:theValue(stateB)];
+            [[theValue(emittedAt) should] beGreaterThanOrEqualTo:theValue(time)];
+        });
+
+        it(@"should fire triggers due within their leeway together", ^{
+            NSUInteger const machineCount = 20;
+            NSMutableArray *machines = [NSMutableArray array];
+            for (NSUInteger i = 0; i < machineCount; ++i) {
+                PLStateMachine *scheduledMachine = [[PLStateMachine alloc] initWithDefinition:machine.definition executor:nil];
+                [scheduledMachine startWithState:stateA];
+                [machines addObject:scheduledMachine];
+            }
+
+            PLStateMachineTimerStatistics before = [PLStateMachine timerStatistics];
+            NSTimeInterval now = machine.currentTime;
+            for (NSUInteger i = 0; i < machineCount; ++i) {
+                PLStateMachine *scheduledMachine = machines[i];
+                [scheduledMachine emitTrigger:[PLStateMachineTrigger triggerWithId:signalB] atTime:now + 0.05 + i * 0.001 leeway:0.1 cancelOnLeavingState:NO];
+            }
+
+            NSUInteger (^enteredCount)(void) = ^{
+                NSUInteger count = 0;
+                for (PLStateMachine *scheduledMachine in machines) {
+                    count += scheduledMachine.state == stateB ? 1 : 0;
+                }
+                return count;
+            };
+            [[expectFutureValue(theValue(enteredCount())) shouldEventually] equal:theValue(machineCount)];
+            PLStateMachineTimerStatistics after = [PLStateMachine timerStatistics];
+            [[theValue(after.firedTimerCount - before.firedTimerCount) should] beGreaterThanOrEqualTo:theValue(machineCount)];
+            [[theValue(after.wakeupCount - before.wakeupCount) should] beLessThan:theValue(machineCount / 2)];
+        });
+
+        it(@"should throw an exception if the leeway is negative", ^{
+            [[theBlock(^{
+                [machine emitTrigger:[PLStateMachineTrigger triggerWithId:signalB] atTime:machine.currentTime leeway:-1 cancelOnLeavingState:NO];
+            }) should] raiseWithName:@"InvalidArgumentException"];
+        });
     });
 });
 
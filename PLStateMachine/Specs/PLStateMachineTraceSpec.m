@@ -0,0 +1,169 @@
+#import <Kiwi/Kiwi.h>
+#import <fcntl.h>
+#import "PLStateMachine.h"
+#import "PLStateMachineTrace.h"
+#import "PLStateMachineTraceRing.h"
+#import "PLStateMachineVirtualClock.h"
+#import "PLStateMachineDefinition.h"
+#import "PLStateMachinePool.h"
+#import "PLStateMachineMapResolver.h"
+#import "PLStateMachineInlineExecutor.h"
+
+SPEC_BEGIN(PLStateMachineTraceSpec)
+
+describe(@"PLStateMachineTrace", ^{
+    PLStateMachineStateId stateA = 1;
+    PLStateMachineStateId stateB = 2;
+    PLStateMachineTriggerId signalA = 1;
+    PLStateMachineTriggerId signalB = 2;
+    PLStateMachineTriggerId signalC = 3;
+
+    __block PLStateMachineVirtualClock *clock;
+    __block PLStateMachineDefinition *definition;
+    __block PLStateMachine *machine;
+
+    beforeEach(^{
+        clock = [[PLStateMachineVirtualClock alloc] initWithTime:100];
+        definition = [[PLStateMachineDefinition alloc] init];
+        [definition registerStateWithId:stateA name:@"stateA" resolver:mapResolver(@{@(signalA) : @(stateB)})];
+        [definition registerStateWithId:stateB name:@"stateB" resolver:mapResolver(@{@(signalB) : @(stateA)})];
+        [definition freeze];
+        machine = [[PLStateMachine alloc] initWithDefinition:definition executor:[[PLStateMachineInlineExecutor alloc] init] clock:clock];
+    });
+
+    it(@"should trace a start, transitions and ignored triggers in order", ^{
+        PLStateMachineTraceRecord records[2 * PLSTATE_MACHINE_TRACE_CAPACITY];
+        [machine startWithState:stateA];
+        [clock advanceBy:1];
+        [machine emitTriggerId:signalA];
+        [clock advanceBy:1];
+        [machine emitTriggerId:signalC];
+
+        NSUInteger count = [machine copyTrace:records maxCount:2 * PLSTATE_MACHINE_TRACE_CAPACITY];
+
+        [[theValue(count) should] equal:theValue(3)];
+        [[theValue(records[0].outcome) should] equal:theValue(PLStateMachineTraceOutcomeStarted)];
+        [[theValue(records[0].prevState) should] equal:theValue(PLStateMachineStateUndefined)];
+        [[theValue(records[0].state) should] equal:theValue(stateA)];
+        [[theValue(records[0].timestamp) should] equal:theValue(100.0)];
+        [[theValue(records[1].outcome) should] equal:theValue(PLStateMachineTraceOutcomeTransitioned)];
+        [[theValue(records[1].prevState) should] equal:theValue(stateA)];
+        [[theValue(records[1].state) should] equal:theValue(stateB)];
+        [[theValue(records[1].triggerId) should] equal:theValue(signalA)];
+        [[theValue(records[1].timestamp) should] equal:theValue(101.0)];
+        [[theValue(records[2].outcome) should] equal:theValue(PLStateMachineTraceOutcomeUnresolved)];
+        [[theValue(records[2].prevState) should] equal:theValue(stateB)];
+        [[theValue(records[2].state) should] equal:theValue(PLStateMachineStateUndefined)];
+        [[theValue(records[2].triggerId) should] equal:theValue(signalC)];
+    });
+
+    it(@"should keep only the newest records once the ring wraps", ^{
+        PLStateMachineTraceRecord records[2 * PLSTATE_MACHINE_TRACE_CAPACITY];
+        [machine startWithState:stateA];
+        for (NSUInteger i = 0; i < PLSTATE_MACHINE_TRACE_CAPACITY; ++i) {
+            [machine emitTriggerId:signalA];
+            [machine emitTriggerId:signalB];
+        }
+
+        NSUInteger count = [machine copyTrace:records maxCount:2 * PLSTATE_MACHINE_TRACE_CAPACITY];
+
+        [[theValue(count) should] equal:theValue(PLSTATE_MACHINE_TRACE_CAPACITY)];
+        [[theValue(records[count - 1].triggerId) should] equal:theValue(signalB)];
+        [[theValue(records[count - 1].state) should] equal:theValue(stateA)];
+        for (NSUInteger i = 0; i < count; ++i) {
+            [[theValue(records[i].outcome) should] equal:theValue(PLStateMachineTraceOutcomeTransitioned)];
+        }
+    });
+
+    it(@"should copy the newest records into a smaller buffer", ^{
+        PLStateMachineTraceRecord records[2 * PLSTATE_MACHINE_TRACE_CAPACITY];
+        [machine startWithState:stateA];
+        [machine emitTriggerId:signalA];
+        [machine emitTriggerId:signalB];
+
+        NSUInteger count = [machine copyTrace:records maxCount:1];
+
+        [[theValue(count) should] equal:theValue(1)];
+        [[theValue(records[0].triggerId) should] equal:theValue(signalB)];
+    });
+
+    it(@"should keep tracing once the record indices pass 32 bits", ^{
+        PLStateMachineTraceRecord records[8];
+        PLStateMachineTraceRing *ring = PLStateMachineTraceRingCreate(4, NULL, 0);
+        PLStateMachineTraceRingReserve(ring, UINT32_MAX - 1);
+        for (NSUInteger i = 0; i < 8; ++i) {
+            PLStateMachineTraceRingWrite(ring, i, stateA, stateB, i, 0, PLStateMachineTraceOutcomeTransitioned);
+        }
+
+        NSUInteger count = PLStateMachineTraceRingCopy(ring, records, 8);
+        PLStateMachineTraceRingFree(ring);
+
+        [[theValue(count) should] equal:theValue(4)];
+        for (NSUInteger i = 0; i < count; ++i) {
+            [[theValue(records[i].triggerId) should] equal:theValue(4 + i)];
+        }
+    });
+
+    it(@"should describe the trace with state names", ^{
+        [machine startWithState:stateA];
+        [machine emitTriggerId:signalA];
+
+        NSString *description = [machine traceDescription];
+
+        [[theValue([description rangeOfString:@"stateA -> stateB on 1 transitioned"].location) shouldNot] equal:theValue(NSNotFound)];
+    });
+
+    it(@"should trace the instances of a pool", ^{
+        PLStateMachineTraceRecord records[2 * PLSTATE_MACHINE_TRACE_CAPACITY];
+        PLStateMachinePool *pool = [[PLStateMachinePool alloc] initWithDefinition:definition capacity:0 clock:clock];
+        [pool addInstanceWithState:stateA];
+        PLStateMachinePoolHandle handle = [pool addInstanceWithState:stateB];
+        [pool emitTriggerId:signalA toInstance:handle];
+        [pool emitTriggerIdToAllInstances:signalA changedHandles:NULL];
+
+        NSUInteger count = [pool copyTrace:records maxCount:2 * PLSTATE_MACHINE_TRACE_CAPACITY];
+
+        [[theValue(count) should] equal:theValue(4)];
+        [[theValue(records[1].outcome) should] equal:theValue(PLStateMachineTraceOutcomeStarted)];
+        [[theValue(records[1].instance) should] equal:theValue(handle)];
+        [[theValue(records[2].outcome) should] equal:theValue(PLStateMachineTraceOutcomeUnresolved)];
+        [[theValue(records[2].instance) should] equal:theValue(handle)];
+        [[theValue(records[3].outcome) should] equal:theValue(PLStateMachineTraceOutcomeTransitioned)];
+        [[theValue(records[3].prevState) should] equal:theValue(stateA)];
+        [[theValue(records[3].state) should] equal:theValue(stateB)];
+        [[theValue(records[3].triggerId) should] equal:theValue(signalA)];
+    });
+
+    it(@"should dump the rings of live machines to a file descriptor", ^{
+        [machine startWithState:stateA];
+        [machine emitTriggerId:signalA];
+
+        NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"PLStateMachineTraceSpec.trace"];
+        int fd = open([path fileSystemRepresentation], O_CREAT | O_TRUNC | O_WRONLY, 0644);
+        BOOL written = PLStateMachineTraceWriteAll(fd);
+        close(fd);
+        NSData *dump = [NSData dataWithContentsOfFile:path];
+        [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+
+        [[theValue(written) should] beYes];
+        const PLStateMachineTraceDumpHeader *header = dump.bytes;
+        [[theValue(header->magic) should] equal:theValue(0x504C5452)];
+        [[theValue(header->recordSize) should] equal:theValue(sizeof(PLStateMachineTracePackedRecord))];
+
+        BOOL found = NO;
+        NSUInteger offset = sizeof(PLStateMachineTraceDumpHeader);
+        for (uint32_t i = 0; i < header->ringCount; ++i) {
+            const PLStateMachineTraceDumpRing *ring = (const PLStateMachineTraceDumpRing *) ((const uint8_t *) dump.bytes + offset);
+            if (ring->owner == (uint64_t) (uintptr_t) (__bridge void *) machine) {
+                found = YES;
+                [[theValue(ring->recordCount) should] equal:theValue(2)];
+                [[theValue(ring->ownerKind) should] equal:theValue(0)];
+            }
+            offset += sizeof(PLStateMachineTraceDumpRing) + ring->recordCount * header->recordSize;
+        }
+        [[theValue(found) should] beYes];
+        [[theValue(offset) should] equal:theValue(dump.length)];
+    });
+});
+
+SPEC_END
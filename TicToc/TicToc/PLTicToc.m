@@ -107,12 +107,13 @@ action callbacks is presented. As are both map and block resolvers.
 
 
         //This is a action registration call. The block will be called when transitioning to PLTicTocStateClick.
+        //The timeout trigger is scoped to the state, it is cancelled as soon as the machine leaves it.
         [_fsm onEntering:PLTicTocStateClick
                     call:^(PLStateMachine *fsm) {
                         NSLog(@"onEntering");
-                        [weakSelf performSelector:@selector(timeout)
-                                       withObject:nil
-                                       afterDelay:weakSelf.interval * 1.1f];
+                        [fsm emitTrigger:[PLStateMachineTrigger triggerWithId:PLTicTocTriggerTimeout]
+                              afterDelay:weakSelf.interval * 1.1f
+                    cancelOnLeavingState:YES];
                     }
                    owner:nil];
 
@@ -124,15 +125,6 @@ action callbacks is presented. As are both map and block resolvers.
                    }
                   owner:nil];
 
-        [_fsm onLeaving:PLTicTocStateClick
-                   call:^(PLStateMachine *fsm) {
-                       NSLog(@"onLeaving");
-                       [NSObject cancelPreviousPerformRequestsWithTarget:weakSelf
-                                                                selector:@selector(timeout)
-                                                                  object:nil];
-                   }
-                  owner:nil];
-
         [_fsm registerStateWithId:PLTicTocStateResult
                              name:@"Result"
                          resolver:mapResolver(@{
@@ -181,8 +173,4 @@ Just to be pedantic about KVC.
     [_fsm emitTriggerId:PLTicTocTriggerTic];
 }
 
-- (void)timeout {
-    [_fsm emitTriggerId:PLTicTocTriggerTimeout];
-}
-
 @end
\ No newline at end of file